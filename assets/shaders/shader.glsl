@@ -1,65 +1,117 @@
 #version 330
 
-in vec2 fragTexCoord;
-in vec4 fragColor;
 out vec4 finalColor;
 
-uniform sampler2D texture0;
 uniform sampler2D fontAtlasTexture;
-uniform sampler2D gridTexture;
-uniform ivec2 gridSize;
+uniform sampler2D layer0Texture;
+uniform sampler2D layer1Texture;
+uniform sampler2D layer2Texture;
 uniform ivec2 cellSize;
+uniform int viewHeight; // of the framebuffer, to flip gl_FragCoord
 
-// Standard VGA 16-color palette
-const vec3 vgaPalette[16] = vec3[](
-        vec3(0.00, 0.00, 0.00), // 0: Black
-        vec3(0.00, 0.00, 0.67), // 1: Blue
-        vec3(0.00, 0.67, 0.00), // 2: Green
-        vec3(0.00, 0.67, 0.67), // 3: Cyan
-        vec3(0.67, 0.00, 0.00), // 4: Red
-        vec3(0.67, 0.00, 0.67), // 5: Magenta
-        vec3(0.67, 0.33, 0.00), // 6: Brown/Yellow
-        vec3(0.67, 0.67, 0.67), // 7: Light Gray
-        vec3(0.33, 0.33, 0.33), // 8: Dark Gray
-        vec3(0.33, 0.33, 1.00), // 9: Light Blue
-        vec3(0.33, 1.00, 0.33), // 10: Light Green
-        vec3(0.33, 1.00, 1.00), // 11: Light Cyan
-        vec3(1.00, 0.33, 0.33), // 12: Light Red
-        vec3(1.00, 0.33, 1.00), // 13: Light Magenta
-        vec3(1.00, 1.00, 0.33), // 14: Yellow
-        vec3(1.00, 1.00, 1.00) // 15: White
-    );
+// Texture row of each layer's top grid row, Grid.origin in grid.h. A whole
+// layer scrolls by moving this instead of re-uploading its cells.
+uniform int rowOrigins[3];
 
-void main() {
-    // Sample grid data
-    vec4 gridSample = texture(gridTexture, fragTexCoord);
+// Colors of the 16 indices, the VGA palette unless te.graphics.setPalette
+// changed them
+uniform vec3 palette[16];
+
+// Palette cycle groups 1-3: colors [x, x + y) rotate cycleRates[i] steps a
+// second (PaletteCycle in palette.h)
+uniform ivec2 cycles[3];
+uniform float cycleRates[3];
+
+// Seconds since the start, animates the attributes
+uniform float time;
+
+// Color index that shows the layer below (VGA_TRANSPARENT in colors.h)
+const int TRANSPARENT = 255;
+
+// Cell.flags bits, CELL_ATTRIBUTE_LIST in grid.h
+const int BLINK = 0x01;
+const int REVERSE = 0x02;
+const int UNDERLINE = 0x04;
+const int BRIGHT = 0x08;
+const int CYCLE_SHIFT = 4;
+const float BLINK_HZ = 2.0; // PALETTE_BLINK_HZ in palette.h
+
+int cycleColor(int color, int group) {
+    ivec2 range = cycles[group];
+    if (color < range.x || color >= range.x + range.y)
+        return color;
+
+    // mod() of floats keeps a backwards cycle's step positive
+    int step = int(mod(floor(time * cycleRates[group]), float(range.y)));
+    return range.x + (color - range.x + step) % range.y;
+}
+
+// Draws one layer's cell over `below`. `cell` is the grid cell and `pixel`
+// the position inside it, both in whole pixels of the glyph atlas.
+vec3 compositeLayer(vec3 below, sampler2D layerTexture, int rowOrigin,
+                    ivec2 cell, ivec2 pixel) {
+    // Fetch grid data, no filtering or normalized coordinates involved
+    int rows = textureSize(layerTexture, 0).y;
+    ivec2 stored = ivec2(cell.x, (cell.y + rowOrigin) % rows);
+    vec4 gridSample = texelFetch(layerTexture, stored, 0);
     int glyph = int(gridSample.r * 255.0);
     int fgColor = int(gridSample.g * 255.0);
     int bgColor = int(gridSample.b * 255.0);
+    int flags = int(gridSample.a * 255.0);
 
-    // Clamp to valid VGA palette indices (0-15)
-    fgColor = fgColor & 15;
-    bgColor = bgColor & 15;
-
-    // Determine position within the cell
-    vec2 cellUV = fract(fragTexCoord * vec2(gridSize));
+    // Attributes, in the order of palette_resolve
+    int group = flags >> CYCLE_SHIFT & 3;
+    if (group > 0) {
+        if (fgColor != TRANSPARENT)
+            fgColor = cycleColor(fgColor, group - 1);
+        if (bgColor != TRANSPARENT)
+            bgColor = cycleColor(bgColor, group - 1);
+    }
+    if ((flags & BRIGHT) != 0 && fgColor != TRANSPARENT)
+        fgColor |= 8;
+    if ((flags & REVERSE) != 0) {
+        int fg = fgColor;
+        fgColor = bgColor;
+        bgColor = fg;
+    }
 
     // Decode CP437: 16x16 grid in font atlas
     int gx = glyph & 15;
     int gy = glyph >> 4;
 
-    // Calculate position in font atlas
-    vec2 atlasUV = (vec2(gx, gy) + cellUV) / 16.0;
+    // Fetch from font atlas, then draw the underline and hide blinked off
+    // glyphs
+    float coverage =
+        texelFetch(fontAtlasTexture, ivec2(gx, gy) * cellSize + pixel, 0).r;
+    if ((flags & UNDERLINE) != 0 && pixel.y == cellSize.y - 1)
+        coverage = 1.0;
+    if ((flags & BLINK) != 0 && int(floor(time * BLINK_HZ * 2.0)) % 2 != 0)
+        coverage = 0.0;
 
-    // Sample from font atlas
-    vec4 fontSample = texture(fontAtlasTexture, atlasUV);
-
-    // Get colors from palette
-    vec3 fgRGB = vgaPalette[fgColor];
-    vec3 bgRGB = vgaPalette[bgColor];
+    // Get colors from palette (clamped to valid VGA indices 0-15), letting
+    // transparent ones through
+    vec3 bgRGB = bgColor == TRANSPARENT ? below : palette[bgColor & 15];
+    vec3 fgRGB = fgColor == TRANSPARENT ? bgRGB : palette[fgColor & 15];
 
     // Blend: use font alpha to interpolate between bg and fg
-    vec3 color = mix(bgRGB, fgRGB, fontSample.r);
+    return mix(bgRGB, fgRGB, coverage);
+}
+
+void main() {
+    // Pixel from the top-left, the quad covers exactly the grid
+    ivec2 frag = ivec2(gl_FragCoord.xy);
+    frag.y = viewHeight - 1 - frag.y;
+    ivec2 cell = frag / cellSize;
+    ivec2 pixel = frag - cell * cellSize;
+
+    // Layers back to front, ENGINE_MAX_LAYERS in engine.h
+    vec3 color = vec3(0.0);
+    color = compositeLayer(color, layer0Texture, rowOrigins[0], cell,
+                           pixel);
+    color = compositeLayer(color, layer1Texture, rowOrigins[1], cell,
+                           pixel);
+    color = compositeLayer(color, layer2Texture, rowOrigins[2], cell,
+                           pixel);
 
     finalColor = vec4(color, 1.0);
 }
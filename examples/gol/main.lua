@@ -1,21 +1,18 @@
 local w, h
-local grid = {}
-local nextGrid = {}
+local cells, nextCells, counts
+local population = 0
 local timer = 0
 local updateInterval = 0.01 -- seconds per step
 local running = true
 local music
+local edges = "clamp" -- the board ends at the window instead of wrapping
 
--- helper function to create empty grid
-local function createGrid()
-	local g = {}
-	for y = 1, h do
-		g[y] = {}
-		for x = 1, w do
-			g[y][x] = 0
-		end
+-- fill the board with a random starting pattern
+local function randomize()
+	for i = 1, w * h do
+		cells[i] = (math.random() > 0.8) and 1 or 0
 	end
-	return g
+	te.sim.neighbors(cells, counts, edges)
 end
 
 -- initialize
@@ -24,50 +21,26 @@ function te.load()
 	music:play()
 
 	w, h = te.window.getDimensions()
-	grid = createGrid()
-	nextGrid = createGrid()
+	cells = te.bytegrid.new(w, h)
+	nextCells = te.bytegrid.new(w, h)
+	counts = te.bytegrid.new(w, h)
 
-	-- random starting pattern
-	for y = 1, h do
-		for x = 1, w do
-			grid[y][x] = (math.random() > 0.8) and 1 or 0
-		end
-	end
-end
+	randomize()
 
--- count alive neighbors
-local function countNeighbors(x, y)
-	local count = 0
-	for dy = -1, 1 do
-		for dx = -1, 1 do
-			if not (dx == 0 and dy == 0) then
-				local nx = x + dx
-				local ny = y + dy
-				if nx >= 1 and nx <= w and ny >= 1 and ny <= h then
-					count = count + grid[ny][nx]
-				end
-			end
-		end
-	end
-	return count
+	-- the HUD lives on its own layer above the board, so the static parts
+	-- are drawn once and never re-uploaded
+	te.graphics.setLayer(2)
+	te.graphics.setColor(BLACK, WHITE)
+	te.graphics.print("Space = Pause/Resume | R = Reset", 1, 1)
 end
 
 -- update grid
 local function step()
-	for y = 1, h do
-		for x = 1, w do
-			local n = countNeighbors(x, y)
-			if grid[y][x] == 1 then
-				-- alive
-				nextGrid[y][x] = (n == 2 or n == 3) and 1 or 0
-			else
-				-- dead
-				nextGrid[y][x] = (n == 3) and 1 or 0
-			end
-		end
-	end
+	population = te.sim.life(cells, nextCells, { rule = "B3/S23", edges = edges })
 	-- swap grids
-	grid, nextGrid = nextGrid, grid
+	cells, nextCells = nextCells, cells
+	-- neighbor counts of the new generation, used for coloring
+	te.sim.neighbors(cells, counts, edges)
 end
 
 function te.update(dt)
@@ -82,12 +55,7 @@ function te.keypressed(key)
 	if key == "space" then
 		running = not running -- pause/resume
 	elseif key == "r" then
-		grid = createGrid()
-		for y = 1, h do
-			for x = 1, w do
-				grid[y][x] = (math.random() > 0.8) and 1 or 0
-			end
-		end
+		randomize()
 	elseif key == "up" then
 		-- increase speed by reducing interval
 		updateInterval = math.max(0.01, updateInterval * 0.8)
@@ -112,25 +80,20 @@ local neighborColors = {
 }
 
 function te.draw()
+	-- te.sim.draw skips dead cells, so the board is cleared first. Cells
+	-- that end up unchanged are not re-uploaded.
+	te.graphics.setLayer(1)
 	te.graphics.clear()
+	te.graphics.setColor(WHITE, BLACK)
+	te.sim.draw(cells, counts, neighborColors, 0xDB + 1)
 
-	for y = 1, h do
-		for x = 1, w do
-			if grid[y][x] == 1 then
-				local n = countNeighbors(x, y)
-				local color = neighborColors[n] or WHITE
-				te.graphics.setColor(color, BLACK)
-				te.graphics.setCell(0xDB + 1, x, y)
-			end
-		end
-	end
-
-	-- HUD
+	-- HUD, padded so shorter values overwrite longer ones
+	te.graphics.setLayer(2)
 	te.graphics.setColor(BLACK, WHITE)
-	te.graphics.print("Space = Pause/Resume | R = Reset", 1, 1)
-	te.graphics.print(string.format("Running: %s", running and "Yes" or "No"), 1, 2)
-	te.graphics.print(string.format("Speed: %.2f steps/sec", 1 / updateInterval), 1, 3)
+	te.graphics.print(string.format("Running: %-3s", running and "Yes" or "No"), 1, 2)
+	te.graphics.print(string.format("Speed: %-8.2f steps/sec", 1 / updateInterval), 1, 3)
+	te.graphics.print(string.format("Population: %-7d", population), 1, 4)
 
-	local fpsStr = string.format("FPS: %d", te.window.getFPS())
+	local fpsStr = string.format("FPS: %4d", te.window.getFPS())
 	te.graphics.print(fpsStr, w - #fpsStr + 1, 1)
 end
@@ -20,6 +20,16 @@ LIGHT_MAGENTA = 13
 YELLOW = 14
 WHITE = 15
 
+-- Shows the layer below, see te.graphics.setLayer
+TRANSPARENT = 255
+
+-- Cell attributes, combined with | for te.graphics.setAttributes
+---@alias Attributes integer
+BLINK = 1
+REVERSE = 2
+UNDERLINE = 4
+BRIGHT = 8
+
 -- Key enum
 ---@alias Key
 ---| "a" | "b" | "c" | "d" | "e" | "f" | "g"
@@ -42,6 +52,143 @@ WHITE = 15
 ---@field setColor fun(fg:Color, bg:Color):nil
 ---@field setCell fun(glyph:integer, x:integer, y:integer):nil
 ---@field print fun(text:string, x:integer, y:integer):nil
+---@field blit fun(cells:string|userdata, x:integer, y:integer, w:integer, h:integer):nil
+---@field blitGlyphs fun(glyphs:string|userdata, x:integer, y:integer, w:integer, h:integer):nil
+---@field blitColors fun(colors:string|userdata, x:integer, y:integer, w:integer, h:integer):nil
+---@field present fun(buffer:te_grid_buffer):nil
+---@field setLayer fun(layer:integer):nil
+---@field getLayer fun():integer, integer current layer and layer count
+---@field setAttributes fun(attributes?:Attributes, cycle?:integer):nil
+---@field setPalette fun(color?:Color, r?:integer, g?:integer, b?:integer):nil
+---@field setCycle fun(group:integer, first:Color, count:integer, rate?:number):nil
+---@field scroll fun(x:integer, y:integer, w:integer, h:integer, dx:integer, dy:integer, glyph?:integer, fg?:Color, bg?:Color):nil glyph counted from 1
+---@field rect fun(x:integer, y:integer, w:integer, h:integer, glyph?:integer):nil glyphs count from 1 like setCell's, default 1
+---@field box fun(x:integer, y:integer, w:integer, h:integer, border?:"single" | "double", glyph?:integer):nil glyph fills the inside, counted from 1
+---@field line fun(x1:integer, y1:integer, x2:integer, y2:integer, glyph?:integer):nil glyph counted from 1
+---@field circle fun(x:integer, y:integer, radius:integer, glyph?:integer, filled?:boolean):nil glyph counted from 1
+---@field fill fun(x:integer, y:integer, glyph?:integer):integer flood fill, returns the cells changed, glyph counted from 1
+---@field pushClip fun(x:integer, y:integer, w:integer, h:integer):nil limits drawing until popClip
+---@field popClip fun():nil
+
+-- Off-screen cell buffer. buffer[i] is the cell at i = (y - 1) * w + x,
+-- packed as glyph | fg << 8 | bg << 16 | flags << 24
+---@class te_grid_buffer
+---@field [integer] integer
+---@field get fun(self:te_grid_buffer, x:integer, y:integer):integer, Color, Color
+---@field set fun(self:te_grid_buffer, x:integer, y:integer, glyph:integer, fg:Color, bg:Color):nil
+---@field fill fun(self:te_grid_buffer, glyph:integer, fg:Color, bg:Color):nil
+---@field copy fun(self:te_grid_buffer, src:te_grid_buffer, x?:integer, y?:integer):nil
+---@field swap fun(self:te_grid_buffer, other:te_grid_buffer):nil
+---@field getDimensions fun(self:te_grid_buffer):integer, integer
+
+---@class te_grid
+---@field new fun(w:integer, h:integer, glyph?:integer, fg?:Color, bg?:Color):te_grid_buffer
+
+-- Dense byte buffer used by the native kernels. buffer[i] is the byte at
+-- i = (y - 1) * w + x
+---@class te_bytegrid_buffer
+---@field [integer] integer
+---@field get fun(self:te_bytegrid_buffer, x:integer, y:integer):integer
+---@field set fun(self:te_bytegrid_buffer, x:integer, y:integer, value:integer):nil
+---@field fill fun(self:te_bytegrid_buffer, value:integer):nil
+---@field swap fun(self:te_bytegrid_buffer, other:te_bytegrid_buffer):nil
+---@field getDimensions fun(self:te_bytegrid_buffer):integer, integer
+---@field toString fun(self:te_bytegrid_buffer):string
+
+---@class te_bytegrid
+---@field new fun(w:integer, h:integer, value?:integer):te_bytegrid_buffer
+
+---@alias SimEdges "wrap" | "clamp" "wrap" by default, "clamp" treats outside cells as dead
+
+---@class te_sim_life_opts
+---@field rule? string Life-like rule such as "B3/S23"
+---@field edges? SimEdges
+---@field counts? te_bytegrid_buffer receives the neighbor counts of src
+---@field threads? integer 0 uses every job thread
+
+---@class te_sim
+---@field life fun(src:te_bytegrid_buffer, dst:te_bytegrid_buffer, opts?:te_sim_life_opts):integer
+---@field neighbors fun(cells:te_bytegrid_buffer, counts:te_bytegrid_buffer, edges?:SimEdges):nil
+---@field draw fun(cells:te_bytegrid_buffer, counts:te_bytegrid_buffer?, colors:Color|table<integer, Color>, glyph:integer, x?:integer, y?:integer):nil glyph counted from 1
+
+-- A light source: {x, y, radius, intensity?}, intensity 0-255 (default 255)
+---@alias FovLight integer[]
+
+---@class te_fov_opts
+---@field falloff? "linear" | "none"
+---@field threads? integer 0 uses every job thread
+
+---@class te_fov
+---@field compute fun(opacity:te_bytegrid_buffer, out:te_bytegrid_buffer, lights:FovLight[], opts?:te_fov_opts):nil
+---@field shade fun(light:te_bytegrid_buffer, dim?:integer, x?:integer, y?:integer):nil
+
+---@alias PathMoves "cardinal" | "diagonal"
+
+-- Distances from every cell to the nearest source over a cost buffer (0
+-- blocks a cell, otherwise the price of stepping onto it). map[i] is the
+-- distance of cell i = (y - 1) * w + x, nil when no source is reachable.
+---@class te_path_map
+---@field [integer] number?
+---@field compute fun(self:te_path_map, costs:te_bytegrid_buffer, sources:integer[]):nil
+---@field update fun(self:te_path_map, costs:te_bytegrid_buffer):integer repairs after a few costs changed, returns how many
+---@field get fun(self:te_path_map, x:integer, y:integer):number?
+---@field next fun(self:te_path_map, x:integer, y:integer):integer?, integer? one step closer to a source
+---@field getDimensions fun(self:te_path_map):integer, integer
+
+-- Cell lists are flat: {x1, y1, x2, y2, ...}
+---@class te_path
+---@field find fun(costs:te_bytegrid_buffer, x1:integer, y1:integer, x2:integer, y2:integer, moves?:PathMoves):integer[]?, number?
+---@field newMap fun(costs:te_bytegrid_buffer, sources:integer[], moves?:PathMoves):te_path_map
+
+---@class te_noise_opts
+---@field type? "simplex" | "value"
+---@field fractal? "none" | "fbm" | "ridged"
+---@field seed? integer the same seed always gives the same noise
+---@field octaves? integer 1 to 16, fractals only (default 4)
+---@field frequency? number features per cell of the first octave (default 0.05)
+---@field lacunarity? number frequency multiplier per octave (default 2)
+---@field gain? number amplitude multiplier per octave (default 0.5)
+---@field z? number samples 3D noise at this depth, for animation
+
+---@class te_noise_fill_opts: te_noise_opts
+---@field x? integer region within the buffer, default the whole buffer
+---@field y? integer
+---@field w? integer
+---@field h? integer
+---@field ox? number position sampled at the region's corner (default 0)
+---@field oy? number
+
+-- A threshold: {max, glyph, fg, bg?}, for values up to max, glyph counted
+-- from 1 like setCell's
+---@alias NoiseLevel integer[]
+
+---@class te_rng
+---@field random fun(self:te_rng, m?:integer, n?:integer):number the same forms as math.random
+---@field seed fun(self:te_rng, seed:integer):nil
+
+---@class te_noise
+---@field fill fun(buf:te_bytegrid_buffer, opts?:te_noise_fill_opts):nil noise mapped to 0-255
+---@field sample fun(x:number, y:number, opts?:te_noise_opts):number -1 to 1
+---@field draw fun(buf:te_bytegrid_buffer, levels:NoiseLevel[], x?:integer, y?:integer):nil
+---@field newRng fun(seed?:integer):te_rng
+
+---@class te_timer
+---@field setTickRate fun(hz:integer):nil
+---@field getTickRate fun():integer
+---@field setTargetFPS fun(fps:integer):nil
+---@field getTime fun():number
+
+---@class te_profiler_stats
+---@field min number milliseconds
+---@field avg number milliseconds
+---@field p99 number milliseconds
+---@field max number milliseconds
+
+---@alias ProfilerPhase "watch" | "load" | "input" | "update" | "audio" | "draw" | "upload" | "present" | "frame"
+
+---@class te_profiler
+---@field getStats fun():table<ProfilerPhase, te_profiler_stats>
+---@field setOverlay fun(enabled:boolean):nil
 
 ---@class te_event
 ---@field quit fun(exitCode:integer):nil
@@ -55,28 +202,88 @@ WHITE = 15
 
 ---@class te_keyboard
 ---@field isDown fun(key:Key):boolean
+---@field setKeyRepeat fun(enabled:boolean):nil
 
 ---@class te_audio_source
----@field play fun(source:te_audio_source):nil
----@field stop fun(source:te_audio_source):nil
----@field setVolume fun(source:te_audio_source, volume:number):nil
+---@field play fun(source:te_audio_source, volume?:number, pitch?:number, pan?:number):nil starts an overlapping voice, streams restart
+---@field stop fun(source:te_audio_source):nil stops every voice
+---@field isPlaying fun(source:te_audio_source):boolean
+---@field setVolume fun(source:te_audio_source, volume:number):nil 0 to 1
+---@field setPitch fun(source:te_audio_source, pitch:number):nil 1 is the original pitch
+---@field setPan fun(source:te_audio_source, pan:number):nil 0 to 1, 0.5 is center
+---@field note fun(source:te_audio_source, note:SynthNote, duration:number, volume?:number):nil synth sources only
+---@field setSequence fun(source:te_audio_source, notes:SynthStep[], loop?:boolean):nil synth sources only, play() runs it
 
 ---@alias SoundMode "static" | "stream"
 
+---@alias SynthNote string | number a name like "C#4" or a frequency in Hz, 0 is a rest
+---@alias SynthStep { [1]:SynthNote, [2]:number, [3]?:number } note, duration, volume
+
+---@class te_synth_patch
+---@field wave? "square" | "pulse" | "triangle" | "noise"
+---@field duty? number pulse high time, 0 to 1
+---@field attack? number seconds
+---@field decay? number seconds
+---@field sustain? number level, 0 to 1
+---@field release? number seconds
+
+---@class te_audio_synth
+---@field new fun(patch?:te_synth_patch):te_audio_source
+---@field frequency fun(note:SynthNote):number
+
 ---@class te_audio
 ---@field newSource fun(path:string, mode:SoundMode):te_audio_source
+---@field synth te_audio_synth
+
+---@alias te_preload_entry string | { [1]:string, [2]:SoundMode } a path, "static" by default
+
+---@class te_resources_stats
+---@field bytes integer resident decoded and file data
+---@field hits integer loads served from the cache
+---@field misses integer loads that read the file
+---@field count integer cached entries, in use or not
+---@field pending integer entries still loading
+
+---@class te_resources
+---@field preload fun(entries:te_preload_entry[], callback?:fun():nil):nil
+---@field getStats fun():te_resources_stats
+---@field collect fun():integer unloads what no source holds, returns bytes freed
+---@field setBudget fun(ms:number):nil main thread time per frame for preloads
+
+---@alias MouseButton 1 | 2 | 3 left, right, middle
+
+---@class te_mouse
+---@field getPosition fun():integer, integer cell under the mouse
+---@field isDown fun(button:MouseButton):boolean
 
 -- Root te table
 ---@class te
 ---@field window te_window
 ---@field graphics te_graphics
+---@field grid te_grid
+---@field bytegrid te_bytegrid
+---@field sim te_sim
+---@field fov te_fov
+---@field path te_path
+---@field noise te_noise
 ---@field event te_event
+---@field mouse te_mouse
+---@field timer te_timer
+---@field profiler te_profiler
 ---@field log te_log
 ---@field keyboard te_keyboard
 ---@field audio te_audio
+---@field resources te_resources
 -- Lifecycle hooks as fields instead of functions
 ---@field load fun():nil
 ---@field update fun(dt:number):nil
----@field draw fun():nil
----@field keypressed fun(key:Key):nil
+---@field draw fun(alpha:number):nil
+---@field unload fun():any called before a hot reload, returns state to keep
+---@field reload fun(state:any):nil called after a hot reload instead of load
+---@field keypressed fun(key:Key, isrepeat:boolean):nil
+---@field keyreleased fun(key:Key):nil
+---@field textinput fun(text:string):nil
+---@field mousemoved fun(x:integer, y:integer):nil
+---@field mousepressed fun(x:integer, y:integer, button:MouseButton):nil
+---@field mousereleased fun(x:integer, y:integer, button:MouseButton):nil
 te = {}
@@ -0,0 +1,168 @@
+#include "audio.h"
+#include "slog.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <time.h>
+
+static void *stream_thread(void *arg) {
+  Audio *audio = arg;
+  struct timespec poll = {.tv_nsec = AUDIO_STREAM_POLL_MS * 1000000L};
+
+  for (;;) {
+    pthread_mutex_lock(&audio->lock);
+    if (audio->stop) {
+      pthread_mutex_unlock(&audio->lock);
+      break;
+    }
+    for (size_t i = 0; i < audio->stream_count; i++)
+      UpdateMusicStream(*audio->streams[i]);
+    pthread_mutex_unlock(&audio->lock);
+
+    nanosleep(&poll, NULL);
+  }
+
+  return NULL;
+}
+
+Audio *audio_init(int buffer_frames) {
+  Audio *audio = calloc(1, sizeof(Audio));
+  assert(audio);
+
+  if (buffer_frames > 0)
+    SetAudioStreamBufferSizeDefault(buffer_frames);
+
+  pthread_mutex_init(&audio->lock, NULL);
+  if (pthread_create(&audio->thread, NULL, stream_thread, audio) != 0)
+    fatal("Failed to start the audio stream thread");
+
+  return audio;
+}
+
+static void release_voice(Voice *voice) {
+  StopSound(voice->sound);
+  UnloadSoundAlias(voice->sound);
+  *voice = (Voice){0};
+}
+
+void audio_free(Audio *audio) {
+  if (!audio)
+    return;
+
+  pthread_mutex_lock(&audio->lock);
+  audio->stop = true;
+  pthread_mutex_unlock(&audio->lock);
+  pthread_join(audio->thread, NULL);
+
+  for (size_t i = 0; i < AUDIO_MAX_VOICES; i++) {
+    if (audio->voices[i].owner)
+      release_voice(&audio->voices[i]);
+  }
+
+  synth_free(audio->synth);
+  pthread_mutex_destroy(&audio->lock);
+  free(audio->streams);
+  free(audio);
+}
+
+void audio_add_stream(Audio *audio, Music *music) {
+  pthread_mutex_lock(&audio->lock);
+  if (audio->stream_count == audio->stream_capacity) {
+    audio->stream_capacity =
+        audio->stream_capacity ? audio->stream_capacity * 2 : 4;
+    audio->streams =
+        realloc(audio->streams, audio->stream_capacity * sizeof(Music *));
+    assert(audio->streams);
+  }
+  audio->streams[audio->stream_count++] = music;
+  pthread_mutex_unlock(&audio->lock);
+}
+
+void audio_remove_stream(Audio *audio, const Music *music) {
+  pthread_mutex_lock(&audio->lock);
+  for (size_t i = 0; i < audio->stream_count; i++) {
+    if (audio->streams[i] == music) {
+      audio->streams[i] = audio->streams[--audio->stream_count];
+      break;
+    }
+  }
+  pthread_mutex_unlock(&audio->lock);
+}
+
+void audio_lock(Audio *audio) { pthread_mutex_lock(&audio->lock); }
+
+void audio_unlock(Audio *audio) { pthread_mutex_unlock(&audio->lock); }
+
+static void apply_params(Voice *voice, VoiceParams params) {
+  SetSoundVolume(voice->sound, params.volume);
+  SetSoundPitch(voice->sound, params.pitch);
+  SetSoundPan(voice->sound, params.pan);
+}
+
+bool audio_play(Audio *audio, const void *owner, Sound sound,
+                VoiceParams params) {
+  // A free or finished voice, otherwise the oldest is cut off
+  Voice *voice = NULL;
+  Voice *oldest = &audio->voices[0];
+  for (size_t i = 0; i < AUDIO_MAX_VOICES && !voice; i++) {
+    Voice *v = &audio->voices[i];
+    if (!v->owner || !IsSoundPlaying(v->sound))
+      voice = v;
+    else if (v->started < oldest->started)
+      oldest = v;
+  }
+  if (!voice)
+    voice = oldest;
+  if (voice->owner)
+    release_voice(voice);
+
+  voice->sound = LoadSoundAlias(sound);
+  if (!IsSoundValid(voice->sound))
+    return false;
+
+  voice->owner = owner;
+  voice->started = ++audio->plays;
+  apply_params(voice, params);
+  PlaySound(voice->sound);
+
+  return true;
+}
+
+void audio_stop(Audio *audio, const void *owner) {
+  for (size_t i = 0; i < AUDIO_MAX_VOICES; i++) {
+    if (audio->voices[i].owner == owner)
+      release_voice(&audio->voices[i]);
+  }
+}
+
+void audio_set_params(Audio *audio, const void *owner, VoiceParams params) {
+  for (size_t i = 0; i < AUDIO_MAX_VOICES; i++) {
+    if (audio->voices[i].owner == owner)
+      apply_params(&audio->voices[i], params);
+  }
+}
+
+bool audio_is_playing(const Audio *audio, const void *owner) {
+  for (size_t i = 0; i < AUDIO_MAX_VOICES; i++) {
+    const Voice *voice = &audio->voices[i];
+    if (voice->owner == owner && IsSoundPlaying(voice->sound))
+      return true;
+  }
+  return false;
+}
+
+Synth *audio_synth(Audio *audio) {
+  if (!audio->synth)
+    audio->synth = synth_init();
+  return audio->synth;
+}
+
+void audio_update(Audio *audio) {
+  if (!audio)
+    return;
+
+  for (size_t i = 0; i < AUDIO_MAX_VOICES; i++) {
+    Voice *voice = &audio->voices[i];
+    if (voice->owner && !IsSoundPlaying(voice->sound))
+      release_voice(voice);
+  }
+}
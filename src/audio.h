@@ -0,0 +1,82 @@
+#ifndef AUDIO_H_
+#define AUDIO_H_
+
+#include "synth.h"
+#include <pthread.h>
+#include <raylib.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Sounds playing at once across all sources. When every voice is busy the
+// oldest one is cut off.
+#define AUDIO_MAX_VOICES 32
+
+// How often the stream thread refills music buffers. Well under the length
+// of one buffer at any sensible size, so refills are never late.
+#define AUDIO_STREAM_POLL_MS 4
+
+typedef struct {
+  float volume; // 0 to 1
+  float pitch;  // 1 is the original pitch
+  float pan;    // 0 to 1, 0.5 is center
+} VoiceParams;
+
+#define VOICE_PARAMS_DEFAULT                                                   \
+  (VoiceParams) { .volume = 1.0f, .pitch = 1.0f, .pan = 0.5f }
+
+// One playing instance of a sound, an alias sharing the source's buffer
+typedef struct {
+  Sound sound;
+  const void *owner;     // the source that started it, NULL when free
+  unsigned long started; // play order, to find the oldest
+} Voice;
+
+// Music streams refilled from a dedicated thread, so a long frame cannot
+// starve them, and a voice pool for overlapping sound effects. Voices are
+// main thread only.
+typedef struct {
+  pthread_t thread;
+  pthread_mutex_t lock; // held by the stream thread while it refills
+  bool stop;
+
+  Music **streams; // registered by the sources that own them
+  size_t stream_count, stream_capacity;
+
+  Voice voices[AUDIO_MAX_VOICES];
+  unsigned long plays;
+
+  Synth *synth; // opened by the first synth source
+} Audio;
+
+// Needs an initialized audio device. `buffer_frames` sizes the buffers of
+// streams loaded afterwards, 0 keeps raylib's default: smaller buffers cut
+// latency, larger ones ride out longer stalls.
+Audio *audio_init(int buffer_frames);
+void audio_free(Audio *audio);
+
+// Streams are refilled while registered. Any other call on a registered
+// stream must hold the lock.
+void audio_add_stream(Audio *audio, Music *music);
+void audio_remove_stream(Audio *audio, const Music *music);
+void audio_lock(Audio *audio);
+void audio_unlock(Audio *audio);
+
+// Starts a new voice of `sound` for `owner`, returns false when the alias
+// cannot be created
+bool audio_play(Audio *audio, const void *owner, Sound sound,
+                VoiceParams params);
+
+// Stops and frees every voice of `owner`
+void audio_stop(Audio *audio, const void *owner);
+
+// Applies `params` to the voices of `owner` that are still playing
+void audio_set_params(Audio *audio, const void *owner, VoiceParams params);
+bool audio_is_playing(const Audio *audio, const void *owner);
+
+// The synth mixer, opened on first use. NULL when it cannot be opened.
+Synth *audio_synth(Audio *audio);
+
+// Frees the voices that finished playing
+void audio_update(Audio *audio);
+
+#endif // AUDIO_H_
@@ -0,0 +1,215 @@
+#include "bench.h"
+#include "clock.h"
+#include "engine.h"
+#include "grid.h"
+#include "lauxlib.h"
+#include "lua.h"
+#include "lua_api.h"
+#include "lualib.h"
+#include "renderer.h"
+#include "slog.h"
+#include "texture_stream.h"
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_GRID_W 240
+#define BENCH_GRID_H 135
+
+// Reproduces the engine lookup every API function used to do before the
+// Engine* became an upvalue, followed by the same work as setCell
+static int l_legacy_setCell(lua_State *L) {
+  int cell = luaL_checkinteger(L, 1) - 1;
+  int x = floor(luaL_checknumber(L, 2) - 1);
+  int y = floor(luaL_checknumber(L, 3) - 1);
+
+  lua_getglobal(L, "te");
+  lua_getfield(L, -1, "__engine");
+  Engine *engine = (Engine *)lua_touserdata(L, -1);
+  lua_pop(L, 2); // pop te.__engine
+
+  if (cell < 0 || cell >= 256 || x < 0 || x >= (int)engine->grid->w || y < 0 ||
+      y >= (int)engine->grid->h)
+    return 0;
+
+  grid_set(engine->grid, (size_t)x, (size_t)y,
+           (Cell){.glyph = cell,
+                  .bg = engine->renderer->bg,
+                  .fg = engine->renderer->fg});
+
+  return 0;
+}
+
+static int l_nop(lua_State *L) {
+  (void)L;
+  return 0;
+}
+
+static int l_clock(lua_State *L) {
+  lua_pushnumber(L, clock_seconds());
+  return 1;
+}
+
+static const char *api_bench_script =
+    "local n, clock, nop, legacy = ...\n"
+    "local function run(name, f, ...)\n"
+    "  local t0 = clock()\n"
+    "  for i = 1, n do f(...) end\n"
+    "  local dt = clock() - t0\n"
+    "  print(string.format('  %-36s %14.0f calls/s', name, n / dt))\n"
+    "end\n"
+    "run('empty C function', nop)\n"
+    "run('setCell via te.__engine (before)', legacy, 65, 10, 10)\n"
+    "run('te.graphics.setCell (upvalue)', te.graphics.setCell, 65, 10, 10)\n"
+    "run('te.graphics.setColor', te.graphics.setColor, WHITE, BLACK)\n"
+    "run('te.graphics.print', te.graphics.print, 'hello', 1, 1)\n"
+    "run('te.window.getDimensions', te.window.getDimensions)\n";
+
+// Measures Lua -> C call throughput of the te API
+static int bench_api(long iterations) {
+  Engine engine = {.config = {.headless = true}};
+  engine.grid = engine.layers[0] = grid_init(BENCH_GRID_W, BENCH_GRID_H);
+  grid_fill(engine.grid, CELL_EMPTY);
+  engine.renderer = renderer_init(&engine);
+  engine.L = luaL_newstate();
+  luaL_openlibs(engine.L);
+  register_lua_api(&engine);
+
+  lua_getglobal(engine.L, "te");
+  lua_pushlightuserdata(engine.L, &engine);
+  lua_setfield(engine.L, -2, "__engine");
+  lua_pop(engine.L, 1);
+
+  printf("api (%ld calls each):\n", iterations);
+
+  int status = luaL_loadstring(engine.L, api_bench_script);
+  if (status == LUA_OK) {
+    lua_pushinteger(engine.L, iterations);
+    lua_pushcfunction(engine.L, l_clock);
+    lua_pushcfunction(engine.L, l_nop);
+    lua_pushcfunction(engine.L, l_legacy_setCell);
+    status = lua_pcall(engine.L, 4, 0, 0);
+  }
+  if (status != LUA_OK)
+    error("api benchmark failed: %s", lua_tostring(engine.L, -1));
+
+  lua_close(engine.L);
+  renderer_free(engine.renderer);
+  grid_free(engine.grid);
+
+  return status == LUA_OK ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static const size_t upload_sizes[][2] = {{80, 25}, {240, 135}, {480, 270}};
+
+// The upload path before cells matched the texel layout: every 3-byte cell
+// is repacked into RGBA with a constant alpha
+static void repack_rgb_cells(const unsigned char *src, unsigned char *dst,
+                             size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    dst[i * 4 + 0] = src[i * 3 + 0];
+    dst[i * 4 + 1] = src[i * 3 + 1];
+    dst[i * 4 + 2] = src[i * 3 + 2];
+    dst[i * 4 + 3] = 255;
+  }
+}
+
+typedef enum {
+  UPLOAD_REPACK,
+  UPLOAD_IN_PLACE,
+  UPLOAD_STREAM,
+} UploadMethod;
+
+// Returns the average time of a full-grid upload in microseconds, including
+// waiting for the GPU to finish
+static double time_uploads(UploadMethod method, Grid *grid,
+                           TextureStream *stream, const unsigned char *rgb,
+                           unsigned char *rgba, long iterations) {
+  Rectangle rec = {0, 0, grid->w, grid->h};
+  size_t count = grid->w * grid->h;
+
+  texture_stream_finish();
+  double start = clock_seconds();
+
+  for (long i = 0; i < iterations; i++) {
+    switch (method) {
+    case UPLOAD_REPACK:
+      repack_rgb_cells(rgb, rgba, count);
+      UpdateTextureRec(stream->texture, rec, rgba);
+      break;
+    case UPLOAD_IN_PLACE:
+      UpdateTextureRec(stream->texture, rec, grid->cells);
+      break;
+    case UPLOAD_STREAM:
+      grid_mark_dirty(grid, 0, 0, grid->w, grid->h);
+      texture_stream_upload(stream, grid);
+      break;
+    }
+  }
+
+  texture_stream_finish();
+  return (clock_seconds() - start) * 1e6 / iterations;
+}
+
+// Measures the cost of uploading a whole grid to its texture
+static int bench_upload(long iterations) {
+  SetTraceLogLevel(LOG_WARNING);
+  SetConfigFlags(FLAG_WINDOW_HIDDEN);
+  InitWindow(64, 64, "te bench");
+
+  printf("upload (%ld full-grid uploads each, us per upload):\n", iterations);
+  printf("%-10s %12s %12s %12s\n", "grid", "repack", "in place", "pbo stream");
+
+  for (size_t s = 0; s < sizeof upload_sizes / sizeof upload_sizes[0]; s++) {
+    size_t w = upload_sizes[s][0], h = upload_sizes[s][1];
+
+    Grid *grid = grid_init(w, h);
+    unsigned char *rgb = malloc(w * h * 3);
+    unsigned char *rgba = malloc(w * h * 4);
+    assert(rgb && rgba);
+
+    for (size_t i = 0; i < w * h; i++) {
+      grid->cells[i] = (Cell){.glyph = rand(), .fg = rand(), .bg = rand()};
+      rgb[i * 3 + 0] = grid->cells[i].glyph;
+      rgb[i * 3 + 1] = grid->cells[i].fg;
+      rgb[i * 3 + 2] = grid->cells[i].bg;
+    }
+
+    TextureStream stream = texture_stream_init(w, h);
+
+    double repack =
+        time_uploads(UPLOAD_REPACK, grid, &stream, rgb, rgba, iterations);
+    double in_place =
+        time_uploads(UPLOAD_IN_PLACE, grid, &stream, rgb, rgba, iterations);
+    double streamed =
+        time_uploads(UPLOAD_STREAM, grid, &stream, rgb, rgba, iterations);
+
+    printf("%4zux%-5zu %12.2f %12.2f %12.2f\n", w, h, repack, in_place,
+           streamed);
+
+    texture_stream_free(&stream);
+    free(rgb);
+    free(rgba);
+    grid_free(grid);
+  }
+
+  CloseWindow();
+
+  return EXIT_SUCCESS;
+}
+
+// te bench [name] [iterations]
+int bench_main(int argc, char *argv[]) {
+  const char *name = argc > 0 ? argv[0] : "api";
+  long iterations = argc > 1 ? strtol(argv[1], NULL, 10) : 0;
+
+  if (strcmp(name, "api") == 0)
+    return bench_api(iterations > 0 ? iterations : 5000000);
+  if (strcmp(name, "upload") == 0)
+    return bench_upload(iterations > 0 ? iterations : 2000);
+
+  error("Unknown benchmark '%s'", name);
+  return EXIT_FAILURE;
+}
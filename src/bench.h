@@ -0,0 +1,6 @@
+#ifndef BENCH_H_
+#define BENCH_H_
+
+int bench_main(int argc, char *argv[]);
+
+#endif // BENCH_H_
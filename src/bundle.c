@@ -0,0 +1,389 @@
+#include "bundle.h"
+#include "chunk_cache.h"
+#include "lauxlib.h"
+#include "slog.h"
+#include <assert.h>
+#include <fcntl.h>
+#include <raylib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct Bundle {
+  const unsigned char *data;
+  size_t size;
+  bool mapped; // munmap on close, otherwise the data is not ours
+  BundleHeader header;
+};
+
+// Entries are copied out instead of cast, a linked-in bundle has no
+// alignment guarantees
+static BundleEntry entry_at(const Bundle *bundle, uint32_t i) {
+  BundleEntry entry;
+  memcpy(&entry, bundle->data + bundle->header.index_offset + i * sizeof entry,
+         sizeof entry);
+  return entry;
+}
+
+// Orders like strcmp, the order bundle_write sorts the index in
+static int compare_path(const Bundle *bundle, const BundleEntry *entry,
+                        const char *path, size_t len) {
+  const char *name = (const char *)bundle->data +
+                     bundle->header.strings_offset + entry->path_offset;
+  size_t n = entry->path_len < len ? entry->path_len : len;
+
+  int c = memcmp(name, path, n);
+  if (c != 0)
+    return c;
+  return (entry->path_len > len) - (entry->path_len < len);
+}
+
+static bool validate(Bundle *bundle) {
+  if (bundle->size < sizeof bundle->header) {
+    error("Not a te bundle: too short");
+    return false;
+  }
+
+  BundleHeader *header = &bundle->header;
+  memcpy(header, bundle->data, sizeof *header);
+
+  if (memcmp(header->magic, BUNDLE_MAGIC, sizeof header->magic) != 0) {
+    error("Not a te bundle: bad magic");
+    return false;
+  }
+
+  if (header->lua_version != LUA_VERSION_NUM) {
+    error("The bundle was built for Lua %u.%u, te runs Lua %d.%d",
+          header->lua_version / 100, header->lua_version % 100,
+          LUA_VERSION_NUM / 100, LUA_VERSION_NUM % 100);
+    return false;
+  }
+
+  uint64_t index_size = (uint64_t)header->entry_count * sizeof(BundleEntry);
+  if (header->index_offset > bundle->size ||
+      index_size > bundle->size - header->index_offset ||
+      header->strings_offset > bundle->size) {
+    error("Corrupt te bundle: index out of range");
+    return false;
+  }
+
+  // Checked once here, so lookups can trust the index
+  size_t strings_size = bundle->size - header->strings_offset;
+  for (uint32_t i = 0; i < header->entry_count; i++) {
+    BundleEntry entry = entry_at(bundle, i);
+    if (entry.offset > bundle->size ||
+        entry.size > bundle->size - entry.offset ||
+        entry.path_offset > strings_size ||
+        entry.path_len > strings_size - entry.path_offset) {
+      error("Corrupt te bundle: entry %u out of range", i);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+Bundle *bundle_open_memory(const unsigned char *data, size_t size) {
+  Bundle *bundle = calloc(1, sizeof(Bundle));
+  assert(bundle);
+
+  bundle->data = data;
+  bundle->size = size;
+
+  if (!validate(bundle)) {
+    free(bundle);
+    return NULL;
+  }
+
+  return bundle;
+}
+
+Bundle *bundle_open(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    error("Failed to open %s", path);
+    return NULL;
+  }
+
+  struct stat st;
+  void *data = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size > 0)
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd); // the mapping keeps the file alive
+
+  if (data == MAP_FAILED) {
+    error("Failed to map %s", path);
+    return NULL;
+  }
+
+  Bundle *bundle = bundle_open_memory(data, st.st_size);
+  if (!bundle) {
+    munmap(data, st.st_size);
+    return NULL;
+  }
+
+  bundle->mapped = true;
+  return bundle;
+}
+
+void bundle_close(Bundle *bundle) {
+  if (!bundle)
+    return;
+
+  if (bundle->mapped)
+    munmap((void *)bundle->data, bundle->size);
+  free(bundle);
+}
+
+bool bundle_find(const Bundle *bundle, const char *path, BundleFile *file) {
+  size_t len = strlen(path);
+  uint32_t lo = 0, hi = bundle->header.entry_count;
+
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    BundleEntry entry = entry_at(bundle, mid);
+
+    int c = compare_path(bundle, &entry, path, len);
+    if (c == 0) {
+      *file = (BundleFile){
+          .data = bundle->data + entry.offset,
+          .size = entry.size,
+          .kind = entry.kind,
+      };
+      return true;
+    }
+
+    if (c < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return false;
+}
+
+int bundle_load(const Bundle *bundle, lua_State *L, const char *path) {
+  BundleFile file;
+  if (!bundle_find(bundle, path, &file)) {
+    lua_pushfstring(L, "cannot open %s in the bundle", path);
+    return LUA_ERRFILE;
+  }
+
+  // Straight from the bundle's memory, Lua only copies what it keeps
+  lua_pushfstring(L, "@%s", path);
+  int status = luaL_loadbufferx(L, (const char *)file.data, file.size,
+                                lua_tostring(L, -1),
+                                file.kind == BUNDLE_BYTECODE ? "b" : "t");
+  lua_remove(L, -2);
+
+  return status;
+}
+
+int bundle_dofile(const Bundle *bundle, lua_State *L, const char *path) {
+  int status = bundle_load(bundle, L, path);
+  if (status != LUA_OK)
+    return status;
+
+  return lua_pcall(L, 0, LUA_MULTRET, 0);
+}
+
+// package.searchers entry for modules inside the bundle, resolving names
+// like the "<game>/?.lua;<game>/?/init.lua" path of unbundled games
+static int bundle_searcher(lua_State *L) {
+  Bundle *bundle = lua_touserdata(L, lua_upvalueindex(1));
+  const char *name = luaL_checkstring(L, 1);
+
+  luaL_Buffer b;
+  luaL_buffinit(L, &b);
+  for (const char *c = name; *c; c++)
+    luaL_addchar(&b, *c == '.' ? '/' : *c);
+  luaL_pushresult(&b);
+  const char *base = lua_tostring(L, -1);
+
+  const char *candidates[] = {
+      lua_pushfstring(L, "%s.lua", base),
+      lua_pushfstring(L, "%s/init.lua", base),
+  };
+
+  for (size_t i = 0; i < 2; i++) {
+    BundleFile file;
+    if (!bundle_find(bundle, candidates[i], &file))
+      continue;
+
+    if (bundle_load(bundle, L, candidates[i]) != LUA_OK) {
+      return luaL_error(L, "error loading module '%s' from bundle file "
+                        "'%s':\n\t%s",
+                        name, candidates[i], lua_tostring(L, -1));
+    }
+
+    lua_pushstring(L, candidates[i]); // the file name for the loader
+    return 2;
+  }
+
+  lua_pushfstring(L, "no bundled file '%s.lua'", base);
+  return 1;
+}
+
+void bundle_install(Bundle *bundle, lua_State *L) {
+  lua_getglobal(L, "package");
+  lua_getfield(L, -1, "searchers");
+
+  // Insert after the preload searcher, ahead of the source file searcher
+  for (lua_Integer i = lua_rawlen(L, -1); i >= 2; i--) {
+    lua_rawgeti(L, -1, i);
+    lua_rawseti(L, -2, i + 1);
+  }
+  lua_pushlightuserdata(L, bundle);
+  lua_pushcclosure(L, bundle_searcher, 1);
+  lua_rawseti(L, -2, 2);
+
+  lua_pop(L, 2);
+}
+
+typedef struct {
+  char *path;
+  BundleEntry entry;
+} PackedFile;
+
+static int compare_packed(const void *a, const void *b) {
+  return strcmp(((const PackedFile *)a)->path, ((const PackedFile *)b)->path);
+}
+
+// Editor files, version control and the chunk cache stay out of bundles,
+// and so do other bundles (like the one being written)
+static bool skip_path(const char *path) {
+  if (path[0] == '.' || strstr(path, "/."))
+    return true;
+  return IsFileExtension(path, BUNDLE_EXTENSION);
+}
+
+// Pads the file with zeros up to the next BUNDLE_ALIGN boundary
+static bool write_padding(FILE *f, uint64_t *offset) {
+  static const char zeros[BUNDLE_ALIGN];
+  size_t pad = (BUNDLE_ALIGN - *offset % BUNDLE_ALIGN) % BUNDLE_ALIGN;
+
+  *offset += pad;
+  return fwrite(zeros, 1, pad, f) == pad;
+}
+
+// Reads, compiles when needed and appends one file at `*offset`
+static bool pack_file(FILE *f, const char *game_path, PackedFile *packed,
+                      uint64_t *offset) {
+  const char *full = TextFormat("%s/%s", game_path, packed->path);
+
+  int size;
+  unsigned char *data = LoadFileData(full, &size);
+  if (!data && GetFileLength(full) > 0) {
+    error("Failed to read %s", full);
+    return false;
+  }
+
+  const void *bytes = data;
+  size_t len = size;
+  char *bytecode = NULL;
+
+  if (IsFileExtension(packed->path, ".lua")) {
+    char chunkname[4096];
+    snprintf(chunkname, sizeof chunkname, "@%s", packed->path);
+
+    bytecode = chunk_compile((const char *)data, size, chunkname, &len);
+    if (!bytecode) {
+      UnloadFileData(data);
+      return false;
+    }
+    bytes = bytecode;
+    packed->entry.kind = BUNDLE_BYTECODE;
+  }
+
+  packed->entry.offset = *offset;
+  packed->entry.size = len;
+  *offset += len;
+
+  bool ok = (len == 0 || fwrite(bytes, 1, len, f) == len) &&
+            write_padding(f, offset);
+
+  free(bytecode);
+  UnloadFileData(data);
+  return ok;
+}
+
+bool bundle_write(const char *game_path, const char *out_path) {
+  FilePathList list = LoadDirectoryFilesEx(game_path, NULL, true);
+  size_t prefix = strlen(game_path) + 1;
+
+  PackedFile *files = calloc(list.count > 0 ? list.count : 1,
+                             sizeof(PackedFile));
+  assert(files);
+  uint32_t count = 0;
+
+  for (unsigned int i = 0; i < list.count; i++) {
+    const char *path = list.paths[i] + prefix;
+    if (DirectoryExists(list.paths[i]) || skip_path(path))
+      continue;
+    files[count++].path = strdup(path);
+  }
+  UnloadDirectoryFiles(list);
+
+  FILE *f = fopen(out_path, "wb");
+  if (!f) {
+    error("Failed to create %s", out_path);
+    for (uint32_t i = 0; i < count; i++)
+      free(files[i].path);
+    free(files);
+    return false;
+  }
+
+  // The header goes in last, once the offsets are known
+  BundleHeader header = {
+      .lua_version = LUA_VERSION_NUM,
+      .entry_count = count,
+  };
+  memcpy(header.magic, BUNDLE_MAGIC, sizeof header.magic);
+
+  uint64_t offset = sizeof header;
+  bool ok = fwrite(&header, sizeof header, 1, f) == 1 &&
+            write_padding(f, &offset);
+
+  for (uint32_t i = 0; ok && i < count; i++)
+    ok = pack_file(f, game_path, &files[i], &offset);
+
+  // Sorted after packing, the data order does not matter
+  qsort(files, count, sizeof *files, compare_packed);
+
+  header.index_offset = offset;
+  header.strings_offset = offset + (uint64_t)count * sizeof(BundleEntry);
+
+  uint32_t path_offset = 0;
+  for (uint32_t i = 0; ok && i < count; i++) {
+    files[i].entry.path_offset = path_offset;
+    files[i].entry.path_len = strlen(files[i].path);
+    path_offset += files[i].entry.path_len;
+    ok = fwrite(&files[i].entry, sizeof(BundleEntry), 1, f) == 1;
+  }
+
+  for (uint32_t i = 0; ok && i < count; i++) {
+    size_t len = files[i].entry.path_len;
+    ok = fwrite(files[i].path, 1, len, f) == len;
+  }
+
+  ok = ok && fseek(f, 0, SEEK_SET) == 0 &&
+       fwrite(&header, sizeof header, 1, f) == 1;
+  ok = fclose(f) == 0 && ok;
+
+  if (ok) {
+    info("Packed %u files into %s (%.1f KiB)", count, out_path,
+         (header.strings_offset + path_offset) / 1024.0);
+  } else {
+    error("Failed to write %s", out_path);
+    remove(out_path);
+  }
+
+  for (uint32_t i = 0; i < count; i++)
+    free(files[i].path);
+  free(files);
+
+  return ok;
+}
@@ -0,0 +1,68 @@
+#ifndef BUNDLE_H_
+#define BUNDLE_H_
+
+#include "lua.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define BUNDLE_MAGIC "TEBUNDL1"
+#define BUNDLE_EXTENSION ".te"
+
+// Every file's data starts at a multiple of this from the start of the
+// bundle, so loaders reading a mapped bundle get aligned buffers
+#define BUNDLE_ALIGN 16
+
+// A whole game in one file: the header, the file data, then an index
+// sorted by path so lookups are a binary search over the mapped bytes.
+// Integers are stored in host byte order.
+typedef struct {
+  char magic[8];
+  uint32_t lua_version; // of the bytecode entries
+  uint32_t entry_count;
+  uint64_t index_offset;   // BundleEntry[entry_count]
+  uint64_t strings_offset; // paths, not NUL-terminated
+} BundleHeader;
+
+typedef enum {
+  BUNDLE_FILE,     // stored as is
+  BUNDLE_BYTECODE, // a .lua file, precompiled
+} BundleKind;
+
+typedef struct {
+  uint64_t offset, size;
+  uint32_t path_offset, path_len; // relative to strings_offset
+  uint32_t kind;                  // BundleKind
+  uint32_t reserved;
+} BundleEntry;
+
+// A read-only view of a bundle, mapped from a file or linked into the binary
+typedef struct Bundle Bundle;
+
+// Points into the bundle, valid until bundle_close
+typedef struct {
+  const unsigned char *data;
+  size_t size;
+  BundleKind kind;
+} BundleFile;
+
+// Returns NULL, after logging why, when the bundle is missing or malformed
+Bundle *bundle_open(const char *path);
+Bundle *bundle_open_memory(const unsigned char *data, size_t size);
+void bundle_close(Bundle *bundle);
+
+// Looks up `path` relative to the game root, like "sounds/hit.wav"
+bool bundle_find(const Bundle *bundle, const char *path, BundleFile *file);
+
+// Like luaL_loadfile and luaL_dofile for a Lua file of the bundle
+int bundle_load(const Bundle *bundle, lua_State *L, const char *path);
+int bundle_dofile(const Bundle *bundle, lua_State *L, const char *path);
+
+// Adds a package.searchers entry that serves game modules from the bundle
+void bundle_install(Bundle *bundle, lua_State *L);
+
+// Packs every file of a game directory, precompiling its Lua files. Returns
+// false, after logging why, on errors.
+bool bundle_write(const char *game_path, const char *out_path);
+
+#endif // BUNDLE_H_
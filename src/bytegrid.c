@@ -0,0 +1,22 @@
+#include "bytegrid.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+ByteGrid *bytegrid_init(size_t w, size_t h) {
+  assert(w > 0 && h > 0 && w <= (SIZE_MAX - sizeof(ByteGrid)) / h);
+  ByteGrid *grid = calloc(1, sizeof(ByteGrid) + w * h);
+  assert(grid != NULL);
+
+  grid->w = w;
+  grid->h = h;
+
+  return grid;
+}
+
+void bytegrid_fill(ByteGrid *grid, unsigned char value) {
+  memset(grid->data, value, grid->w * grid->h);
+}
+
+void bytegrid_free(ByteGrid *grid) { free(grid); }
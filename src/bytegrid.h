@@ -0,0 +1,17 @@
+#ifndef BYTEGRID_H_
+#define BYTEGRID_H_
+
+#include <stddef.h>
+
+// A dense w x h grid of bytes, the input and output format of the native
+// simulation kernels
+typedef struct {
+  size_t w, h;
+  unsigned char data[]; // flexible array member
+} ByteGrid;
+
+ByteGrid *bytegrid_init(size_t w, size_t h);
+void bytegrid_fill(ByteGrid *grid, unsigned char value);
+void bytegrid_free(ByteGrid *grid);
+
+#endif // BYTEGRID_H_
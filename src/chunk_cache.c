@@ -0,0 +1,422 @@
+#include "chunk_cache.h"
+#include "lauxlib.h"
+#include "slog.h"
+#include <assert.h>
+#include <raylib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define CHUNK_CACHE_MAGIC "TECHUNK1"
+
+// Precedes the path of the source and the bytecode in every cache file
+typedef struct {
+  char magic[8];
+  uint32_t lua_version; // bytecode only loads into the same Lua version
+  uint32_t path_len;
+  uint64_t mtime_ns;
+  uint64_t size;
+  uint64_t hash; // FNV-1a of the source
+} ChunkHeader;
+
+typedef struct {
+  char *data;
+  size_t len, capacity;
+} Buffer;
+
+typedef struct {
+  ChunkCache *cache;
+  char *path;
+} RebuildJob;
+
+static uint64_t fnv1a(const char *data, size_t len) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= (unsigned char)data[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+static uint64_t stat_mtime_ns(const struct stat *st) {
+#ifdef __linux__
+  return (uint64_t)st->st_mtim.tv_sec * 1000000000ULL + st->st_mtim.tv_nsec;
+#else
+  return (uint64_t)st->st_mtime * 1000000000ULL;
+#endif
+}
+
+// Reads a whole file, returns NULL when it cannot be read
+static char *read_file(const char *path, size_t *len) {
+  FILE *f = fopen(path, "rb");
+  if (!f)
+    return NULL;
+
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+
+  char *data = size >= 0 ? malloc(size > 0 ? size : 1) : NULL;
+  if (data && fread(data, 1, size, f) != (size_t)size) {
+    free(data);
+    data = NULL;
+  }
+  fclose(f);
+
+  *len = size;
+  return data;
+}
+
+static const char *source_path(const ChunkCache *cache, const char *path,
+                               char *buf, size_t size) {
+  snprintf(buf, size, "%s/%s", cache->game_path, path);
+  return buf;
+}
+
+// Cache files live in one flat directory, "ui/menu.lua" -> "ui.menu.luac".
+// The header records the source path, so a clash only costs a rebuild.
+static const char *entry_path(const ChunkCache *cache, const char *path,
+                              char *buf, size_t size) {
+  int n = snprintf(buf, size, "%s/%s/", cache->game_path, CHUNK_CACHE_DIR);
+  for (const char *c = path; *c && (size_t)n + 2 < size; c++)
+    buf[n++] = *c == '/' ? '.' : *c;
+  snprintf(buf + n, size - n, "c");
+  return buf;
+}
+
+static int buffer_writer(lua_State *L, const void *p, size_t sz, void *ud) {
+  (void)L;
+  Buffer *buf = ud;
+
+  if (buf->len + sz > buf->capacity) {
+    buf->capacity = (buf->len + sz) * 2;
+    buf->data = realloc(buf->data, buf->capacity);
+    assert(buf->data);
+  }
+  memcpy(buf->data + buf->len, p, sz);
+  buf->len += sz;
+
+  return 0;
+}
+
+char *chunk_compile(const char *source, size_t len, const char *chunkname,
+                    size_t *bytecode_len) {
+  // A private state, so compiles can run on any thread
+  lua_State *L = luaL_newstate();
+  assert(L);
+
+  Buffer bytecode = {0};
+  if (luaL_loadbufferx(L, source, len, chunkname, "t") != LUA_OK) {
+    warning("Failed to compile %s", lua_tostring(L, -1));
+  } else if (lua_dump(L, buffer_writer, &bytecode, 0) != 0) {
+    free(bytecode.data);
+    bytecode.data = NULL;
+  }
+  lua_close(L);
+
+  *bytecode_len = bytecode.len;
+  return bytecode.data;
+}
+
+bool chunk_cache_build(ChunkCache *cache, const char *path) {
+  char src_path[4096], dst_path[4096], tmp_path[4096];
+  source_path(cache, path, src_path, sizeof src_path);
+  entry_path(cache, path, dst_path, sizeof dst_path);
+
+  // Stat before reading, so a save racing with the build leaves an entry
+  // that is already stale instead of one that looks fresh
+  struct stat st;
+  if (stat(src_path, &st) != 0)
+    return false;
+
+  size_t len;
+  char *source = read_file(src_path, &len);
+  if (!source)
+    return false;
+
+  char chunkname[4096 + 1];
+  snprintf(chunkname, sizeof chunkname, "@%s", src_path);
+
+  bool ok = false;
+  size_t bytecode_len;
+  char *bytecode = chunk_compile(source, len, chunkname, &bytecode_len);
+
+  if (bytecode) {
+    ChunkHeader header = {
+        .lua_version = LUA_VERSION_NUM,
+        .path_len = strlen(path),
+        .mtime_ns = stat_mtime_ns(&st),
+        .size = len,
+        .hash = fnv1a(source, len),
+    };
+    memcpy(header.magic, CHUNK_CACHE_MAGIC, sizeof header.magic);
+
+    // Write then rename, so readers never see a partial entry
+    snprintf(tmp_path, sizeof tmp_path, "%s.%ld.%p.tmp", dst_path,
+             (long)getpid(), (void *)bytecode);
+    FILE *f = fopen(tmp_path, "wb");
+    if (f) {
+      ok = fwrite(&header, sizeof header, 1, f) == 1 &&
+           fwrite(path, 1, header.path_len, f) == header.path_len &&
+           fwrite(bytecode, 1, bytecode_len, f) == bytecode_len;
+      ok = fclose(f) == 0 && ok;
+      ok = ok && rename(tmp_path, dst_path) == 0;
+      if (!ok)
+        remove(tmp_path);
+    }
+  }
+
+  free(bytecode);
+  free(source);
+
+  return ok;
+}
+
+static void *rebuild_thread(void *arg) {
+  RebuildJob *job = arg;
+
+  ChunkCache *cache = job->cache;
+
+  if (!chunk_cache_build(cache, job->path))
+    debug("Failed to rebuild the cache entry of %s", job->path);
+
+  pthread_mutex_lock(&cache->lock);
+  if (--cache->pending_rebuilds == 0)
+    pthread_cond_signal(&cache->idle);
+  pthread_mutex_unlock(&cache->lock);
+
+  free(job->path);
+  free(job);
+  return NULL;
+}
+
+static void schedule_rebuild(ChunkCache *cache, const char *path) {
+  RebuildJob *job = malloc(sizeof(RebuildJob));
+  assert(job);
+  *job = (RebuildJob){.cache = cache, .path = strdup(path)};
+
+  pthread_mutex_lock(&cache->lock);
+  cache->pending_rebuilds++;
+  pthread_mutex_unlock(&cache->lock);
+
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, rebuild_thread, job) == 0) {
+    pthread_detach(thread);
+    return;
+  }
+
+  pthread_mutex_lock(&cache->lock);
+  cache->pending_rebuilds--;
+  pthread_mutex_unlock(&cache->lock);
+  free(job->path);
+  free(job);
+}
+
+// Loads the bytecode of a cache file if it belongs to `path` and matches
+// the source, pushing the chunk. `source` is read on demand for the hash
+// check and handed back so a miss does not read it twice.
+static bool load_entry(ChunkCache *cache, lua_State *L, const char *path,
+                       const struct stat *st, const char *src_path,
+                       char **source, size_t *source_len, bool *refresh) {
+  char dst_path[4096];
+  entry_path(cache, path, dst_path, sizeof dst_path);
+
+  size_t len;
+  char *entry = read_file(dst_path, &len);
+  if (!entry)
+    return false;
+
+  ChunkHeader header;
+  bool fresh = false;
+
+  if (len >= sizeof header) {
+    memcpy(&header, entry, sizeof header);
+    fresh = memcmp(header.magic, CHUNK_CACHE_MAGIC, sizeof header.magic) == 0 &&
+            header.lua_version == LUA_VERSION_NUM &&
+            header.path_len == strlen(path) &&
+            len >= sizeof header + header.path_len &&
+            memcmp(entry + sizeof header, path, header.path_len) == 0 &&
+            header.size == (uint64_t)st->st_size;
+  }
+
+  // Same size but touched: compare contents before throwing the entry away
+  if (fresh && header.mtime_ns != stat_mtime_ns(st)) {
+    if (!*source)
+      *source = read_file(src_path, source_len);
+    fresh = *source && fnv1a(*source, *source_len) == header.hash;
+    *refresh = fresh;
+  }
+
+  if (fresh) {
+    size_t offset = sizeof header + header.path_len;
+    fresh = luaL_loadbufferx(L, entry + offset, len - offset, path, "b") ==
+            LUA_OK;
+    if (!fresh)
+      lua_pop(L, 1);
+  }
+
+  free(entry);
+  return fresh;
+}
+
+int chunk_cache_load(ChunkCache *cache, lua_State *L, const char *path) {
+  char src_path[4096];
+  source_path(cache, path, src_path, sizeof src_path);
+
+  struct stat st;
+  if (stat(src_path, &st) != 0) {
+    lua_pushfstring(L, "cannot open %s", src_path);
+    return LUA_ERRFILE;
+  }
+
+  char *source = NULL;
+  size_t len = 0;
+  bool refresh = false;
+
+  if (load_entry(cache, L, path, &st, src_path, &source, &len, &refresh)) {
+    cache->hits++;
+    if (refresh)
+      schedule_rebuild(cache, path);
+    free(source);
+    return LUA_OK;
+  }
+
+  cache->misses++;
+  if (!source)
+    source = read_file(src_path, &len);
+  if (!source) {
+    lua_pushfstring(L, "cannot read %s", src_path);
+    return LUA_ERRFILE;
+  }
+
+  lua_pushfstring(L, "@%s", src_path);
+  int status = luaL_loadbufferx(L, source, len, lua_tostring(L, -1), "t");
+  lua_remove(L, -2);
+  free(source);
+
+  if (status == LUA_OK)
+    schedule_rebuild(cache, path);
+
+  return status;
+}
+
+int chunk_cache_dofile(ChunkCache *cache, lua_State *L, const char *path) {
+  int status = chunk_cache_load(cache, L, path);
+  if (status != LUA_OK)
+    return status;
+
+  return lua_pcall(L, 0, LUA_MULTRET, 0);
+}
+
+// package.searchers entry for modules inside the game directory, mirroring
+// the "<game>/?.lua;<game>/?/init.lua" entries of package.path
+static int cache_searcher(lua_State *L) {
+  ChunkCache *cache = lua_touserdata(L, lua_upvalueindex(1));
+  const char *name = luaL_checkstring(L, 1);
+
+  luaL_Buffer b;
+  luaL_buffinit(L, &b);
+  for (const char *c = name; *c; c++)
+    luaL_addchar(&b, *c == '.' ? '/' : *c);
+  luaL_pushresult(&b);
+  const char *base = lua_tostring(L, -1);
+
+  const char *candidates[] = {
+      lua_pushfstring(L, "%s.lua", base),
+      lua_pushfstring(L, "%s/init.lua", base),
+  };
+
+  for (size_t i = 0; i < 2; i++) {
+    const char *full = lua_pushfstring(L, "%s/%s", cache->game_path,
+                                       candidates[i]);
+    if (!FileExists(full)) {
+      lua_pop(L, 1);
+      continue;
+    }
+
+    if (chunk_cache_load(cache, L, candidates[i]) != LUA_OK) {
+      return luaL_error(L, "error loading module '%s' from file '%s':\n\t%s",
+                        name, full, lua_tostring(L, -1));
+    }
+
+    lua_insert(L, -2); // chunk, then the file name for the loader
+    return 2;
+  }
+
+  lua_pushfstring(L, "no cached game file '%s/%s.lua'", cache->game_path,
+                  base);
+  return 1;
+}
+
+void chunk_cache_install(ChunkCache *cache, lua_State *L) {
+  lua_getglobal(L, "package");
+  lua_getfield(L, -1, "searchers");
+
+  // Insert after the preload searcher, ahead of the source file searcher
+  for (lua_Integer i = lua_rawlen(L, -1); i >= 2; i--) {
+    lua_rawgeti(L, -1, i);
+    lua_rawseti(L, -2, i + 1);
+  }
+  lua_pushlightuserdata(L, cache);
+  lua_pushcclosure(L, cache_searcher, 1);
+  lua_rawseti(L, -2, 2);
+
+  lua_pop(L, 2);
+}
+
+ChunkCache *chunk_cache_init(const char *game_path) {
+  ChunkCache *cache = calloc(1, sizeof(ChunkCache));
+  assert(cache);
+
+  cache->game_path = strdup(game_path);
+  pthread_mutex_init(&cache->lock, NULL);
+  pthread_cond_init(&cache->idle, NULL);
+
+  char dir[4096];
+  snprintf(dir, sizeof dir, "%s/%s", game_path, CHUNK_CACHE_DIR);
+  if (mkdir(dir, 0755) != 0 && !DirectoryExists(dir))
+    warning("Failed to create %s, Lua chunks will not be cached", dir);
+
+  return cache;
+}
+
+size_t chunk_cache_build_all(ChunkCache *cache, size_t *built) {
+  FilePathList files = LoadDirectoryFilesEx(cache->game_path, ".lua", true);
+  size_t prefix = strlen(cache->game_path) + 1;
+  size_t failed = 0;
+  *built = 0;
+
+  for (unsigned int i = 0; i < files.count; i++) {
+    const char *path = files.paths[i] + prefix;
+    if (strncmp(path, CHUNK_CACHE_DIR "/", strlen(CHUNK_CACHE_DIR) + 1) == 0)
+      continue;
+
+    if (chunk_cache_build(cache, path)) {
+      (*built)++;
+    } else {
+      error("Failed to compile %s", path);
+      failed++;
+    }
+  }
+
+  UnloadDirectoryFiles(files);
+  return failed;
+}
+
+void chunk_cache_free(ChunkCache *cache) {
+  if (!cache)
+    return;
+
+  pthread_mutex_lock(&cache->lock);
+  while (cache->pending_rebuilds > 0)
+    pthread_cond_wait(&cache->idle, &cache->lock);
+  pthread_mutex_unlock(&cache->lock);
+
+  pthread_cond_destroy(&cache->idle);
+  pthread_mutex_destroy(&cache->lock);
+  free(cache->game_path);
+  free(cache);
+}
@@ -0,0 +1,49 @@
+#ifndef CHUNK_CACHE_H_
+#define CHUNK_CACHE_H_
+
+#include "lua.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Directory inside the game that holds the compiled chunks
+#define CHUNK_CACHE_DIR ".tecache"
+
+// On-disk cache of compiled Lua chunks for the files of one game. An entry
+// is fresh when the source still has the recorded size and mtime, or
+// failing that the same content hash. Stale entries are loaded from source
+// and rebuilt on a background thread.
+typedef struct {
+  char *game_path;
+  size_t hits, misses;
+
+  // Background rebuilds still running, chunk_cache_free waits for them
+  pthread_mutex_t lock;
+  pthread_cond_t idle;
+  size_t pending_rebuilds;
+} ChunkCache;
+
+ChunkCache *chunk_cache_init(const char *game_path);
+void chunk_cache_free(ChunkCache *cache);
+
+// Adds a package.searchers entry that loads game modules through the cache
+void chunk_cache_install(ChunkCache *cache, lua_State *L);
+
+// Like luaL_loadfile for `path` relative to the game directory
+int chunk_cache_load(ChunkCache *cache, lua_State *L, const char *path);
+
+// Like luaL_dofile for `path` relative to the game directory
+int chunk_cache_dofile(ChunkCache *cache, lua_State *L, const char *path);
+
+// Compiles `path` and writes its entry, returns false on errors
+bool chunk_cache_build(ChunkCache *cache, const char *path);
+
+// Compiles Lua source into bytecode with a private state, so any thread
+// can call it. Returns NULL, after logging why, on syntax errors.
+char *chunk_compile(const char *source, size_t len, const char *chunkname,
+                    size_t *bytecode_len);
+
+// Builds an entry for every Lua file in the game, returns how many failed
+size_t chunk_cache_build_all(ChunkCache *cache, size_t *built);
+
+#endif // CHUNK_CACHE_H_
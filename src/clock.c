@@ -0,0 +1,22 @@
+#include "clock.h"
+#include <sched.h>
+
+// Sleeps are only trusted to within about a millisecond of the deadline
+#define CLOCK_SPIN_MARGIN 0.001
+
+void clock_wait_until(double deadline, ClockWait strategy) {
+  double remaining = deadline - clock_seconds();
+
+  if (strategy == CLOCK_WAIT_SLEEP && remaining > CLOCK_SPIN_MARGIN) {
+    double sleep_for = remaining - CLOCK_SPIN_MARGIN;
+    struct timespec ts = {.tv_sec = (time_t)sleep_for,
+                          .tv_nsec = (long)((sleep_for - (time_t)sleep_for) *
+                                            1e9)};
+    nanosleep(&ts, NULL);
+  }
+
+  while (clock_seconds() < deadline) {
+    if (strategy == CLOCK_WAIT_YIELD)
+      sched_yield();
+  }
+}
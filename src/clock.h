@@ -0,0 +1,22 @@
+#ifndef CLOCK_H_
+#define CLOCK_H_
+
+#include <time.h>
+
+// How the main loop waits out the rest of a frame
+typedef enum {
+  CLOCK_WAIT_SLEEP, // sleep, then spin the last millisecond for accuracy
+  CLOCK_WAIT_YIELD, // give the core away with sched_yield until the deadline
+  CLOCK_WAIT_SPIN,  // busy-wait, lowest jitter and highest power draw
+} ClockWait;
+
+// Monotonic wall clock in seconds, usable without a window
+static inline double clock_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+void clock_wait_until(double deadline, ClockWait strategy);
+
+#endif // CLOCK_H_
@@ -2,28 +2,31 @@
 #define COLORS_H_
 
 #define VGA_COLOR_LIST                                                         \
-  X(BLACK)                                                                     \
-  X(BLUE)                                                                      \
-  X(GREEN)                                                                     \
-  X(CYAN)                                                                      \
-  X(RED)                                                                       \
-  X(MAGENTA)                                                                   \
-  X(BROWN)                                                                     \
-  X(LIGHT_GRAY)                                                                \
-  X(DARK_GRAY)                                                                 \
-  X(LIGHT_BLUE)                                                                \
-  X(LIGHT_GREEN)                                                               \
-  X(LIGHT_CYAN)                                                                \
-  X(LIGHT_RED)                                                                 \
-  X(LIGHT_MAGENTA)                                                             \
-  X(YELLOW)                                                                    \
-  X(WHITE)
+  X(BLACK, 0x00, 0x00, 0x00)                                                   \
+  X(BLUE, 0x00, 0x00, 0xAA)                                                    \
+  X(GREEN, 0x00, 0xAA, 0x00)                                                   \
+  X(CYAN, 0x00, 0xAA, 0xAA)                                                    \
+  X(RED, 0xAA, 0x00, 0x00)                                                     \
+  X(MAGENTA, 0xAA, 0x00, 0xAA)                                                 \
+  X(BROWN, 0xAA, 0x55, 0x00)                                                   \
+  X(LIGHT_GRAY, 0xAA, 0xAA, 0xAA)                                              \
+  X(DARK_GRAY, 0x55, 0x55, 0x55)                                               \
+  X(LIGHT_BLUE, 0x55, 0x55, 0xFF)                                              \
+  X(LIGHT_GREEN, 0x55, 0xFF, 0x55)                                             \
+  X(LIGHT_CYAN, 0x55, 0xFF, 0xFF)                                              \
+  X(LIGHT_RED, 0xFF, 0x55, 0x55)                                               \
+  X(LIGHT_MAGENTA, 0xFF, 0x55, 0xFF)                                           \
+  X(YELLOW, 0xFF, 0xFF, 0x55)                                                  \
+  X(WHITE, 0xFF, 0xFF, 0xFF)
 
 typedef enum {
-#define X(name) VGA_##name,
+#define X(name, r, g, b) VGA_##name,
   VGA_COLOR_LIST
 #undef X
       VGA_COLOR_COUNT
 } VGA_Color;
 
+// Color index that lets the layer below show through, see ENGINE_MAX_LAYERS
+#define VGA_TRANSPARENT 0xFF
+
 #endif
@@ -0,0 +1,236 @@
+#include "draw.h"
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+enum { TOP_LEFT, TOP_RIGHT, BOTTOM_LEFT, BOTTOM_RIGHT, HORIZONTAL, VERTICAL };
+
+// CP437 box-drawing glyphs of each border style
+static const unsigned char border_glyphs[][6] = {
+    [DRAW_BORDER_SINGLE] = {218, 191, 192, 217, 196, 179},
+    [DRAW_BORDER_DOUBLE] = {201, 187, 200, 188, 205, 186},
+};
+
+static inline int min_int(int a, int b) { return a < b ? a : b; }
+
+static inline int max_int(int a, int b) { return a > b ? a : b; }
+
+DrawClip draw_clip_grid(const Grid *grid) {
+  return (DrawClip){0, 0, grid->w, grid->h};
+}
+
+DrawClip draw_clip_intersect(DrawClip a, DrawClip b) {
+  return (DrawClip){max_int(a.x0, b.x0), max_int(a.y0, b.y0),
+                    min_int(a.x1, b.x1), min_int(a.y1, b.y1)};
+}
+
+static inline void plot(Grid *grid, const DrawClip *clip, int x, int y,
+                        Cell cell) {
+  if (draw_clip_contains(clip, x, y))
+    grid_set(grid, x, y, cell);
+}
+
+// Cells [x0, x1) of row y
+static void span(Grid *grid, const DrawClip *clip, int x0, int x1, int y,
+                 Cell cell) {
+  if (y < clip->y0 || y >= clip->y1)
+    return;
+
+  x0 = max_int(x0, clip->x0);
+  x1 = min_int(x1, clip->x1);
+  if (x0 < x1)
+    grid_fill_span(grid, x0, y, x1 - x0, cell);
+}
+
+void draw_rect(Grid *grid, const DrawClip *clip, int x, int y, int w, int h,
+               Cell cell) {
+  int y0 = max_int(y, clip->y0);
+  int y1 = min_int(y + h, clip->y1);
+
+  for (int row = y0; row < y1; row++)
+    span(grid, clip, x, x + w, row, cell);
+}
+
+void draw_box(Grid *grid, const DrawClip *clip, int x, int y, int w, int h,
+              DrawBorder border, Cell cell) {
+  if (w <= 0 || h <= 0)
+    return;
+
+  const unsigned char *glyphs = border_glyphs[border];
+  int right = x + w - 1;
+  int bottom = y + h - 1;
+
+  Cell edge = cell;
+  edge.glyph = glyphs[HORIZONTAL];
+  span(grid, clip, x + 1, right, y, edge);
+  if (bottom > y)
+    span(grid, clip, x + 1, right, bottom, edge);
+
+  edge.glyph = glyphs[VERTICAL];
+  for (int row = max_int(y + 1, clip->y0); row < min_int(bottom, clip->y1);
+       row++) {
+    plot(grid, clip, x, row, edge);
+    plot(grid, clip, right, row, edge);
+  }
+
+  edge.glyph = glyphs[TOP_LEFT];
+  plot(grid, clip, x, y, edge);
+  edge.glyph = glyphs[TOP_RIGHT];
+  plot(grid, clip, right, y, edge);
+  if (bottom > y) {
+    edge.glyph = glyphs[BOTTOM_LEFT];
+    plot(grid, clip, x, bottom, edge);
+    edge.glyph = glyphs[BOTTOM_RIGHT];
+    plot(grid, clip, right, bottom, edge);
+  }
+}
+
+void draw_line(Grid *grid, const DrawClip *clip, int x0, int y0, int x1,
+               int y1, Cell cell) {
+  if (y0 == y1) {
+    span(grid, clip, min_int(x0, x1), max_int(x0, x1) + 1, y0, cell);
+    return;
+  }
+
+  // Step i moves one cell along the major axis and round(i * m / n) along
+  // the minor one, the cells Bresenham's error term picks. Computing each
+  // step directly lets the walk start where the line enters the clip.
+  bool steep = abs(y1 - y0) > abs(x1 - x0);
+  int64_t a0 = steep ? y0 : x0;
+  int64_t b0 = steep ? x0 : y0;
+  int64_t da = steep ? (int64_t)y1 - y0 : (int64_t)x1 - x0;
+  int64_t db = steep ? (int64_t)x1 - x0 : (int64_t)y1 - y0;
+  int sa = da < 0 ? -1 : 1;
+  int sb = db < 0 ? -1 : 1;
+  int64_t n = da < 0 ? -da : da;
+  int64_t m = db < 0 ? -db : db;
+
+  // Steps whose major coordinate is inside the clip
+  int64_t lo = steep ? clip->y0 : clip->x0;
+  int64_t hi = (steep ? clip->y1 : clip->x1) - 1;
+  int64_t i0 = sa > 0 ? lo - a0 : a0 - hi;
+  int64_t i1 = sa > 0 ? hi - a0 : a0 - lo;
+  if (i0 < 0)
+    i0 = 0;
+  if (i1 > n)
+    i1 = n;
+
+  for (int64_t i = i0; i <= i1; i++) {
+    int a = a0 + sa * i;
+    int b = b0 + sb * ((2 * i * m + n) / (2 * n));
+    plot(grid, clip, steep ? b : a, steep ? a : b, cell);
+  }
+}
+
+// Half width of the circle's row `dy` cells from its center, -1 past it
+static int half_width(int64_t r, int64_t dy) {
+  int64_t left = r * r + r - dy * dy;
+  if (left < 0)
+    return -1;
+
+  // sqrt rounded down, exact for the 48-bit values radii are limited to
+  int64_t w = (int64_t)sqrt((double)left);
+  while (w * w > left)
+    w--;
+  while ((w + 1) * (w + 1) <= left)
+    w++;
+  return w;
+}
+
+void draw_circle(Grid *grid, const DrawClip *clip, int cx, int cy, int r,
+                 Cell cell, bool filled) {
+  if (r < 0 || (int64_t)cx + r < clip->x0 || (int64_t)cx - r >= clip->x1 ||
+      (int64_t)cy + r < clip->y0 || (int64_t)cy - r >= clip->y1)
+    return;
+
+  int y0 = max_int(cy - r, clip->y0);
+  int y1 = min_int(cy + r, clip->y1 - 1);
+  for (int y = y0; y <= y1; y++) {
+    int dy = y - cy;
+    int w = half_width(r, dy);
+    if (filled) {
+      span(grid, clip, cx - w, cx + w + 1, y, cell);
+      continue;
+    }
+
+    // Cells past the narrower neighboring row have a vertical neighbor
+    // outside, the last cell of the row a horizontal one
+    int inner = min_int(half_width(r, dy - 1), half_width(r, dy + 1)) + 1;
+    inner = min_int(max_int(inner, 0), w);
+    span(grid, clip, cx + inner, cx + w + 1, y, cell);
+    span(grid, clip, cx - w, cx - inner + 1, y, cell);
+  }
+}
+
+typedef struct {
+  int x, y;
+} Seed;
+
+typedef struct {
+  Seed *seeds;
+  size_t count, capacity;
+} SeedStack;
+
+static void push_seed(SeedStack *stack, int x, int y) {
+  if (stack->count == stack->capacity) {
+    stack->capacity = stack->capacity ? stack->capacity * 2 : 64;
+    stack->seeds = realloc(stack->seeds, stack->capacity * sizeof(Seed));
+    assert(stack->seeds);
+  }
+  stack->seeds[stack->count++] = (Seed){x, y};
+}
+
+// Pushes one seed per run of `target` cells in [x0, x1] of row y
+static void push_runs(SeedStack *stack, Grid *grid, const DrawClip *clip,
+                      int x0, int x1, int y, Cell target) {
+  if (y < clip->y0 || y >= clip->y1)
+    return;
+
+  const Cell *row = grid_cell(grid, 0, y);
+  bool in_run = false;
+  for (int x = x0; x <= x1; x++) {
+    bool match = cell_eq(row[x], target);
+    if (match && !in_run)
+      push_seed(stack, x, y);
+    in_run = match;
+  }
+}
+
+size_t draw_flood(Grid *grid, const DrawClip *clip, int x, int y, Cell cell) {
+  if (!draw_clip_contains(clip, x, y))
+    return 0;
+
+  Cell target = *grid_cell(grid, x, y);
+  if (cell_eq(target, cell))
+    return 0;
+
+  size_t filled = 0;
+  SeedStack stack = {0};
+  push_seed(&stack, x, y);
+
+  while (stack.count > 0) {
+    Seed seed = stack.seeds[--stack.count];
+    const Cell *row = grid_cell(grid, 0, seed.y);
+    if (!cell_eq(row[seed.x], target))
+      continue; // filled from another seed since it was pushed
+
+    // Widen the seed to the whole run it is in, fill it in one go, then
+    // look for runs to continue from above and below it
+    int x0 = seed.x, x1 = seed.x;
+    while (x0 > clip->x0 && cell_eq(row[x0 - 1], target))
+      x0--;
+    while (x1 + 1 < clip->x1 && cell_eq(row[x1 + 1], target))
+      x1++;
+
+    grid_fill_span(grid, x0, seed.y, x1 - x0 + 1, cell);
+    filled += x1 - x0 + 1;
+
+    push_runs(&stack, grid, clip, x0, x1, seed.y - 1, target);
+    push_runs(&stack, grid, clip, x0, x1, seed.y + 1, target);
+  }
+
+  free(stack.seeds);
+
+  return filled;
+}
@@ -0,0 +1,59 @@
+#ifndef DRAW_H_
+#define DRAW_H_
+
+#include "grid.h"
+#include <stdbool.h>
+
+// Shapes drawn straight into a Grid. Rows are written as spans with
+// grid_fill_span, so cells that already match stay clean.
+
+// Depth of the te.graphics.pushClip stack
+#define DRAW_CLIP_DEPTH 16
+
+// Coordinates, sizes and radii given to the draw_* functions must lie
+// within +-DRAW_COORD_LIMIT, so sums like x + w never overflow an int
+#define DRAW_COORD_LIMIT (1 << 24)
+
+// Half-open cell rectangle [x0, x1) x [y0, y1) that drawing is limited to,
+// always within the grid. Empty when x0 >= x1 or y0 >= y1.
+typedef struct {
+  int x0, y0, x1, y1;
+} DrawClip;
+
+typedef enum {
+  DRAW_BORDER_SINGLE, // CP437 glyphs 179, 191, 192, 196, 217, 218
+  DRAW_BORDER_DOUBLE, // CP437 glyphs 186, 187, 188, 200, 201, 205
+} DrawBorder;
+
+static inline bool draw_clip_contains(const DrawClip *clip, int x, int y) {
+  return x >= clip->x0 && x < clip->x1 && y >= clip->y0 && y < clip->y1;
+}
+
+DrawClip draw_clip_grid(const Grid *grid);
+DrawClip draw_clip_intersect(DrawClip a, DrawClip b);
+
+// Filled w x h rectangle at (x, y)
+void draw_rect(Grid *grid, const DrawClip *clip, int x, int y, int w, int h,
+               Cell cell);
+
+// Border of the w x h rectangle at (x, y) in box-drawing glyphs, colored
+// like `cell`. The inside is left alone.
+void draw_box(Grid *grid, const DrawClip *clip, int x, int y, int w, int h,
+              DrawBorder border, Cell cell);
+
+// Bresenham line, both ends included. Only the steps inside the clip are
+// walked, so the cost is bounded by the clip's size, not the line's.
+void draw_line(Grid *grid, const DrawClip *clip, int x0, int y0, int x1,
+               int y1, Cell cell);
+
+// Circle of radius r around (cx, cy), the cells within r * (r + 1) squared
+// distance like te.fov lights. Outlines are the filled cells with a
+// 4-neighbor outside. Drawn row by row over the rows inside the clip.
+void draw_circle(Grid *grid, const DrawClip *clip, int cx, int cy, int r,
+                 Cell cell, bool filled);
+
+// Replaces the 4-connected area of cells equal to the one at (x, y) with
+// `cell`, one span per row run. Returns the number of cells changed.
+size_t draw_flood(Grid *grid, const DrawClip *clip, int x, int y, Cell cell);
+
+#endif // DRAW_H_
@@ -1,100 +1,18 @@
 #include "engine.h"
 #include "globals.h"
 #include "grid.h"
-#include "input/keystring.h"
+#include "jobs.h"
 #include "lauxlib.h"
 #include "lua.h"
 #include "lua_api.h"
 #include "lualib.h"
+#include "reload.h"
 #include "renderer.h"
 #include "slog.h"
 #include <assert.h>
 #include <raylib.h>
 #include <stdlib.h>
 
-#ifdef __linux__
-#include <fcntl.h>
-#include <sys/inotify.h>
-#include <unistd.h>
-#endif
-
-void init_engine_lua_script(Engine *engine) {
-  const char *main_path = TextFormat("%s/main.lua", engine->game_path);
-  if (luaL_dofile(engine->L, main_path) != LUA_OK) {
-    fatal("Failed to load main.lua: %s", lua_tostring(engine->L, -1));
-  }
-
-  call_load(engine->L);
-  info("Initialized load of lua script");
-}
-
-#define EVENT_SIZE (sizeof(struct inotify_event))
-#define BUF_LEN (1024 * (EVENT_SIZE + 16))
-
-void add_lua_file_watch(Engine *engine, const char *path) {
-
-#ifdef __linux__
-  int inotify_err =
-      inotify_add_watch(engine->watch_handle, path,
-                        IN_ATTRIB | IN_MODIFY | IN_CREATE | IN_DELETE);
-  assert(inotify_err != -1 && "failed to add watch");
-#endif
-}
-
-void init_lua_file_watch(Engine *engine) {
-#ifdef __linux__
-  int inotifyFd = inotify_init(); /* Create inotify instance */
-  assert(inotifyFd != -1 && "inotify init failed");
-  // TODO go through lua script path and add all lua files
-  int flags = fcntl(inotifyFd, F_GETFL, 0);
-  fcntl(inotifyFd, F_SETFL, flags | O_NONBLOCK);
-  engine->watch_handle = inotifyFd;
-  add_lua_file_watch(engine, TextFormat("%s/main.lua", engine->game_path));
-#endif
-}
-
-bool poll_lua_file_change(Engine *engine) {
-  bool change = false;
-
-#ifdef __linux__
-  char buffer[BUF_LEN] = {0};
-  assert(engine->watch_handle != 0);
-  int length = read(engine->watch_handle, buffer, BUF_LEN);
-
-  int i = 0;
-  while (i < length) {
-    struct inotify_event *event = (struct inotify_event *)&buffer[i];
-
-    if (event->mask & IN_MODIFY) {
-      info("Lua file was modified. Reloading...");
-      change = true;
-    }
-    if (event->mask & IN_CREATE) {
-      info("Lua file was created. Reloading...");
-      change = true;
-    }
-    if (event->mask & IN_DELETE) {
-      warning("Lua file was deleted. Reloading...");
-      change = true;
-    }
-    if (event->mask & IN_ATTRIB) {
-      info("Lua file was changed. Reloading...");
-      change = true;
-    }
-    if (event->mask & IN_IGNORED) {
-      warning(
-          "Lua file was removed from inotify. Adding back and reloading...");
-      add_lua_file_watch(engine, TextFormat("%s/main.lua", engine->game_path));
-      change = true;
-    }
-
-    i += EVENT_SIZE + event->len;
-  }
-#endif
-
-  return change;
-}
-
 static void CustomTraceLog(int msgType, const char *text, va_list args) {
   char buf[1024];
   vsnprintf(buf, sizeof buf, text, args);
@@ -118,108 +36,283 @@ static void CustomTraceLog(int msgType, const char *text, va_list args) {
   }
 }
 
-Engine *engine_init(const char *game_path) {
+// Runs main.lua from the game directory or bundle, leaving the error
+// message on the stack on failure
+static int run_main(Engine *engine) {
+  if (engine->chunk_cache)
+    return chunk_cache_dofile(engine->chunk_cache, engine->L, "main.lua");
+
+  if (!engine->bundle) {
+    lua_pushstring(engine->L, "the game bundle could not be opened");
+    return LUA_ERRFILE;
+  }
+  return bundle_dofile(engine->bundle, engine->L, "main.lua");
+}
+
+Engine *engine_init(EngineConfig config) {
+  double start = clock_seconds();
+
   Engine *engine = malloc(sizeof(Engine));
   assert(engine);
 
   engine->running = true;
   engine->exit_code = 0;
-  engine->game_path = game_path;
-  engine->stream_count = 0;
+  engine->game_path = config.game_path;
+  engine->config = config;
+  engine->frame = 0;
+  input_init(&engine->input);
+  engine->profiler = profiler_init();
+
+  // Bundles are read-only snapshots of a game, with nothing to watch or
+  // cache
+  bool bundled = config.bundle_data ||
+                 IsFileExtension(engine->game_path, BUNDLE_EXTENSION);
+  if (config.bundle_data) {
+    engine->bundle = bundle_open_memory(config.bundle_data, config.bundle_size);
+  } else {
+    engine->bundle = bundled ? bundle_open(engine->game_path) : NULL;
+  }
 
-  init_lua_file_watch(engine);
+  // Headless runs are meant to be reproducible, so they never hot reload
+  engine->watcher = config.headless || bundled
+                        ? NULL
+                        : watcher_start(engine->game_path);
+  jobs_init(0);
+  engine->chunk_cache = bundled ? NULL : chunk_cache_init(engine->game_path);
+  engine->resources = resources_init(engine->game_path, engine->bundle);
 
   engine->L = luaL_newstate();
   assert(engine->L);
   luaL_openlibs(engine->L);
   register_lua_api(engine);
 
+  if (engine->chunk_cache) {
+    // Let require() find modules anywhere in the game directory
+    lua_getglobal(engine->L, "package");
+    lua_pushfstring(engine->L, "%s/?.lua;%s/?/init.lua;", engine->game_path,
+                    engine->game_path);
+    lua_getfield(engine->L, -2, "path");
+    lua_concat(engine->L, 2);
+    lua_setfield(engine->L, -2, "path");
+    lua_pop(engine->L, 1);
+    chunk_cache_install(engine->chunk_cache, engine->L);
+  } else if (engine->bundle) {
+    bundle_install(engine->bundle, engine->L);
+  }
+
+  // Started before main.lua so loading is profiled as well
+  engine->lua_profiler =
+      config.lua_profile ? lua_profiler_start(engine->L) : NULL;
+
   SetTraceLogCallback(CustomTraceLog);
-  InitWindow(0, 0, "te");
-  InitAudioDevice();
-  SetWindowMonitor(0);
-  ToggleFullscreen();
-  SetTraceLogLevel(LOG_WARNING);
-
-  int sw = GetScreenWidth();
-  int sh = GetScreenHeight();
-  int w = sw / GLYPH_W;
-  int h = sh / GLYPH_H;
-
-  engine->grid = grid_init(w, h);
-  grid_fill(engine->grid, CELL_EMPTY);
-
-  const char *main_path = TextFormat("%s/main.lua", engine->game_path);
-  if (luaL_dofile(engine->L, main_path) != LUA_OK) {
+
+  int w, h;
+  engine->audio = NULL;
+  if (config.headless) {
+    SetTraceLogLevel(LOG_WARNING);
+    w = config.cols;
+    h = config.rows;
+  } else {
+    if (config.vsync)
+      SetConfigFlags(FLAG_VSYNC_HINT);
+    InitWindow(0, 0, "te");
+    InitAudioDevice();
+    if (IsAudioDeviceReady())
+      engine->audio = audio_init(config.audio_buffer_frames);
+    SetWindowMonitor(0);
+    ToggleFullscreen();
+    SetTraceLogLevel(LOG_WARNING);
+
+    int scale = config.scale > 1 ? config.scale : 1;
+    w = GetScreenWidth() / (GLYPH_W * scale);
+    h = GetScreenHeight() / (GLYPH_H * scale);
+  }
+
+  for (int i = 0; i < ENGINE_MAX_LAYERS; i++) {
+    engine->layers[i] = grid_init(w, h);
+    grid_fill(engine->layers[i], i == 0 ? CELL_EMPTY : CELL_CLEAR);
+  }
+  engine->layer = 0;
+  engine->grid = engine->layers[0];
+
+  // The renderer holds the draw state (colors), so it must exist before
+  // te.load runs
+  engine->renderer = renderer_init(engine);
+
+  if (run_main(engine) != LUA_OK) {
     fatal("Failed to load main.lua: %s", lua_tostring(engine->L, -1));
     return engine;
   }
 
   call_load(engine->L);
 
-  engine->renderer = renderer_init(engine);
+  if (engine->chunk_cache) {
+    info("Initialized te successfully in %.1f ms (%zu Lua chunks cached, %zu "
+         "compiled)",
+         (clock_seconds() - start) * 1000.0, engine->chunk_cache->hits,
+         engine->chunk_cache->misses);
+  } else {
+    info("Initialized te successfully in %.1f ms (from a bundle)",
+         (clock_seconds() - start) * 1000.0);
+  }
+  return engine;
+}
 
-  int cell_size[2] = {engine->renderer->atlas.glyph_w,
-                      engine->renderer->atlas.glyph_h};
-  SetShaderValue(engine->renderer->grid_shader.shader,
-                 engine->renderer->grid_shader.cellSizeLoc, cell_size,
-                 SHADER_UNIFORM_IVEC2);
+// Queues this frame's input, handles the engine hotkeys and hands the rest
+// to Lua in one batch
+void handle_input(Engine *engine) {
+  int scale = engine->config.scale > 1 ? engine->config.scale : 1;
+  input_poll(&engine->input, GLYPH_W * scale, GLYPH_H * scale);
 
-  int grid_size[2] = {engine->grid->w, engine->grid->h};
-  SetShaderValue(engine->renderer->grid_shader.shader,
-                 engine->renderer->grid_shader.gridSizeLoc, grid_size,
-                 SHADER_UNIFORM_IVEC2);
+  if (input_consume_key(&engine->input, KEY_F3))
+    engine->profiler->overlay = !engine->profiler->overlay;
 
-  info("Initialized te successfully!");
-  return engine;
+  if (engine->lua_profiler && input_consume_key(&engine->input, KEY_F4))
+    lua_profiler_write(engine->lua_profiler, engine->config.lua_profile_out);
+
+  call_input(engine->L, &engine->input);
 }
 
-void handle_all_keypresses(Engine *engine) {
-  int key;
+// Runs te.update for the time that passed since the last frame and returns
+// the interpolation alpha for te.draw
+static float run_updates(Engine *engine, double elapsed, double *accumulator) {
+  if (engine->config.tick_rate <= 0) {
+    call_update(engine->L, elapsed);
+    return 1.0f;
+  }
+
+  double tick = 1.0 / engine->config.tick_rate;
+  int max_ticks = engine->config.max_ticks > 0 ? engine->config.max_ticks : 1;
+  int ticks = 0;
 
-  while ((key = GetKeyPressed()) != 0) {
-    const char *keyStr = keycode_to_string(key);
-    if (keyStr != NULL) {
-      call_keypressed(engine->L, keyStr);
-    }
+  *accumulator += elapsed;
+  while (*accumulator >= tick && ticks < max_ticks) {
+    call_update(engine->L, tick);
+    *accumulator -= tick;
+    ticks++;
   }
+
+  // Too far behind to catch up: drop the backlog instead of spiralling
+  if (*accumulator >= tick) {
+    debug("Dropping %d update ticks", (int)(*accumulator / tick));
+    *accumulator -= tick * (int)(*accumulator / tick);
+  }
+
+  return *accumulator / tick;
 }
 
 int engine_run(Engine *engine) {
-  while (engine->running) {
-    float dt = GetFrameTime();
+  double accumulator = 0.0;
+  double last = clock_seconds();
 
-    if (poll_lua_file_change(engine)) {
-      init_engine_lua_script(engine);
+  while (engine->running) {
+    double frame_start = clock_seconds();
+    double elapsed = frame_start - last;
+    last = frame_start;
+    profiler_begin(engine->profiler, PROFILER_FRAME);
+
+    // Headless runs advance a virtual clock so frame dumps are reproducible
+    if (engine->config.headless)
+      elapsed = 1.0 / (engine->config.target_fps > 0 ? engine->config.target_fps
+                                                     : 60);
+
+    profiler_begin(engine->profiler, PROFILER_WATCH);
+    char **changed;
+    size_t change_count = watcher_poll(engine->watcher, &changed);
+    if (change_count > 0) {
+      reload_lua_changes(engine, changed, change_count);
+      watcher_free_changes(changed, change_count);
     }
+    profiler_end(engine->profiler, PROFILER_WATCH);
+
+    profiler_begin(engine->profiler, PROFILER_LOAD);
+    int preloaded[16];
+    size_t preload_count = resources_update(engine->resources, preloaded, 16);
+    lua_profiler_resume(engine->lua_profiler);
+    for (size_t i = 0; i < preload_count; i++)
+      call_preloaded(engine->L, preloaded[i]);
+    profiler_end(engine->profiler, PROFILER_LOAD);
 
     /* --- Input --- */
-    handle_all_keypresses(engine);
+    profiler_begin(engine->profiler, PROFILER_INPUT);
+    lua_profiler_resume(engine->lua_profiler);
+    if (!engine->config.headless)
+      handle_input(engine);
+    profiler_end(engine->profiler, PROFILER_INPUT);
 
     /* --- Update --- */
-    call_update(engine->L, dt);
+    profiler_begin(engine->profiler, PROFILER_UPDATE);
+    lua_profiler_resume(engine->lua_profiler);
+    float alpha = run_updates(engine, elapsed, &accumulator);
+    profiler_end(engine->profiler, PROFILER_UPDATE);
 
-    /* --- Update streaming audio --- */
-    for (int i = 0; i < engine->stream_count; i++) {
-      UpdateMusicStream(engine->streams[i]);
-    }
+    /* --- Free finished voices, streams refill on the audio thread --- */
+    profiler_begin(engine->profiler, PROFILER_AUDIO);
+    audio_update(engine->audio);
+    profiler_end(engine->profiler, PROFILER_AUDIO);
 
     /* --- Draw --- */
-    call_draw(engine->L);
+    profiler_begin(engine->profiler, PROFILER_DRAW);
+    lua_profiler_resume(engine->lua_profiler);
+    // A te.draw that errored between pushClip and popClip must not leave
+    // the next frame clipped
+    engine->renderer->clip_depth = 0;
+    call_draw(engine->L, alpha);
+    // The overlay goes on the top layer only for this frame, so the layers
+    // the game keeps between frames never lose cells to it
+    Grid *top = engine->layers[ENGINE_MAX_LAYERS - 1];
+    if (engine->profiler->overlay)
+      profiler_draw_overlay(engine->profiler, top);
+    profiler_end(engine->profiler, PROFILER_DRAW);
 
     render_frame(engine);
+    profiler_restore_overlay(engine->profiler, top);
+
+    engine->frame++;
+    if (engine->config.max_frames > 0 &&
+        engine->frame >= engine->config.max_frames)
+      engine->running = false;
+
+    /* --- Frame pacing --- */
+    if (!engine->config.headless && engine->config.target_fps > 0) {
+      clock_wait_until(frame_start + 1.0 / engine->config.target_fps,
+                       engine->config.wait);
+    }
+
+    profiler_end(engine->profiler, PROFILER_FRAME);
+    profiler_end_frame(engine->profiler);
   }
 
   return engine->exit_code;
 }
 
 void engine_free(Engine *engine) {
+  if (engine->config.frame_stats_out)
+    profiler_dump(engine->profiler, engine->config.frame_stats_out);
+  profiler_free(engine->profiler);
+
+  if (engine->lua_profiler) {
+    lua_profiler_write(engine->lua_profiler, engine->config.lua_profile_out);
+    lua_profiler_stop(engine->lua_profiler);
+  }
+
   if (engine->L)
     lua_close(engine->L);
+  chunk_cache_free(engine->chunk_cache);
+  audio_free(engine->audio); // after the sources Lua held
+  resources_free(engine->resources);
+  bundle_close(engine->bundle);
   if (engine->renderer)
     renderer_free(engine->renderer);
-  if (engine->grid)
-    grid_free(engine->grid);
-  CloseWindow();
+  for (int i = 0; i < ENGINE_MAX_LAYERS; i++) {
+    if (engine->layers[i])
+      grid_free(engine->layers[i]);
+  }
+  watcher_stop(engine->watcher);
+  jobs_shutdown();
+  if (!engine->config.headless) {
+    CloseAudioDevice();
+    CloseWindow();
+  }
   free(engine);
 }
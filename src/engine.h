@@ -1,28 +1,84 @@
 #ifndef ENGINE_H_
 #define ENGINE_H_
 
+#include "bundle.h"
+#include "audio.h"
+#include "chunk_cache.h"
+#include "clock.h"
 #include "grid.h"
+#include "input/input.h"
 #include "lua.h"
+#include "lua_profiler.h"
+#include "profiler.h"
+#include "resources.h"
+#include "watcher.h"
 
-#define ENGINE_MAX_STREAMS 5
+// Grid layers composited back to front in one shader pass. A VGA_TRANSPARENT
+// bg shows the layer below, a VGA_TRANSPARENT fg hides the glyph. Bounded by
+// the texture units raylib binds per draw: the glyph atlas plus one per layer.
+#define ENGINE_MAX_LAYERS 3
 
 typedef struct Renderer Renderer;
 
+typedef struct {
+  const char *game_path; // a game directory or a .te bundle
+
+  // A bundle linked into the binary, runs instead of game_path when set
+  const unsigned char *bundle_data;
+  size_t bundle_size;
+
+  // Headless mode skips the window and audio device and rasterizes frames on
+  // the CPU into a grid of `cols` x `rows` cells
+  bool headless;
+  size_t cols, rows;
+  long max_frames;       // stop after this many frames, 0 runs until quit
+  const char *frame_out; // headless frame dump path, see raster_write
+
+  // Frame scheduling. With a tick rate te.update runs at that fixed rate
+  // (catching up at most max_ticks per frame) and te.draw gets the
+  // interpolation alpha, otherwise te.update runs once per frame.
+  int tick_rate;
+  int max_ticks;
+  int target_fps; // 0 renders as fast as possible
+  bool vsync;
+  ClockWait wait;
+
+  // Integer upscale of the grid, whose cells are then scale glyphs wide and
+  // tall on screen. 0 or 1 draws the glyphs at their size.
+  int scale;
+
+  const char *frame_stats_out; // per-phase timings written at exit
+
+  int audio_buffer_frames; // music stream buffer size, 0 for raylib's default
+
+  // Lua sampling profiler, written as collapsed stacks at exit and on F4
+  bool lua_profile;
+  const char *lua_profile_out;
+} EngineConfig;
+
 typedef struct {
   bool running;
   int exit_code;
   const char *game_path;
+  EngineConfig config;
+  long frame;
 
   lua_State *L;
   Renderer *renderer;
-  Grid *grid;
-  int watch_handle;
-
-  Music streams[ENGINE_MAX_STREAMS];
-  int stream_count;
+  Grid *layers[ENGINE_MAX_LAYERS];
+  int layer;
+  Grid *grid; // layers[layer], the target of te.graphics
+  Profiler *profiler;
+  LuaProfiler *lua_profiler; // NULL unless config.lua_profile
+  Input input;
+  Watcher *watcher;        // hot reload, NULL when unsupported
+  ChunkCache *chunk_cache; // NULL when running a bundle
+  Bundle *bundle;          // NULL when running a game directory
+  Resources *resources;
+  Audio *audio; // NULL without an audio device (headless)
 } Engine;
 
-Engine *engine_init(const char *game_path);
+Engine *engine_init(EngineConfig config);
 int engine_run(Engine *engine);
 void engine_free(Engine *engine);
 void render_frame(Engine *engine);
@@ -3,51 +3,276 @@
 #include <stdlib.h>
 #include <string.h>
 
-Grid *grid_init(int w, int h) {
-  Grid *grid = malloc(sizeof(Grid) + (w * h * sizeof(Cell)));
+// Cells are uploaded to the RGBA8 grid texture without conversion
+_Static_assert(sizeof(Cell) == 4, "Cell must match the grid texel layout");
+
+Grid *grid_init(size_t w, size_t h) {
+  assert(w > 0 && h > 0 && w <= GRID_MAX_CELLS / h);
+  Grid *grid = malloc(sizeof(Grid) + w * h * sizeof(Cell));
   assert(grid != NULL);
 
   grid->w = w;
   grid->h = h;
+  grid->origin = 0;
+
+  grid->dirty = malloc(h * sizeof(GridSpan));
+  assert(grid->dirty != NULL);
+  grid_clear_dirty(grid);
+
+  // Nothing has been uploaded yet, so the whole grid starts out dirty
+  grid_mark_dirty(grid, 0, 0, w, h);
 
   return grid;
 }
 
+// `y` is a storage row, see grid_storage_row
+static inline void mark_cell_dirty(Grid *grid, size_t x, size_t y) {
+  GridSpan *span = &grid->dirty[y];
+  if (x < span->x0)
+    span->x0 = x;
+  if (x + 1 > span->x1)
+    span->x1 = x + 1;
+  if (y < grid->dirty_y0)
+    grid->dirty_y0 = y;
+  if (y + 1 > grid->dirty_y1)
+    grid->dirty_y1 = y + 1;
+}
+
 void grid_set(Grid *grid, size_t x, size_t y, Cell cell) {
-  grid->cells[y * grid->w + x] = cell;
+  Cell *dst = grid_cell(grid, x, y);
+
+  // Only cells that actually change need to be re-uploaded, so a frame that
+  // clears and redraws the same picture stays clean
+  if (cell_eq(*dst, cell))
+    return;
+
+  *dst = cell;
+  mark_cell_dirty(grid, x, grid_storage_row(grid, y));
+}
+
+// Sets the cells [x, x + w) of row y, marking only the run that changed
+void grid_fill_span(Grid *grid, size_t x, size_t y, size_t w, Cell cell) {
+  assert(x + w <= grid->w && y < grid->h);
+  Cell *row = grid_cell(grid, x, y);
+
+  size_t first = w, last = 0;
+  for (size_t i = 0; i < w; i++) {
+    if (!cell_eq(row[i], cell)) {
+      row[i] = cell;
+      if (first == w)
+        first = i;
+      last = i;
+    }
+  }
+
+  if (first < w) {
+    size_t stored = grid_storage_row(grid, y);
+    mark_cell_dirty(grid, x + first, stored);
+    mark_cell_dirty(grid, x + last, stored);
+  }
 }
 
 void grid_fill(Grid *grid, Cell cell) {
-  for (int y = 0; y < (int)grid->h; y++) {
-    for (int x = 0; x < (int)grid->w; x++) {
-      grid_set(grid, x, y, cell);
+  // Every cell gets the same value, so rows are visited in storage order
+  for (size_t y = 0; y < grid->h; y++) {
+    Cell *row = &grid->cells[y * grid->w];
+
+    for (size_t x = 0; x < grid->w; x++) {
+      if (!cell_eq(row[x], cell)) {
+        row[x] = cell;
+        mark_cell_dirty(grid, x, y);
+      }
+    }
+  }
+}
+
+size_t grid_plane_stride(GridPlane plane) {
+  switch (plane) {
+  case GRID_PLANE_TEXELS:
+    return sizeof(Cell);
+  case GRID_PLANE_CELLS:
+    return 3;
+  case GRID_PLANE_GLYPHS:
+    return 1;
+  case GRID_PLANE_COLORS:
+    return 2;
+  }
+  return 0;
+}
+
+// Copies a w x h block of packed cells from `src` to (x, y), clipped to the
+// grid. Rows that already match are skipped so they stay clean.
+void grid_blit(Grid *grid, int x, int y, int w, int h,
+               const unsigned char *src, GridPlane plane) {
+  size_t bpp = grid_plane_stride(plane);
+  size_t src_pitch = (size_t)w * bpp;
+
+  int x0 = x < 0 ? 0 : x;
+  int y0 = y < 0 ? 0 : y;
+  int x1 = x + w > (int)grid->w ? (int)grid->w : x + w;
+  int y1 = y + h > (int)grid->h ? (int)grid->h : y + h;
+  if (x0 >= x1 || y0 >= y1)
+    return;
+
+  size_t span = x1 - x0;
+
+  for (int row = y0; row < y1; row++) {
+    const unsigned char *in = src + (row - y) * src_pitch + (x0 - x) * bpp;
+    size_t stored = grid_storage_row(grid, row);
+    Cell *out = &grid->cells[stored * grid->w + x0];
+
+    switch (plane) {
+    case GRID_PLANE_TEXELS:
+      if (memcmp(out, in, span * sizeof(Cell)) == 0)
+        continue;
+      memcpy(out, in, span * sizeof(Cell));
+      break;
+
+    case GRID_PLANE_CELLS:
+      for (size_t i = 0; i < span; i++) {
+        const unsigned char *c = &in[i * 3];
+        if (out[i].glyph != c[0] || out[i].fg != c[1] || out[i].bg != c[2]) {
+          out[i].glyph = c[0];
+          out[i].fg = c[1];
+          out[i].bg = c[2];
+          mark_cell_dirty(grid, x0 + i, stored);
+        }
+      }
+      continue;
+
+    case GRID_PLANE_GLYPHS:
+      for (size_t i = 0; i < span; i++) {
+        if (out[i].glyph != in[i]) {
+          out[i].glyph = in[i];
+          mark_cell_dirty(grid, x0 + i, stored);
+        }
+      }
+      continue;
+
+    case GRID_PLANE_COLORS:
+      for (size_t i = 0; i < span; i++) {
+        if (out[i].fg != in[i * 2 + 0] || out[i].bg != in[i * 2 + 1]) {
+          out[i].fg = in[i * 2 + 0];
+          out[i].bg = in[i * 2 + 1];
+          mark_cell_dirty(grid, x0 + i, stored);
+        }
+      }
+      continue;
     }
+
+    grid_mark_dirty(grid, x0, row, span, 1);
   }
 }
 
-Texture grid_render_texture(Grid *grid) {
-  Image image = GenImageColor(grid->w, grid->h, BLANK);
-  unsigned char *image_data = image.data;
+static void fill_row(Grid *grid, size_t x, size_t y, size_t w, Cell fill) {
+  Cell *row = grid_cell(grid, x, y);
+  for (size_t i = 0; i < w; i++)
+    row[i] = fill;
+}
+
+// Scrolls every row of the grid by rotating the origin, so only the `dy`
+// rows brought in are written and uploaded
+static void scroll_ring(Grid *grid, int dy, Cell fill) {
+  int h = grid->h;
+  int origin = ((int)grid->origin - dy) % h;
+  grid->origin = origin < 0 ? origin + h : origin;
+
+  int y0 = dy > 0 ? 0 : h + dy;
+  int y1 = dy > 0 ? dy : h;
+  for (int y = y0; y < y1; y++)
+    fill_row(grid, 0, y, grid->w, fill);
+  grid_mark_dirty(grid, 0, y0, grid->w, y1 - y0);
+}
+
+void grid_scroll(Grid *grid, int x, int y, int w, int h, int dx, int dy,
+                 Cell fill) {
+  int x0 = x < 0 ? 0 : x;
+  int y0 = y < 0 ? 0 : y;
+  int x1 = x + w > (int)grid->w ? (int)grid->w : x + w;
+  int y1 = y + h > (int)grid->h ? (int)grid->h : y + h;
+  if (x0 >= x1 || y0 >= y1 || (dx == 0 && dy == 0))
+    return;
+
+  w = x1 - x0;
+  h = y1 - y0;
+  if (abs(dx) >= w || abs(dy) >= h) {
+    for (int row = y0; row < y1; row++)
+      fill_row(grid, x0, row, w, fill);
+    grid_mark_dirty(grid, x0, y0, w, h);
+    return;
+  }
+
+  if (dx == 0 && w == (int)grid->w && h == (int)grid->h) {
+    scroll_ring(grid, dy, fill);
+    return;
+  }
+
+  // Rows are visited away from the direction they move in, so no row is
+  // overwritten before it has been moved. Within a row memmove handles the
+  // overlap.
+  size_t span = w - abs(dx);
+  int src_x = x0 + (dx < 0 ? -dx : 0);
+  int dst_x = x0 + (dx > 0 ? dx : 0);
+  int gap_x = dx > 0 ? x0 : x1 + dx;
 
-  for (int y = 0; y < (int)grid->h; y++) {
-    for (int x = 0; x < (int)grid->w; x++) {
-      Cell cell = grid->cells[y * grid->w + x];
+  for (int i = 0; i < h; i++) {
+    int row = dy > 0 ? y1 - 1 - i : y0 + i;
+    int src_row = row - dy;
 
-      int pixel_offset = (y * grid->w + x) * 4;
-      image_data[pixel_offset + 0] = cell.glyph; // R: character
-      image_data[pixel_offset + 1] = cell.fg;    // G: fg color
-      image_data[pixel_offset + 2] = cell.bg;    // B: bg color
-      image_data[pixel_offset + 3] = 255;        // A: alpha
+    if (src_row < y0 || src_row >= y1) {
+      fill_row(grid, x0, row, w, fill);
+      continue;
     }
+
+    memmove(grid_cell(grid, dst_x, row), grid_cell(grid, src_x, src_row),
+            span * sizeof(Cell));
+    fill_row(grid, gap_x, row, abs(dx), fill);
+  }
+
+  grid_mark_dirty(grid, x0, y0, w, h);
+}
+
+// Marks the w x h region at (x, y) for upload, clipped to the grid
+void grid_mark_dirty(Grid *grid, size_t x, size_t y, size_t w, size_t h) {
+  if (x >= grid->w || y >= grid->h || w == 0 || h == 0)
+    return;
+  if (x + w > grid->w)
+    w = grid->w - x;
+  if (y + h > grid->h)
+    h = grid->h - y;
+
+  // The rows may wrap around the end of the storage
+  for (size_t row = y; row < y + h; row++) {
+    size_t stored = grid_storage_row(grid, row);
+    GridSpan *span = &grid->dirty[stored];
+    if (x < span->x0)
+      span->x0 = x;
+    if (x + w > span->x1)
+      span->x1 = x + w;
+    if (stored < grid->dirty_y0)
+      grid->dirty_y0 = stored;
+    if (stored + 1 > grid->dirty_y1)
+      grid->dirty_y1 = stored + 1;
   }
+}
 
-  Texture texture = LoadTextureFromImage(image);
-  UnloadImage(image);
+void grid_clear_dirty(Grid *grid) {
+  for (size_t y = 0; y < grid->h; y++) {
+    grid->dirty[y] = (GridSpan){.x0 = grid->w, .x1 = 0};
+  }
 
-  return texture;
+  grid->dirty_y0 = grid->h;
+  grid->dirty_y1 = 0;
 }
 
-void grid_free(Grid *grid) { free(grid); }
+bool grid_is_dirty(const Grid *grid) {
+  return grid->dirty_y0 < grid->dirty_y1;
+}
+
+void grid_free(Grid *grid) {
+  free(grid->dirty);
+  free(grid);
+}
 
 void grid_print(Grid *grid, size_t x, size_t y, const char *text) {
   size_t cx = x;
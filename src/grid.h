@@ -3,25 +3,109 @@
 
 #include "colors.h"
 #include "raylib.h"
+#include <stdbool.h>
 #include <stddef.h>
 
+// One RGBA8 texel of the grid texture, so uploads copy cells as they are
 typedef struct {
   unsigned char glyph, fg, bg;
+  unsigned char flags; // CELL_* attributes and a cycle group, 0 by default
 } Cell;
 
+// Bits of Cell.flags, applied at draw time so animating them costs no grid
+// writes. See palette_resolve.
+#define CELL_ATTRIBUTE_LIST                                                    \
+  X(BLINK, 0x01)     /* the glyph blinks, see PALETTE_BLINK_HZ */              \
+  X(REVERSE, 0x02)   /* fg and bg swapped */                                   \
+  X(UNDERLINE, 0x04) /* fg on the bottom pixel row */                          \
+  X(BRIGHT, 0x08)    /* fg from the bright half of the palette */
+
+enum {
+#define X(name, bit) CELL_##name = bit,
+  CELL_ATTRIBUTE_LIST
+#undef X
+};
+
+// The high bits of Cell.flags pick a palette cycle group, 0 is none
+#define CELL_CYCLE_SHIFT 4
+#define CELL_CYCLE_MASK 0x30
+
 #define CELL_EMPTY                                                             \
-  (Cell) { .glyph = 0, .fg = VGA_BLACK, .bg = VGA_BLACK }
+  (Cell) { .glyph = 0, .fg = VGA_BLACK, .bg = VGA_BLACK, .flags = 0 }
+
+// Fully see-through cell, the empty state of layers above the first
+#define CELL_CLEAR                                                             \
+  (Cell) {                                                                     \
+    .glyph = 0, .fg = VGA_TRANSPARENT, .bg = VGA_TRANSPARENT, .flags = 0       \
+  }
+
+// Half-open column range [x0, x1) of a row changed since the last upload.
+// A span with x0 >= x1 is clean.
+typedef struct {
+  size_t x0, x1;
+} GridSpan;
+
+// Byte layouts accepted by grid_blit, one entry per cell
+typedef enum {
+  GRID_PLANE_TEXELS, // glyph, fg, bg, flags, the in-memory Cell layout
+  GRID_PLANE_CELLS,  // glyph, fg, bg, flags are kept
+  GRID_PLANE_GLYPHS, // glyph, colors are kept
+  GRID_PLANE_COLORS, // fg, bg, glyphs are kept
+} GridPlane;
 
 typedef struct {
   size_t w, h;
+
+  // Rows are a ring: row y is stored at row (origin + y) % h of `cells`, so
+  // scrolling the whole grid vertically moves the origin instead of the
+  // cells. Grids that never call grid_scroll keep it 0 and are stored in
+  // order.
+  size_t origin;
+
+  // Dirty tracking: rows [dirty_y0, dirty_y1) may hold non-empty spans.
+  // Indexed by storage row, the way the cells are uploaded.
+  GridSpan *dirty;
+  size_t dirty_y0, dirty_y1;
+
   Cell cells[]; // flexible array member
 } Grid;
 
-Grid *grid_init(int w, int h);
+static inline bool cell_eq(Cell a, Cell b) {
+  return a.glyph == b.glyph && a.fg == b.fg && a.bg == b.bg &&
+         a.flags == b.flags;
+}
+
+// The row of `cells` that holds row `y`
+static inline size_t grid_storage_row(const Grid *grid, size_t y) {
+  size_t row = grid->origin + y;
+  return row < grid->h ? row : row - grid->h;
+}
+
+static inline Cell *grid_cell(Grid *grid, size_t x, size_t y) {
+  return &grid->cells[grid_storage_row(grid, y) * grid->w + x];
+}
+
+// Largest grid grid_init accepts, 64 MiB of cells
+#define GRID_MAX_CELLS ((size_t)1 << 24)
+
+Grid *grid_init(size_t w, size_t h);
 void grid_set(Grid *grid, size_t x, size_t y, Cell cell);
+void grid_fill_span(Grid *grid, size_t x, size_t y, size_t w, Cell cell);
 void grid_fill(Grid *grid, Cell cell);
-Texture grid_render_texture(Grid *grid);
 void grid_free(Grid *grid);
 void grid_print(Grid *grid, size_t x, size_t y, const char *text);
+void grid_blit(Grid *grid, int x, int y, int w, int h,
+               const unsigned char *src, GridPlane plane);
+size_t grid_plane_stride(GridPlane plane);
+
+// Moves the cells of the w x h region at (x, y) by (dx, dy) cells, clipped
+// to the grid. Cells moved out of the region are dropped and the ones left
+// behind become `fill`.
+void grid_scroll(Grid *grid, int x, int y, int w, int h, int dx, int dy,
+                 Cell fill);
+
+void grid_mark_dirty(Grid *grid, size_t x, size_t y, size_t w, size_t h);
+void grid_clear_dirty(Grid *grid);
+bool grid_is_dirty(const Grid *grid);
 
 #endif // GRID_H_
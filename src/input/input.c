@@ -0,0 +1,134 @@
+#include "input.h"
+#include "raylib.h"
+
+// Keys that have a name are the only ones games can see, so only those are
+// checked for releases and repeats
+static const int named_keys[] = {
+#define KEYDEF(key, str) key,
+#include "keycodes.def"
+#undef KEYDEF
+};
+
+#define KEY_COUNT (sizeof(named_keys) / sizeof(named_keys[0]))
+
+static const int mouse_buttons[] = {
+    MOUSE_BUTTON_LEFT,
+    MOUSE_BUTTON_RIGHT,
+    MOUSE_BUTTON_MIDDLE,
+};
+
+#define MOUSE_BUTTON_COUNT (sizeof(mouse_buttons) / sizeof(mouse_buttons[0]))
+
+void input_init(Input *input) {
+  input->head = 0;
+  input->count = 0;
+  input->dropped = 0;
+  input->key_repeat = false;
+  input->mouse_x = -1;
+  input->mouse_y = -1;
+}
+
+void input_push(Input *input, InputEvent event) {
+  if (input->count == INPUT_QUEUE_SIZE) {
+    input->head = (input->head + 1) % INPUT_QUEUE_SIZE;
+    input->count--;
+    input->dropped++;
+  }
+
+  input->events[(input->head + input->count) % INPUT_QUEUE_SIZE] = event;
+  input->count++;
+}
+
+bool input_pop(Input *input, InputEvent *event) {
+  if (input->count == 0)
+    return false;
+
+  *event = input->events[input->head];
+  input->head = (input->head + 1) % INPUT_QUEUE_SIZE;
+  input->count--;
+
+  return true;
+}
+
+void input_clear(Input *input) {
+  input->head = 0;
+  input->count = 0;
+}
+
+bool input_consume_key(Input *input, int key) {
+  bool found = false;
+  size_t kept = 0;
+
+  // Compact the queue in place, keeping the order of the other events
+  for (size_t i = 0; i < input->count; i++) {
+    InputEvent event = input->events[(input->head + i) % INPUT_QUEUE_SIZE];
+
+    if ((event.type == INPUT_KEY_PRESSED || event.type == INPUT_KEY_REPEAT) &&
+        event.key == key) {
+      found = true;
+      continue;
+    }
+
+    input->events[(input->head + kept) % INPUT_QUEUE_SIZE] = event;
+    kept++;
+  }
+
+  input->count = kept;
+  return found;
+}
+
+static void poll_keys(Input *input) {
+  // Presses come from raylib's queue so they keep their order
+  int key;
+  while ((key = GetKeyPressed()) != 0) {
+    input_push(input, (InputEvent){.type = INPUT_KEY_PRESSED, .key = key});
+  }
+
+  for (size_t i = 0; i < KEY_COUNT; i++) {
+    if (input->key_repeat && IsKeyPressedRepeat(named_keys[i])) {
+      input_push(input, (InputEvent){.type = INPUT_KEY_REPEAT,
+                                     .key = named_keys[i]});
+    }
+    if (IsKeyReleased(named_keys[i])) {
+      input_push(input, (InputEvent){.type = INPUT_KEY_RELEASED,
+                                     .key = named_keys[i]});
+    }
+  }
+
+  int codepoint;
+  while ((codepoint = GetCharPressed()) != 0) {
+    input_push(input,
+               (InputEvent){.type = INPUT_TEXT, .codepoint = codepoint});
+  }
+}
+
+static void poll_mouse(Input *input, int cell_w, int cell_h) {
+  Vector2 pos = GetMousePosition();
+  int x = (int)pos.x / cell_w;
+  int y = (int)pos.y / cell_h;
+
+  if (x != input->mouse_x || y != input->mouse_y) {
+    input->mouse_x = x;
+    input->mouse_y = y;
+    input_push(input, (InputEvent){.type = INPUT_MOUSE_MOVED,
+                                   .mouse = {.x = x, .y = y}});
+  }
+
+  for (size_t i = 0; i < MOUSE_BUTTON_COUNT; i++) {
+    InputEvent event = {.mouse = {.x = x, .y = y, .button = mouse_buttons[i]}};
+
+    if (IsMouseButtonPressed(mouse_buttons[i])) {
+      event.type = INPUT_MOUSE_PRESSED;
+      input_push(input, event);
+    }
+    if (IsMouseButtonReleased(mouse_buttons[i])) {
+      event.type = INPUT_MOUSE_RELEASED;
+      input_push(input, event);
+    }
+  }
+}
+
+void input_poll(Input *input, int cell_w, int cell_h) {
+  poll_keys(input);
+  poll_mouse(input, cell_w, cell_h);
+}
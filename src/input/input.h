@@ -0,0 +1,64 @@
+#ifndef INPUT_H_
+#define INPUT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Events buffered between two dispatches into Lua, the oldest are dropped
+// when a frame produces more
+#define INPUT_QUEUE_SIZE 256
+
+// Event types and the te callback each one is dispatched to
+#define INPUT_EVENTS(X)                                                        \
+  X(KEY_PRESSED, "keypressed")                                                 \
+  X(KEY_REPEAT, "keypressed")                                                  \
+  X(KEY_RELEASED, "keyreleased")                                               \
+  X(TEXT, "textinput")                                                         \
+  X(MOUSE_MOVED, "mousemoved")                                                 \
+  X(MOUSE_PRESSED, "mousepressed")                                             \
+  X(MOUSE_RELEASED, "mousereleased")
+
+typedef enum {
+#define X(name, callback) INPUT_##name,
+  INPUT_EVENTS(X)
+#undef X
+      INPUT_EVENT_COUNT
+} InputEventType;
+
+typedef struct {
+  InputEventType type;
+  union {
+    int key;       // raylib keycode
+    int codepoint; // INPUT_TEXT
+    struct {
+      int x, y;   // cell under the mouse, 0-based
+      int button; // raylib mouse button, unused for INPUT_MOUSE_MOVED
+    } mouse;
+  };
+} InputEvent;
+
+typedef struct {
+  InputEvent events[INPUT_QUEUE_SIZE];
+  size_t head, count;
+  size_t dropped;
+
+  bool key_repeat; // queue INPUT_KEY_REPEAT while a key is held, off by default
+
+  int mouse_x, mouse_y; // last reported mouse cell, -1 before the first
+} Input;
+
+void input_init(Input *input);
+
+// Queues everything raylib saw since the previous call, mouse positions are
+// converted to cells of cell_w x cell_h pixels
+void input_poll(Input *input, int cell_w, int cell_h);
+
+void input_push(Input *input, InputEvent event);
+bool input_pop(Input *input, InputEvent *event);
+void input_clear(Input *input);
+
+// Removes queued presses and repeats of `key`, returns whether there were
+// any. Used for engine hotkeys that games never see.
+bool input_consume_key(Input *input, int key);
+
+#endif // INPUT_H_
@@ -35,12 +35,3 @@ int string_to_keycode(const char *str) {
 
   return KEY_NULL;
 }
-
-const char *keycode_to_string(int key) {
-  for (size_t i = 0; i < sizeof(key_map) / sizeof(key_map[0]); i++) {
-    if (key_map[i].key == key)
-      return key_map[i].str;
-  }
-
-  return NULL;
-}
@@ -1,4 +1,3 @@
 #pragma once
 
 int string_to_keycode(const char *str);
-const char *keycode_to_string(int key);
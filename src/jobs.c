@@ -0,0 +1,138 @@
+#include "jobs.h"
+#include "slog.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define JOBS_MAX_WORKERS 64
+
+static struct {
+  pthread_t threads[JOBS_MAX_WORKERS];
+  int worker_count;
+
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_cond_t done;
+  unsigned long generation;
+  bool quit;
+
+  // Current batch, identified by `generation`. Chunks are coarse (about one
+  // per thread), so claiming them under the lock costs nothing measurable.
+  JobFn fn;
+  void *ctx;
+  size_t n, chunk, chunk_count;
+  size_t next_chunk, finished_chunks;
+} pool;
+
+// Claims and runs chunks of batch `generation` until none are left
+static void run_chunks(unsigned long generation) {
+  for (;;) {
+    pthread_mutex_lock(&pool.lock);
+    if (pool.generation != generation || pool.next_chunk >= pool.chunk_count) {
+      pthread_mutex_unlock(&pool.lock);
+      return;
+    }
+    size_t begin = pool.next_chunk++ * pool.chunk;
+    size_t end = begin + pool.chunk < pool.n ? begin + pool.chunk : pool.n;
+    JobFn fn = pool.fn;
+    void *ctx = pool.ctx;
+    pthread_mutex_unlock(&pool.lock);
+
+    fn(ctx, begin, end);
+
+    pthread_mutex_lock(&pool.lock);
+    if (++pool.finished_chunks == pool.chunk_count)
+      pthread_cond_signal(&pool.done);
+    pthread_mutex_unlock(&pool.lock);
+  }
+}
+
+static void *worker_main(void *arg) {
+  (void)arg;
+  unsigned long seen = 0;
+
+  for (;;) {
+    pthread_mutex_lock(&pool.lock);
+    while (!pool.quit && pool.generation == seen)
+      pthread_cond_wait(&pool.wake, &pool.lock);
+    if (pool.quit) {
+      pthread_mutex_unlock(&pool.lock);
+      return NULL;
+    }
+    seen = pool.generation;
+    pthread_mutex_unlock(&pool.lock);
+
+    run_chunks(seen);
+  }
+}
+
+void jobs_init(int workers) {
+  if (workers <= 0)
+    workers = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+  if (workers > JOBS_MAX_WORKERS)
+    workers = JOBS_MAX_WORKERS;
+
+  pthread_mutex_init(&pool.lock, NULL);
+  pthread_cond_init(&pool.wake, NULL);
+  pthread_cond_init(&pool.done, NULL);
+  pool.quit = false;
+  pool.worker_count = 0;
+
+  for (int i = 0; i < workers; i++) {
+    if (pthread_create(&pool.threads[i], NULL, worker_main, NULL) != 0) {
+      warning("Failed to start job worker %d", i);
+      break;
+    }
+    pool.worker_count++;
+  }
+
+  info("Started %d job workers", pool.worker_count);
+}
+
+void jobs_shutdown(void) {
+  pthread_mutex_lock(&pool.lock);
+  pool.quit = true;
+  pthread_cond_broadcast(&pool.wake);
+  pthread_mutex_unlock(&pool.lock);
+
+  for (int i = 0; i < pool.worker_count; i++)
+    pthread_join(pool.threads[i], NULL);
+  pool.worker_count = 0;
+}
+
+int jobs_thread_count(void) { return pool.worker_count + 1; }
+
+void jobs_parallel_for(size_t n, size_t max_tasks, JobFn fn, void *ctx) {
+  if (n == 0)
+    return;
+
+  size_t tasks = max_tasks ? max_tasks : (size_t)jobs_thread_count();
+  if (tasks > n)
+    tasks = n;
+
+  // Nothing to share, skip the wake-up round trip
+  if (tasks <= 1 || pool.worker_count == 0) {
+    fn(ctx, 0, n);
+    return;
+  }
+
+  pthread_mutex_lock(&pool.lock);
+  pool.fn = fn;
+  pool.ctx = ctx;
+  pool.n = n;
+  pool.chunk = (n + tasks - 1) / tasks;
+  pool.chunk_count = (n + pool.chunk - 1) / pool.chunk;
+  pool.next_chunk = 0;
+  pool.finished_chunks = 0;
+  unsigned long generation = ++pool.generation;
+  pthread_cond_broadcast(&pool.wake);
+  pthread_mutex_unlock(&pool.lock);
+
+  run_chunks(generation);
+
+  pthread_mutex_lock(&pool.lock);
+  while (pool.finished_chunks < pool.chunk_count)
+    pthread_cond_wait(&pool.done, &pool.lock);
+  pthread_mutex_unlock(&pool.lock);
+}
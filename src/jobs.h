@@ -0,0 +1,19 @@
+#ifndef JOBS_H_
+#define JOBS_H_
+
+#include <stddef.h>
+
+// Processes the half-open range [begin, end) of a parallel_for
+typedef void (*JobFn)(void *ctx, size_t begin, size_t end);
+
+// Starts `workers` background threads, 0 picks one per extra CPU core
+void jobs_init(int workers);
+void jobs_shutdown(void);
+int jobs_thread_count(void);
+
+// Splits [0, n) into at most `max_tasks` chunks (0 = one per thread) and
+// runs them across the pool. The calling thread helps and the call returns
+// once every chunk is done. Must only be called from the main thread.
+void jobs_parallel_for(size_t n, size_t max_tasks, JobFn fn, void *ctx);
+
+#endif // JOBS_H_
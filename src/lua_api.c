@@ -1,16 +1,37 @@
 #include "lua_api.h"
+#include "bytegrid.h"
+#include "clock.h"
 #include "colors.h"
+#include "draw.h"
 #include "grid.h"
 #include "input/keystring.h"
 #include "lauxlib.h"
 #include "lua.h"
 #include "renderer.h"
+#include "sim/fov.h"
+#include "sim/life.h"
+#include "sim/noise.h"
+#include "sim/path.h"
 #include "slog.h"
 #include <assert.h>
 #include <math.h>
 #include <raylib.h>
 #include <string.h>
 
+// Every API function is registered as a closure whose first upvalue is the
+// Engine*, so calls never go through the (rebindable) te global
+static inline Engine *lua_engine(lua_State *L) {
+  return (Engine *)lua_touserdata(L, lua_upvalueindex(1));
+}
+
+// The area te.graphics draws to: the grid, or the top of the clip stack
+static DrawClip current_clip(Engine *engine) {
+  Renderer *renderer = engine->renderer;
+  if (renderer->clip_depth == 0)
+    return draw_clip_grid(engine->grid);
+  return renderer->clips[renderer->clip_depth - 1];
+}
+
 // te.graphics.setCell(cell, x, y)
 static int l_setCell(lua_State *L) {
   int cell = luaL_checkinteger(L, 1) - 1;
@@ -21,19 +42,17 @@ static int l_setCell(lua_State *L) {
   int x = floor(_x);
   int y = floor(_y);
 
-  lua_getglobal(L, "te");
-  lua_getfield(L, -1, "__engine");
-  Engine *engine = (Engine *)lua_touserdata(L, -1);
-  lua_pop(L, 2); // pop te.__engine
+  Engine *engine = lua_engine(L);
 
-  if (cell < 0 || cell >= 256 || x < 0 || x >= (int)engine->grid->w || y < 0 ||
-      y >= (int)engine->grid->h)
+  DrawClip clip = current_clip(engine);
+  if (cell < 0 || cell >= 256 || !draw_clip_contains(&clip, x, y))
     return 0;
 
   grid_set(engine->grid, (size_t)x, (size_t)y,
            (Cell){.glyph = cell,
                   .bg = engine->renderer->bg,
-                  .fg = engine->renderer->fg});
+                  .fg = engine->renderer->fg,
+                  .flags = engine->renderer->flags});
 
   return 0;
 }
@@ -48,48 +67,313 @@ static int l_print(lua_State *L) {
   int x = floor(_x);
   int y = floor(_y);
 
-  lua_getglobal(L, "te");
-  lua_getfield(L, -1, "__engine");
-  Engine *engine = (Engine *)lua_touserdata(L, -1);
-  lua_pop(L, 2); // pop te.__engine
+  Engine *engine = lua_engine(L);
 
+  DrawClip clip = current_clip(engine);
   for (int i = 0; i < (int)strlen(text); i++) {
-    if (x + i < 0 || x + i >= (int)engine->grid->w || y < 0 ||
-        y >= (int)engine->grid->h)
-      return 0;
+    if (!draw_clip_contains(&clip, x + i, y))
+      continue;
 
     grid_set(engine->grid, x + i, y,
              (Cell){
                  .glyph = text[i],
                  .fg = engine->renderer->fg,
                  .bg = engine->renderer->bg,
+                 .flags = engine->renderer->flags,
              });
   }
 
   return 0;
 }
 
-// te.graphics.clear()
+// Returns the bytes of a string or full userdata argument
+static const unsigned char *check_buffer(lua_State *L, int arg, size_t *len) {
+  switch (lua_type(L, arg)) {
+  case LUA_TSTRING:
+    return (const unsigned char *)lua_tolstring(L, arg, len);
+  case LUA_TUSERDATA:
+    *len = lua_rawlen(L, arg);
+    return lua_touserdata(L, arg);
+  }
+
+  luaL_argerror(L, arg, "expected a string or userdata buffer");
+  return NULL;
+}
+
+static int blit_plane(lua_State *L, GridPlane plane) {
+  size_t len;
+  const unsigned char *buffer = check_buffer(L, 1, &len);
+
+  // Lua -> C index conversion
+  lua_Number x = floor(luaL_checknumber(L, 2) - 1);
+  lua_Number y = floor(luaL_checknumber(L, 3) - 1);
+  luaL_argcheck(L, fabs(x) <= DRAW_COORD_LIMIT, 2, "value out of range");
+  luaL_argcheck(L, fabs(y) <= DRAW_COORD_LIMIT, 3, "value out of range");
+
+  // Bounded like draw coordinates so x + w stays an int, and checked
+  // against the buffer by division so w * h cannot wrap
+  lua_Integer w = luaL_checkinteger(L, 4);
+  lua_Integer h = luaL_checkinteger(L, 5);
+  luaL_argcheck(L, w >= 0 && w <= DRAW_COORD_LIMIT, 4, "value out of range");
+  luaL_argcheck(L, h >= 0 && h <= DRAW_COORD_LIMIT, 5, "value out of range");
+
+  if (h > 0 && (size_t)w > len / grid_plane_stride(plane) / (size_t)h)
+    return luaL_argerror(L, 1, "buffer is smaller than w * h cells");
+
+  Engine *engine = lua_engine(L);
+
+  grid_blit(engine->grid, x, y, w, h, buffer, plane);
+
+  return 0;
+}
+
+// te.graphics.blit(buffer, x, y, w, h), 3 bytes per cell: glyph, fg, bg
+static int l_blit(lua_State *L) { return blit_plane(L, GRID_PLANE_CELLS); }
+
+// te.graphics.blitGlyphs(buffer, x, y, w, h), 1 byte per cell: glyph
+static int l_blitGlyphs(lua_State *L) {
+  return blit_plane(L, GRID_PLANE_GLYPHS);
+}
+
+// te.graphics.blitColors(buffer, x, y, w, h), 2 bytes per cell: fg, bg
+static int l_blitColors(lua_State *L) {
+  return blit_plane(L, GRID_PLANE_COLORS);
+}
+
+// te.graphics.clear(), layers above the first are cleared to transparent
 static int l_clear(lua_State *L) {
-  lua_getglobal(L, "te");
-  lua_getfield(L, -1, "__engine");
-  Engine *engine = (Engine *)lua_touserdata(L, -1);
-  lua_pop(L, 2); // pop te.__engine
+  Engine *engine = lua_engine(L);
+
+  grid_fill(engine->grid, engine->layer == 0 ? CELL_EMPTY : CELL_CLEAR);
+
+  return 0;
+}
+
+// Reads a coordinate or size for the draw_* functions, bounded by
+// DRAW_COORD_LIMIT before it is narrowed to an int
+static int check_draw_int(lua_State *L, int arg) {
+  lua_Integer value = luaL_checkinteger(L, arg);
+  luaL_argcheck(L, value >= -DRAW_COORD_LIMIT && value <= DRAW_COORD_LIMIT,
+                arg, "value out of range");
+  return value;
+}
+
+// Reads an optional glyph numbered from 1 like te.graphics.setCell's,
+// defaulting to 1 (glyph 0). Returns -1 when it is not a valid glyph, which
+// makes the drawing call do nothing, as setCell does.
+static int opt_glyph(lua_State *L, int arg) {
+  lua_Integer glyph = luaL_optinteger(L, arg, 1) - 1;
+  return glyph >= 0 && glyph < 256 ? glyph : -1;
+}
+
+// A cell of `glyph` in the current draw state
+static Cell draw_cell(Engine *engine, unsigned char glyph) {
+  return (Cell){.glyph = glyph,
+                .fg = engine->renderer->fg,
+                .bg = engine->renderer->bg,
+                .flags = engine->renderer->flags};
+}
+
+// te.graphics.scroll(x, y, w, h, dx, dy, [glyph, fg, bg]) moves the cells
+// of a region by (dx, dy), filling the cells left behind with the given
+// cell or, by default, what te.graphics.clear leaves. The glyph counts from
+// 1 like setCell's. Scrolling the whole layer vertically only writes the
+// rows brought in.
+static int l_scroll(lua_State *L) {
+  // Lua -> C index conversion
+  int x = check_draw_int(L, 1) - 1;
+  int y = check_draw_int(L, 2) - 1;
+  int w = check_draw_int(L, 3);
+  int h = check_draw_int(L, 4);
+  int dx = check_draw_int(L, 5);
+  int dy = check_draw_int(L, 6);
+  bool custom = !lua_isnoneornil(L, 7);
+  int glyph = opt_glyph(L, 7);
+  if (glyph < 0)
+    return 0;
+
+  Engine *engine = lua_engine(L);
+
+  Cell fill = engine->layer == 0 ? CELL_EMPTY : CELL_CLEAR;
+  if (custom) {
+    fill = draw_cell(engine, glyph);
+    fill.fg = luaL_optinteger(L, 8, fill.fg);
+    fill.bg = luaL_optinteger(L, 9, fill.bg);
+  }
+
+  grid_scroll(engine->grid, x, y, w, h, dx, dy, fill);
+
+  return 0;
+}
+
+// te.graphics.rect(x, y, w, h, [glyph]) fills a rectangle
+static int l_rect(lua_State *L) {
+  // Lua -> C index conversion
+  int x = check_draw_int(L, 1) - 1;
+  int y = check_draw_int(L, 2) - 1;
+  int w = check_draw_int(L, 3);
+  int h = check_draw_int(L, 4);
+  int glyph = opt_glyph(L, 5);
+  if (glyph < 0)
+    return 0;
+
+  Engine *engine = lua_engine(L);
+
+  DrawClip clip = current_clip(engine);
+  draw_rect(engine->grid, &clip, x, y, w, h, draw_cell(engine, glyph));
+
+  return 0;
+}
+
+// te.graphics.box(x, y, w, h, [border], [glyph]) draws a "single" (default)
+// or "double" line border, filling the inside with `glyph` when given
+static int l_box(lua_State *L) {
+  static const char *const borders[] = {"single", "double", NULL};
+
+  // Lua -> C index conversion
+  int x = check_draw_int(L, 1) - 1;
+  int y = check_draw_int(L, 2) - 1;
+  int w = check_draw_int(L, 3);
+  int h = check_draw_int(L, 4);
+  DrawBorder border = luaL_checkoption(L, 5, "single", borders);
+  bool fill = !lua_isnoneornil(L, 6);
+  int glyph = opt_glyph(L, 6);
+  if (glyph < 0)
+    return 0;
+
+  Engine *engine = lua_engine(L);
+
+  DrawClip clip = current_clip(engine);
+  if (fill) {
+    draw_rect(engine->grid, &clip, x + 1, y + 1, w - 2, h - 2,
+              draw_cell(engine, glyph));
+  }
+  draw_box(engine->grid, &clip, x, y, w, h, border, draw_cell(engine, 0));
+
+  return 0;
+}
+
+// te.graphics.line(x1, y1, x2, y2, [glyph])
+static int l_line(lua_State *L) {
+  // Lua -> C index conversion
+  int x1 = check_draw_int(L, 1) - 1;
+  int y1 = check_draw_int(L, 2) - 1;
+  int x2 = check_draw_int(L, 3) - 1;
+  int y2 = check_draw_int(L, 4) - 1;
+  int glyph = opt_glyph(L, 5);
+  if (glyph < 0)
+    return 0;
+
+  Engine *engine = lua_engine(L);
+
+  DrawClip clip = current_clip(engine);
+  draw_line(engine->grid, &clip, x1, y1, x2, y2, draw_cell(engine, glyph));
+
+  return 0;
+}
+
+// te.graphics.circle(x, y, radius, [glyph], [filled])
+static int l_circle(lua_State *L) {
+  // Lua -> C index conversion
+  int x = check_draw_int(L, 1) - 1;
+  int y = check_draw_int(L, 2) - 1;
+  int r = check_draw_int(L, 3);
+  int glyph = opt_glyph(L, 4);
+  bool filled = lua_toboolean(L, 5);
+  if (glyph < 0)
+    return 0;
+
+  Engine *engine = lua_engine(L);
+
+  DrawClip clip = current_clip(engine);
+  draw_circle(engine->grid, &clip, x, y, r, draw_cell(engine, glyph), filled);
+
+  return 0;
+}
+
+// count = te.graphics.fill(x, y, [glyph]) flood fills the area of cells
+// matching the one at (x, y), returns the number of cells changed
+static int l_fill(lua_State *L) {
+  // Lua -> C index conversion
+  int x = check_draw_int(L, 1) - 1;
+  int y = check_draw_int(L, 2) - 1;
+  int glyph = opt_glyph(L, 3);
+  if (glyph < 0)
+    return 0;
+
+  Engine *engine = lua_engine(L);
+
+  DrawClip clip = current_clip(engine);
+  size_t count =
+      draw_flood(engine->grid, &clip, x, y, draw_cell(engine, glyph));
+  lua_pushinteger(L, count);
+
+  return 1;
+}
+
+// te.graphics.pushClip(x, y, w, h) limits drawing to a rectangle within the
+// current clip, until the matching popClip
+static int l_pushClip(lua_State *L) {
+  // Lua -> C index conversion
+  int x = check_draw_int(L, 1) - 1;
+  int y = check_draw_int(L, 2) - 1;
+  int w = check_draw_int(L, 3);
+  int h = check_draw_int(L, 4);
+
+  Engine *engine = lua_engine(L);
+  Renderer *renderer = engine->renderer;
+
+  if (renderer->clip_depth == DRAW_CLIP_DEPTH)
+    return luaL_error(L, "clip stack overflow (%d deep)", DRAW_CLIP_DEPTH);
+
+  DrawClip clip = draw_clip_intersect(current_clip(engine),
+                                      (DrawClip){x, y, x + w, y + h});
+  renderer->clips[renderer->clip_depth++] = clip;
+
+  return 0;
+}
+
+// te.graphics.popClip()
+static int l_popClip(lua_State *L) {
+  Engine *engine = lua_engine(L);
+
+  if (engine->renderer->clip_depth == 0)
+    return luaL_error(L, "popClip without a matching pushClip");
+  engine->renderer->clip_depth--;
+
+  return 0;
+}
+
+// te.graphics.setLayer(layer) picks the layer drawn to, 1 is the bottom
+static int l_setLayer(lua_State *L) {
+  lua_Integer layer = luaL_checkinteger(L, 1);
+  luaL_argcheck(L, layer >= 1 && layer <= ENGINE_MAX_LAYERS, 1,
+                "layer out of range");
+
+  Engine *engine = lua_engine(L);
 
-  grid_fill(engine->grid, CELL_EMPTY);
+  engine->layer = layer - 1;
+  engine->grid = engine->layers[engine->layer];
 
   return 0;
 }
 
+// layer, count = te.graphics.getLayer()
+static int l_getLayer(lua_State *L) {
+  Engine *engine = lua_engine(L);
+
+  lua_pushinteger(L, engine->layer + 1);
+  lua_pushinteger(L, ENGINE_MAX_LAYERS);
+
+  return 2;
+}
+
 // te.graphics.setColor()
 static int l_setColor(lua_State *L) {
   VGA_Color fg = luaL_checkinteger(L, 1);
   VGA_Color bg = luaL_checkinteger(L, 2);
 
-  lua_getglobal(L, "te");
-  lua_getfield(L, -1, "__engine");
-  Engine *engine = (Engine *)lua_touserdata(L, -1);
-  lua_pop(L, 2); // pop te.__engine
+  Engine *engine = lua_engine(L);
 
   engine->renderer->fg = fg;
   engine->renderer->bg = bg;
@@ -97,12 +381,77 @@ static int l_setColor(lua_State *L) {
   return 0;
 }
 
+// te.graphics.setAttributes([attributes, [cycle]]) applies to the cells
+// drawn next. `attributes` combines BLINK, REVERSE, UNDERLINE and BRIGHT
+// with |, `cycle` is a palette cycle group or 0. No arguments reset both.
+static int l_setAttributes(lua_State *L) {
+  lua_Integer attributes = luaL_optinteger(L, 1, 0);
+  lua_Integer cycle = luaL_optinteger(L, 2, 0);
+  luaL_argcheck(L, (attributes & ~0x0F) == 0, 1, "unknown attribute bits");
+  luaL_argcheck(L, cycle >= 0 && cycle <= PALETTE_CYCLE_GROUPS, 2,
+                "cycle group out of range");
+
+  Engine *engine = lua_engine(L);
+
+  engine->renderer->flags = attributes | cycle << CELL_CYCLE_SHIFT;
+
+  return 0;
+}
+
+// te.graphics.setPalette(color, r, g, b) changes what a color index looks
+// like on every cell using it, te.graphics.setPalette() restores VGA
+static int l_setPalette(lua_State *L) {
+  Engine *engine = lua_engine(L);
+  Palette *palette = &engine->renderer->palette;
+
+  if (lua_isnoneornil(L, 1)) {
+    Palette vga = palette_default();
+    memcpy(palette->colors, vga.colors, sizeof palette->colors);
+    engine->renderer->palette_dirty = true;
+    return 0;
+  }
+
+  lua_Integer color = luaL_checkinteger(L, 1);
+  luaL_argcheck(L, color >= 0 && color < VGA_COLOR_COUNT, 1,
+                "color out of range");
+  for (int c = 0; c < 3; c++) {
+    lua_Integer v = luaL_checkinteger(L, 2 + c);
+    luaL_argcheck(L, v >= 0 && v <= 255, 2 + c, "component out of range");
+    palette->colors[color][c] = v;
+  }
+  engine->renderer->palette_dirty = true;
+
+  return 0;
+}
+
+// te.graphics.setCycle(group, first, count, rate) rotates the colors
+// first .. first + count - 1 of cells in `group` by `rate` steps a second.
+// A count of 0 stops the group.
+static int l_setCycle(lua_State *L) {
+  lua_Integer group = luaL_checkinteger(L, 1);
+  lua_Integer first = luaL_checkinteger(L, 2);
+  lua_Integer count = luaL_checkinteger(L, 3);
+  lua_Number rate = luaL_optnumber(L, 4, 1.0);
+  luaL_argcheck(L, group >= 1 && group <= PALETTE_CYCLE_GROUPS, 1,
+                "cycle group out of range");
+  luaL_argcheck(L, first >= 0 && first < VGA_COLOR_COUNT, 2,
+                "color out of range");
+  luaL_argcheck(L, count >= 0 && first + count <= VGA_COLOR_COUNT, 3,
+                "cycle runs past the palette");
+  luaL_argcheck(L, isfinite(rate), 4, "rate must be finite");
+
+  Engine *engine = lua_engine(L);
+
+  engine->renderer->palette.cycles[group - 1] =
+      (PaletteCycle){.first = first, .count = count, .rate = rate};
+  engine->renderer->palette_dirty = true;
+
+  return 0;
+}
+
 // w, h = te.window.getDimensions()
 static int l_getDimensions(lua_State *L) {
-  lua_getglobal(L, "te");
-  lua_getfield(L, -1, "__engine");
-  Engine *engine = (Engine *)lua_touserdata(L, -1);
-  lua_pop(L, 2); // pop te.__engine
+  Engine *engine = lua_engine(L);
 
   int w = engine->grid->w;
   int h = engine->grid->h;
@@ -122,11 +471,19 @@ static int l_getFPS(lua_State *L) {
   return 1;
 }
 
-// te.keyboard.isDown(key)
+// Registry table mapping keycodes to their interned names, used to dispatch
+// key events without creating strings
+#define KEY_NAMES_REGISTRY "te.keynames"
+
+// te.keyboard.isDown(key). Upvalue 2 maps key names to keycodes, so the
+// common case is a single lookup of an already interned string.
 static int l_isDown(lua_State *L) {
   const char *key_str = luaL_checkstring(L, 1);
 
-  int keycode = string_to_keycode(key_str);
+  lua_pushvalue(L, 1);
+  int keycode = lua_rawget(L, lua_upvalueindex(2)) == LUA_TNUMBER
+                    ? lua_tointeger(L, -1)
+                    : string_to_keycode(key_str); // e.g. "Space"
   bool pressed = false;
 
   if (keycode != KEY_NULL) {
@@ -140,14 +497,42 @@ static int l_isDown(lua_State *L) {
   return 1;
 }
 
+// te.keyboard.setKeyRepeat(enabled), held keys repeat te.keypressed with
+// isrepeat set
+static int l_setKeyRepeat(lua_State *L) {
+  Engine *engine = lua_engine(L);
+
+  engine->input.key_repeat = lua_toboolean(L, 1);
+
+  return 0;
+}
+
+// x, y = te.mouse.getPosition(), the cell under the mouse
+static int l_mouse_getPosition(lua_State *L) {
+  Engine *engine = lua_engine(L);
+
+  lua_pushinteger(L, engine->input.mouse_x + 1);
+  lua_pushinteger(L, engine->input.mouse_y + 1);
+
+  return 2;
+}
+
+// te.mouse.isDown(button), 1 = left, 2 = right, 3 = middle
+static int l_mouse_isDown(lua_State *L) {
+  lua_Integer button = luaL_checkinteger(L, 1);
+  luaL_argcheck(L, button >= 1 && button <= 3, 1, "button must be 1 to 3");
+  Engine *engine = lua_engine(L);
+
+  lua_pushboolean(L, !engine->config.headless && IsMouseButtonDown(button - 1));
+
+  return 1;
+}
+
 // te.event.quit(exit_code)
 static int l_quit(lua_State *L) {
   int exit_code = luaL_checkinteger(L, 1);
 
-  lua_getglobal(L, "te");
-  lua_getfield(L, -1, "__engine");
-  Engine *engine = (Engine *)lua_touserdata(L, -1);
-  lua_pop(L, 2); // pop te.__engine
+  Engine *engine = lua_engine(L);
 
   engine->exit_code = exit_code;
   engine->running = false;
@@ -155,6 +540,71 @@ static int l_quit(lua_State *L) {
   return 0;
 }
 
+// te.timer.setTickRate(hz), 0 switches back to one variable update per frame
+static int l_setTickRate(lua_State *L) {
+  lua_Integer hz = luaL_checkinteger(L, 1);
+  luaL_argcheck(L, hz >= 0, 1, "tick rate must not be negative");
+
+  lua_engine(L)->config.tick_rate = hz;
+
+  return 0;
+}
+
+// hz = te.timer.getTickRate()
+static int l_getTickRate(lua_State *L) {
+  lua_pushinteger(L, lua_engine(L)->config.tick_rate);
+
+  return 1;
+}
+
+// te.timer.setTargetFPS(fps), 0 renders as fast as possible
+static int l_setTargetFPS(lua_State *L) {
+  lua_Integer fps = luaL_checkinteger(L, 1);
+  luaL_argcheck(L, fps >= 0, 1, "target fps must not be negative");
+
+  lua_engine(L)->config.target_fps = fps;
+
+  return 0;
+}
+
+// seconds = te.timer.getTime(), monotonic
+static int l_getTime(lua_State *L) {
+  lua_pushnumber(L, clock_seconds());
+
+  return 1;
+}
+
+// stats = te.profiler.getStats() maps each phase to {min, avg, p99, max} in
+// milliseconds over the recent frame history
+static int l_profiler_getStats(lua_State *L) {
+  Profiler *profiler = lua_engine(L)->profiler;
+
+  lua_createtable(L, 0, PROFILER_PHASE_COUNT);
+  for (int phase = 0; phase < PROFILER_PHASE_COUNT; phase++) {
+    ProfilerStats stats = profiler_stats(profiler, phase);
+
+    lua_createtable(L, 0, 4);
+    lua_pushnumber(L, stats.min * 1e3);
+    lua_setfield(L, -2, "min");
+    lua_pushnumber(L, stats.avg * 1e3);
+    lua_setfield(L, -2, "avg");
+    lua_pushnumber(L, stats.p99 * 1e3);
+    lua_setfield(L, -2, "p99");
+    lua_pushnumber(L, stats.max * 1e3);
+    lua_setfield(L, -2, "max");
+    lua_setfield(L, -2, profiler_phase_names[phase]);
+  }
+
+  return 1;
+}
+
+// te.profiler.setOverlay(enabled), also toggled with F3
+static int l_profiler_setOverlay(lua_State *L) {
+  lua_engine(L)->profiler->overlay = lua_toboolean(L, 1);
+
+  return 0;
+}
+
 #define SLOG_LEVELS(X)                                                         \
   X(debug, DEBUG)                                                              \
   X(info, INFO)                                                                \
@@ -189,30 +639,33 @@ SLOG_LEVELS(X)
 
 typedef struct {
   bool is_stream;
+  bool is_synth;
+  bool is_silent; // no audio device (headless), every method is a no-op
   union {
-    Sound sound;
-    Music music;
+    Sound sound;           // the shared buffer, played through voices
+    Music music;           // registered with the stream thread
+    SynthChannel *channel; // a channel of the synth mixer
   } as;
-  Sound sound; // or Music for streaming
+  Resource *resource; // the shared decoded sound or encoded stream data
+  VoiceParams params; // applied to every play
 } LuaAudioSource;
 
 int l_newSource(lua_State *L) {
   const char *filename = luaL_checkstring(L, 1);
   const char *mode = luaL_checkstring(L, 2);
 
-  lua_getglobal(L, "te");
-  lua_getfield(L, -1, "__engine");
-  Engine *engine = (Engine *)lua_touserdata(L, -1);
-  lua_pop(L, 2); // pop te.__engine
-
-  filename = TextFormat("%s/%s", engine->game_path, filename);
+  Engine *engine = lua_engine(L);
   info("Loading sound: %s", filename);
 
   LuaAudioSource *src = lua_newuserdata(L, sizeof(LuaAudioSource));
   if (!src)
     return luaL_error(L, "Failed to allocate sound source");
+  *src = (LuaAudioSource){
+      .is_stream = TextIsEqual(mode, "stream"),
+      .params = VOICE_PARAMS_DEFAULT,
+  };
 
-  if (!FileExists(filename)) {
+  if (!resources_exists(engine->resources, filename)) {
     return luaL_error(L, "File not found");
   }
 
@@ -220,168 +673,1687 @@ int l_newSource(lua_State *L) {
   luaL_getmetatable(L, "TeSoundSource");
   lua_setmetatable(L, -2);
 
-  if (TextIsEqual(mode, "stream")) {
-    src->is_stream = true;
-    src->as.music = LoadMusicStream(filename);
+  src->is_silent = !engine->audio;
+  if (src->is_silent) {
+    src->is_stream = false;
+    return 1;
+  }
+
+  // Sounds play aliases of the cached buffer, streams decode their own copy
+  // of the cached file data
+  src->resource = resources_acquire(
+      engine->resources, filename,
+      src->is_stream ? RESOURCE_FILE : RESOURCE_SOUND);
+  if (!src->resource)
+    return luaL_error(L, "Failed to load sound");
+
+  if (src->is_stream) {
+    src->as.music = LoadMusicStreamFromMemory(GetFileExtension(filename),
+                                              src->resource->data,
+                                              src->resource->size);
     if (!IsMusicValid(src->as.music))
       return luaL_error(L, "Failed to load stream");
 
-    engine->streams[engine->stream_count++] = src->as.music;
-    if (engine->stream_count < ENGINE_MAX_STREAMS) {
-      engine->streams[engine->stream_count++] = src->as.music;
-    } else {
-      warning("Too many streams, ignoring additional ones");
-    }
-
+    // Userdata never moves, so the stream thread can keep a pointer
+    audio_add_stream(engine->audio, &src->as.music);
   } else {
-    src->is_stream = false;
-    src->as.sound = LoadSound(filename);
-    if (!IsSoundValid(src->as.sound))
-      return luaL_error(L, "Failed to load sound");
+    src->as.sound = src->resource->sound;
   }
 
   return 1; // userdata on top of stack
 }
 
+static LuaAudioSource *check_source(lua_State *L) {
+  return luaL_checkudata(L, 1, "TeSoundSource");
+}
+
+static float clampf(float value, float lo, float hi) {
+  return value < lo ? lo : value > hi ? hi : value;
+}
+
+// Reads an optional number argument clamped to [lo, hi]
+static float opt_clamped(lua_State *L, int arg, float def, float lo,
+                         float hi) {
+  return clampf(luaL_optnumber(L, arg, def), lo, hi);
+}
+
+// Pushes the source's parameters to whatever is playing it
+static void apply_source_params(lua_State *L, LuaAudioSource *src) {
+  Audio *audio = lua_engine(L)->audio;
+
+  if (src->is_synth) {
+    synth_set_params(audio->synth, src->as.channel, src->params.volume,
+                     src->params.pitch, src->params.pan);
+  } else if (src->is_stream) {
+    audio_lock(audio);
+    SetMusicVolume(src->as.music, src->params.volume);
+    SetMusicPitch(src->as.music, src->params.pitch);
+    SetMusicPan(src->as.music, src->params.pan);
+    audio_unlock(audio);
+  } else {
+    audio_set_params(audio, src, src->params);
+  }
+}
+
+// source:play([volume, pitch, pan]) starts a new voice, overlapping the
+// ones still playing. The arguments override the source's settings for
+// this voice only. Streams have one voice and restart instead, synths
+// restart their sequence.
 static int l_sound_play(lua_State *L) {
-  LuaAudioSource *src = luaL_checkudata(L, 1, "TeSoundSource");
+  LuaAudioSource *src = check_source(L);
+  if (src->is_silent)
+    return 0;
 
-  if (src->is_stream) {
+  Audio *audio = lua_engine(L)->audio;
+  VoiceParams params = {
+      .volume = opt_clamped(L, 2, src->params.volume, 0.0f, 1.0f),
+      .pitch = opt_clamped(L, 3, src->params.pitch, 0.01f, 100.0f),
+      .pan = opt_clamped(L, 4, src->params.pan, 0.0f, 1.0f),
+  };
+
+  if (src->is_synth) {
+    synth_set_params(audio->synth, src->as.channel, params.volume,
+                     params.pitch, params.pan);
+    synth_play(audio->synth, src->as.channel);
+  } else if (src->is_stream) {
+    audio_lock(audio);
+    SetMusicVolume(src->as.music, params.volume);
+    SetMusicPitch(src->as.music, params.pitch);
+    SetMusicPan(src->as.music, params.pan);
     PlayMusicStream(src->as.music);
-  } else {
-    PlaySound(src->as.sound);
+    audio_unlock(audio);
+  } else if (!audio_play(audio, src, src->as.sound, params)) {
+    warning("Failed to start a voice");
   }
   return 0;
 }
 
+// source:stop() stops every voice of the source
 static int l_sound_stop(lua_State *L) {
-  LuaAudioSource *src = luaL_checkudata(L, 1, "TeSoundSource");
+  LuaAudioSource *src = check_source(L);
+  if (src->is_silent)
+    return 0;
 
-  if (src->is_stream) {
+  Audio *audio = lua_engine(L)->audio;
+  if (src->is_synth) {
+    synth_stop(audio->synth, src->as.channel);
+  } else if (src->is_stream) {
+    audio_lock(audio);
     StopMusicStream(src->as.music);
+    audio_unlock(audio);
   } else {
-    StopSound(src->as.sound);
+    audio_stop(audio, src);
   }
   return 0;
 }
 
-static int l_sound_set_volume(lua_State *L) {
-  LuaAudioSource *src = luaL_checkudata(L, 1, "TeSoundSource");
-
-  float volume = luaL_checknumber(L, 2);
-  if (volume < 0.0f)
-    volume = 0.0f;
-  if (volume > 1.0f)
-    volume = 1.0f;
+// playing = source:isPlaying()
+static int l_sound_is_playing(lua_State *L) {
+  LuaAudioSource *src = check_source(L);
+  if (src->is_silent) {
+    lua_pushboolean(L, false);
+    return 1;
+  }
 
-  if (src->is_stream) {
-    SetMusicVolume(src->as.music, volume);
+  Audio *audio = lua_engine(L)->audio;
+  if (src->is_synth) {
+    lua_pushboolean(L, synth_is_playing(audio->synth, src->as.channel));
+  } else if (src->is_stream) {
+    audio_lock(audio);
+    lua_pushboolean(L, IsMusicStreamPlaying(src->as.music));
+    audio_unlock(audio);
   } else {
-    SetSoundVolume(src->as.sound, volume);
+    lua_pushboolean(L, audio_is_playing(audio, src));
   }
-
-  return 0;
+  return 1;
 }
 
+#define SOURCE_PARAMS(X)                                                       \
+  X(l_sound_set_volume, volume, 0.0f, 1.0f)                                    \
+  X(l_sound_set_pitch, pitch, 0.01f, 100.0f)                                   \
+  X(l_sound_set_pan, pan, 0.0f, 1.0f)
+
+// source:setVolume(v), setPitch(p), setPan(p) change the source's settings
+// and the voices already playing
+#define X(fn, field, lo, hi)                                                   \
+  static int fn(lua_State *L) {                                                \
+    LuaAudioSource *src = check_source(L);                                     \
+    src->params.field = clampf(luaL_checknumber(L, 2), lo, hi);                \
+    if (!src->is_silent)                                                       \
+      apply_source_params(L, src);                                             \
+    return 0;                                                                  \
+  }
+SOURCE_PARAMS(X)
+#undef X
+
 // sound garbage collector
 static int l_sound_gc(lua_State *L) {
-  LuaAudioSource *src = luaL_checkudata(L, 1, "TeSoundSource");
+  LuaAudioSource *src = check_source(L);
+  Engine *engine = lua_engine(L);
+
+  if (src->is_synth && !src->is_silent) {
+    synth_channel_free(engine->audio->synth, src->as.channel);
+    return 0;
+  }
+
+  if (src->is_silent || !src->resource)
+    return 0;
+
   if (src->is_stream) {
-    UnloadMusicStream(src->as.music);
+    if (IsMusicValid(src->as.music)) {
+      audio_remove_stream(engine->audio, &src->as.music);
+      UnloadMusicStream(src->as.music);
+    }
   } else {
-    UnloadSound(src->as.sound);
+    audio_stop(engine->audio, src); // aliases go before their buffer
   }
+  resources_release(engine->resources, src->resource);
 
   return 0;
 }
 
-void register_lua_api(Engine *engine) {
-  lua_State *L = engine->L;
+// ---- te.audio.synth ----
 
-  // ---- te table ----
-  lua_newtable(L);
+// Reads a note given as a name ("C#4") or a frequency in Hz, 0 is a rest
+static float check_note_frequency(lua_State *L, int arg) {
+  if (lua_type(L, arg) == LUA_TNUMBER)
+    return lua_tonumber(L, arg);
 
-  // te.__engine = Engine*
-  lua_pushlightuserdata(L, engine);
-  lua_setfield(L, -2, "__engine");
+  const char *name = luaL_checkstring(L, arg);
+  float freq = synth_note_frequency(name);
+  if (freq <= 0.0f)
+    return luaL_argerror(L, arg, lua_pushfstring(L, "bad note '%s'", name));
+  return freq;
+}
 
-  // ---- te.graphics ----
-  lua_newtable(L);
-  lua_pushcfunction(L, l_setCell);
-  lua_setfield(L, -2, "setCell");
-  lua_pushcfunction(L, l_print);
-  lua_setfield(L, -2, "print");
-  lua_pushcfunction(L, l_clear);
-  lua_setfield(L, -2, "clear");
-  lua_pushcfunction(L, l_setColor);
-  lua_setfield(L, -2, "setColor");
-  lua_setfield(L, -2, "graphics");
-
-  // ---- te.window ----
-  lua_newtable(L);
-  lua_pushcfunction(L, l_getDimensions);
-  lua_setfield(L, -2, "getDimensions");
-  lua_pushcfunction(L, l_getFPS);
-  lua_setfield(L, -2, "getFPS");
-  lua_setfield(L, -2, "window");
+static SynthChannel *check_synth_source(lua_State *L) {
+  LuaAudioSource *src = check_source(L);
+  luaL_argcheck(L, src->is_synth, 1, "not a synth source");
+  return src->is_silent ? NULL : src->as.channel;
+}
 
-  // ---- te.keyboard ----
-  lua_newtable(L);
-  lua_pushcfunction(L, l_isDown);
-  lua_setfield(L, -2, "isDown");
-  lua_setfield(L, -2, "keyboard");
+static float opt_field(lua_State *L, int table, const char *key, float def) {
+  lua_getfield(L, table, key);
+  float value = luaL_optnumber(L, -1, def);
+  lua_pop(L, 1);
+  return value;
+}
 
-  // ---- te.event ----
-  lua_newtable(L);
-  lua_pushcfunction(L, l_quit);
-  lua_setfield(L, -2, "quit");
-  lua_setfield(L, -2, "event");
+// source = te.audio.synth.new({wave = "square", duty = 0.5, attack = 0.01,
+// decay = 0.05, sustain = 0.7, release = 0.1}), every field optional
+static int l_synth_new(lua_State *L) {
+  SynthPatch patch = {
+      .wave = SYNTH_SQUARE,
+      .duty = 0.5f,
+      .attack = 0.005f,
+      .decay = 0.05f,
+      .sustain = 0.7f,
+      .release = 0.05f,
+  };
+
+  if (!lua_isnoneornil(L, 1)) {
+    luaL_checktype(L, 1, LUA_TTABLE);
+
+    lua_getfield(L, 1, "wave");
+    if (!lua_isnil(L, -1)) {
+      patch.wave = luaL_checkoption(L, -1, NULL, synth_wave_names);
+    }
+    lua_pop(L, 1);
 
-  // ---- te.log ----
-  lua_newtable(L);
-#define X(level, _)                                                            \
-  lua_pushcfunction(L, l_log_##level);                                         \
-  lua_setfield(L, -2, #level);
-  SLOG_LEVELS(X)
-#undef X
-  lua_setfield(L, -2, "log");
+    patch.duty = clampf(opt_field(L, 1, "duty", patch.duty), 0.0f, 1.0f);
+    patch.attack = fmaxf(0.0f, opt_field(L, 1, "attack", patch.attack));
+    patch.decay = fmaxf(0.0f, opt_field(L, 1, "decay", patch.decay));
+    patch.sustain =
+        clampf(opt_field(L, 1, "sustain", patch.sustain), 0.0f, 1.0f);
+    patch.release = fmaxf(0.0f, opt_field(L, 1, "release", patch.release));
+  }
 
-  // ---- te.audio ----
-  lua_newtable(L);
-  lua_pushcfunction(L, l_newSource);
-  lua_setfield(L, -2, "newSource");
-  lua_setfield(L, -2, "audio");
+  Engine *engine = lua_engine(L);
+  LuaAudioSource *src = lua_newuserdata(L, sizeof(LuaAudioSource));
+  *src = (LuaAudioSource){
+      .is_synth = true,
+      .is_silent = !engine->audio,
+      .params = VOICE_PARAMS_DEFAULT,
+  };
+
+  if (!src->is_silent) {
+    Synth *synth = audio_synth(engine->audio);
+    src->as.channel = synth ? synth_channel_new(synth, patch) : NULL;
+    if (!src->as.channel) {
+      return luaL_error(L, "No free synth channel (at most %d)",
+                        SYNTH_MAX_CHANNELS);
+    }
+  }
 
-  // ---- set te global ----
-  lua_setglobal(L, "te");
+  luaL_getmetatable(L, "TeSoundSource");
+  lua_setmetatable(L, -2);
 
-  // ---- SoundSource metatable ----
-  luaL_newmetatable(L, "TeSoundSource");
+  return 1;
+}
 
-  // methods
-  lua_pushcfunction(L, l_sound_play);
-  lua_setfield(L, -2, "play");
-  lua_pushcfunction(L, l_sound_stop);
-  lua_setfield(L, -2, "stop");
-  lua_pushcfunction(L, l_sound_set_volume);
-  lua_setfield(L, -2, "setVolume");
+// hz = te.audio.synth.frequency("A4")
+static int l_synth_frequency(lua_State *L) {
+  lua_pushnumber(L, check_note_frequency(L, 1));
+  return 1;
+}
 
-  // __index
-  lua_pushvalue(L, -1);
-  lua_setfield(L, -2, "__index");
+// source:note(note, duration, [volume]) plays one note now, cutting off
+// the sequence. Notes are names like "C#4" or frequencies in Hz.
+static int l_sound_note(lua_State *L) {
+  SynthChannel *channel = check_synth_source(L);
+  SynthNote note = {
+      .freq = check_note_frequency(L, 2),
+      .duration = luaL_checknumber(L, 3),
+      .volume = opt_clamped(L, 4, 1.0f, 0.0f, 1.0f),
+  };
+
+  if (channel)
+    synth_note(lua_engine(L)->audio->synth, channel, note);
+  return 0;
+}
 
-  // __gc
-  lua_pushcfunction(L, l_sound_gc);
-  lua_setfield(L, -2, "__gc");
+// source:setSequence({{"C4", 0.1}, {0, 0.05}, {"E4", 0.2, 0.5}}, [loop])
+// sets the notes play() runs through, each {note, duration, [volume]}
+static int l_sound_set_sequence(lua_State *L) {
+  SynthChannel *channel = check_synth_source(L);
+  luaL_checktype(L, 2, LUA_TTABLE);
+  bool loop = lua_toboolean(L, 3);
+
+  size_t count = lua_rawlen(L, 2);
+  luaL_argcheck(L, count <= SYNTH_MAX_STEPS, 2, "too many notes");
+
+  SynthNote steps[SYNTH_MAX_STEPS];
+  for (size_t i = 0; i < count; i++) {
+    lua_rawgeti(L, 2, i + 1);
+    luaL_argcheck(L, lua_istable(L, -1), 2, "notes are {note, duration}");
+    int step = lua_gettop(L);
+
+    lua_rawgeti(L, step, 1);
+    lua_rawgeti(L, step, 2);
+    lua_rawgeti(L, step, 3);
+    steps[i] = (SynthNote){
+        .freq = check_note_frequency(L, step + 1),
+        .duration = luaL_checknumber(L, step + 2),
+        .volume = opt_clamped(L, step + 3, 1.0f, 0.0f, 1.0f),
+    };
+    lua_settop(L, step - 1);
+  }
 
-  lua_pop(L, 1); // pop metatable
+  if (channel)
+    synth_set_sequence(lua_engine(L)->audio->synth, channel, steps, count,
+                       loop);
+  return 0;
+}
 
-  // ---- Define VGA color constants ----
-#define X(name)                                                                \
+// ---- te.resources ----
+
+// te.resources.preload({"hit.wav", {"music.ogg", "stream"}}, [callback])
+// loads in the background, entries take the modes of te.audio.newSource.
+// The callback runs once all of them are ready or failed.
+static int l_resources_preload(lua_State *L) {
+  luaL_checktype(L, 1, LUA_TTABLE);
+  if (!lua_isnoneornil(L, 2))
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+
+  // Scratch arrays owned by the stack. Only string entries are taken, as
+  // those stay alive in the table once popped; converted numbers would not.
+  size_t count = lua_rawlen(L, 1);
+  const char **paths = lua_newuserdata(L, count * sizeof(*paths) + 1);
+  ResourceKind *kinds = lua_newuserdata(L, count * sizeof(*kinds) + 1);
+
+  for (size_t i = 0; i < count; i++) {
+    kinds[i] = RESOURCE_SOUND;
+    if (lua_rawgeti(L, 1, i + 1) == LUA_TTABLE) {
+      lua_rawgeti(L, -1, 2);
+      const char *mode = luaL_optstring(L, -1, "static");
+      if (TextIsEqual(mode, "stream"))
+        kinds[i] = RESOURCE_FILE;
+      lua_pop(L, 1);
+
+      lua_rawgeti(L, -1, 1);
+      lua_replace(L, -2);
+    }
+
+    if (lua_type(L, -1) != LUA_TSTRING)
+      return luaL_argerror(L, 1, "expected paths or {path, mode} pairs");
+    paths[i] = lua_tostring(L, -1);
+    lua_pop(L, 1);
+  }
+
+  int tag = LUA_NOREF;
+  if (!lua_isnoneornil(L, 2)) {
+    lua_pushvalue(L, 2);
+    tag = luaL_ref(L, LUA_REGISTRYINDEX);
+  }
+
+  resources_preload(lua_engine(L)->resources, paths, kinds, count, tag);
+  return 0;
+}
+
+// stats = te.resources.getStats() with the resident bytes, cache hits and
+// misses, and entry counts
+static int l_resources_getStats(lua_State *L) {
+  ResourceStats stats = resources_stats(lua_engine(L)->resources);
+
+  lua_createtable(L, 0, 5);
+  lua_pushinteger(L, stats.bytes);
+  lua_setfield(L, -2, "bytes");
+  lua_pushinteger(L, stats.hits);
+  lua_setfield(L, -2, "hits");
+  lua_pushinteger(L, stats.misses);
+  lua_setfield(L, -2, "misses");
+  lua_pushinteger(L, stats.count);
+  lua_setfield(L, -2, "count");
+  lua_pushinteger(L, stats.pending);
+  lua_setfield(L, -2, "pending");
+
+  return 1;
+}
+
+// freed = te.resources.collect() unloads everything no source holds
+static int l_resources_collect(lua_State *L) {
+  lua_pushinteger(L, resources_collect(lua_engine(L)->resources));
+  return 1;
+}
+
+// te.resources.setBudget(ms) per frame for finishing preloads
+static int l_resources_setBudget(lua_State *L) {
+  double ms = luaL_checknumber(L, 1);
+  luaL_argcheck(L, ms >= 0, 1, "budget must not be negative");
+  lua_engine(L)->resources->budget = ms / 1000.0;
+
+  return 0;
+}
+
+// ---- te.grid buffers ----
+//
+// A TeGrid is an off-screen Grid owned by Lua. Cells are addressed either
+// with get/set or as buf[i] (i = (y - 1) * w + x), where a cell is packed
+// into one integer: glyph | fg << 8 | bg << 16 | flags << 24, the same
+// layout as the grid texture.
+
+typedef struct {
+  Grid *grid;
+} LuaGridBuffer;
+
+static inline lua_Integer pack_cell(Cell cell) {
+  return cell.glyph | cell.fg << 8 | cell.bg << 16 |
+         (lua_Integer)cell.flags << 24;
+}
+
+static inline Cell unpack_cell(lua_Integer packed) {
+  return (Cell){.glyph = packed & 0xFF,
+                .fg = (packed >> 8) & 0xFF,
+                .bg = (packed >> 16) & 0xFF,
+                .flags = (packed >> 24) & 0xFF};
+}
+
+static Grid *check_grid_buffer(lua_State *L, int arg) {
+  return ((LuaGridBuffer *)luaL_checkudata(L, arg, "TeGrid"))->grid;
+}
+
+// Reads a cell given as (glyph, fg, bg) starting at `arg`
+static Cell check_cell_args(lua_State *L, int arg) {
+  return (Cell){.glyph = luaL_checkinteger(L, arg),
+                .fg = luaL_checkinteger(L, arg + 1),
+                .bg = luaL_checkinteger(L, arg + 2)};
+}
+
+// Converts 1-based (x, y) arguments to a cell index, erroring when outside
+static size_t check_cell_index(lua_State *L, Grid *grid, int arg) {
+  lua_Integer x = luaL_checkinteger(L, arg) - 1;
+  lua_Integer y = luaL_checkinteger(L, arg + 1) - 1;
+  luaL_argcheck(L, x >= 0 && x < (lua_Integer)grid->w, arg, "x out of range");
+  luaL_argcheck(L, y >= 0 && y < (lua_Integer)grid->h, arg + 1,
+                "y out of range");
+  return y * grid->w + x;
+}
+
+// buf = te.grid.new(w, h, [glyph, fg, bg])
+static int l_grid_new(lua_State *L) {
+  lua_Integer w = luaL_checkinteger(L, 1);
+  lua_Integer h = luaL_checkinteger(L, 2);
+  luaL_argcheck(L, w > 0, 1, "width must be positive");
+  luaL_argcheck(L, h > 0, 2, "height must be positive");
+  if ((lua_Unsigned)w > GRID_MAX_CELLS / (lua_Unsigned)h)
+    return luaL_error(L, "grid of %I x %I cells is too large (at most %I)", w,
+                      h, (lua_Integer)GRID_MAX_CELLS);
+  Cell fill = lua_isnoneornil(L, 3) ? CELL_EMPTY : check_cell_args(L, 3);
+
+  LuaGridBuffer *buf = lua_newuserdata(L, sizeof(LuaGridBuffer));
+  buf->grid = grid_init(w, h);
+  grid_fill(buf->grid, fill);
+
+  luaL_getmetatable(L, "TeGrid");
+  lua_setmetatable(L, -2);
+
+  return 1;
+}
+
+// glyph, fg, bg = buf:get(x, y)
+static int l_grid_get(lua_State *L) {
+  Grid *grid = check_grid_buffer(L, 1);
+  Cell cell = grid->cells[check_cell_index(L, grid, 2)];
+
+  lua_pushinteger(L, cell.glyph);
+  lua_pushinteger(L, cell.fg);
+  lua_pushinteger(L, cell.bg);
+
+  return 3;
+}
+
+// buf:set(x, y, glyph, fg, bg)
+static int l_grid_set(lua_State *L) {
+  Grid *grid = check_grid_buffer(L, 1);
+  size_t i = check_cell_index(L, grid, 2);
+
+  grid->cells[i] = check_cell_args(L, 4);
+
+  return 0;
+}
+
+// buf:fill(glyph, fg, bg)
+static int l_grid_fill(lua_State *L) {
+  Grid *grid = check_grid_buffer(L, 1);
+
+  grid_fill(grid, check_cell_args(L, 2));
+
+  return 0;
+}
+
+// buf:copy(src, [x, y]) copies all of src into buf at (x, y), clipped
+static int l_grid_copy(lua_State *L) {
+  Grid *dst = check_grid_buffer(L, 1);
+  Grid *src = check_grid_buffer(L, 2);
+  int x = luaL_optinteger(L, 3, 1) - 1;
+  int y = luaL_optinteger(L, 4, 1) - 1;
+
+  grid_blit(dst, x, y, src->w, src->h, (const unsigned char *)src->cells,
+            GRID_PLANE_TEXELS);
+
+  return 0;
+}
+
+// buf:swap(other) exchanges the contents of two equally sized buffers
+static int l_grid_swap(lua_State *L) {
+  LuaGridBuffer *a = luaL_checkudata(L, 1, "TeGrid");
+  LuaGridBuffer *b = luaL_checkudata(L, 2, "TeGrid");
+  luaL_argcheck(L, a->grid->w == b->grid->w && a->grid->h == b->grid->h, 2,
+                "buffers must have the same dimensions");
+
+  Grid *tmp = a->grid;
+  a->grid = b->grid;
+  b->grid = tmp;
+
+  return 0;
+}
+
+// w, h = buf:getDimensions()
+static int l_grid_getDimensions(lua_State *L) {
+  Grid *grid = check_grid_buffer(L, 1);
+
+  lua_pushinteger(L, grid->w);
+  lua_pushinteger(L, grid->h);
+
+  return 2;
+}
+
+// buf[i] -> packed cell, other keys resolve to methods
+static int l_grid_index(lua_State *L) {
+  Grid *grid = check_grid_buffer(L, 1);
+
+  if (lua_type(L, 2) == LUA_TNUMBER) {
+    lua_Integer i = lua_tointeger(L, 2) - 1;
+    if (i < 0 || i >= (lua_Integer)(grid->w * grid->h))
+      return 0;
+
+    lua_pushinteger(L, pack_cell(grid->cells[i]));
+    return 1;
+  }
+
+  lua_getmetatable(L, 1);
+  lua_pushvalue(L, 2);
+  lua_rawget(L, -2);
+
+  return 1;
+}
+
+// buf[i] = packed cell
+static int l_grid_newindex(lua_State *L) {
+  Grid *grid = check_grid_buffer(L, 1);
+  lua_Integer i = luaL_checkinteger(L, 2) - 1;
+  luaL_argcheck(L, i >= 0 && i < (lua_Integer)(grid->w * grid->h), 2,
+                "cell index out of range");
+
+  grid->cells[i] = unpack_cell(luaL_checkinteger(L, 3));
+
+  return 0;
+}
+
+static int l_grid_len(lua_State *L) {
+  Grid *grid = check_grid_buffer(L, 1);
+
+  lua_pushinteger(L, grid->w * grid->h);
+
+  return 1;
+}
+
+static int l_grid_gc(lua_State *L) {
+  LuaGridBuffer *buf = luaL_checkudata(L, 1, "TeGrid");
+  grid_free(buf->grid);
+
+  return 0;
+}
+
+// te.graphics.present(buf) copies a buffer onto the screen at the top-left
+// corner. Only rows that differ are marked dirty.
+static int l_present(lua_State *L) {
+  Grid *src = check_grid_buffer(L, 1);
+  Engine *engine = lua_engine(L);
+
+  grid_blit(engine->grid, 0, 0, src->w, src->h,
+            (const unsigned char *)src->cells, GRID_PLANE_TEXELS);
+
+  return 0;
+}
+
+// ---- te.bytegrid buffers ----
+//
+// A TeByteGrid is a w x h array of bytes used as input and output of the
+// native kernels (te.sim, ...). buf[i] addresses byte i = (y - 1) * w + x.
+
+typedef struct {
+  ByteGrid *grid;
+} LuaByteGrid;
+
+static ByteGrid *check_bytegrid(lua_State *L, int arg) {
+  return ((LuaByteGrid *)luaL_checkudata(L, arg, "TeByteGrid"))->grid;
+}
+
+static ByteGrid *opt_bytegrid(lua_State *L, int arg) {
+  return lua_isnoneornil(L, arg) ? NULL : check_bytegrid(L, arg);
+}
+
+// Converts 1-based (x, y) arguments to a byte index, erroring when outside
+static size_t check_byte_index(lua_State *L, ByteGrid *grid, int arg) {
+  lua_Integer x = luaL_checkinteger(L, arg) - 1;
+  lua_Integer y = luaL_checkinteger(L, arg + 1) - 1;
+  luaL_argcheck(L, x >= 0 && x < (lua_Integer)grid->w, arg, "x out of range");
+  luaL_argcheck(L, y >= 0 && y < (lua_Integer)grid->h, arg + 1,
+                "y out of range");
+  return y * grid->w + x;
+}
+
+static ByteGrid *push_bytegrid(lua_State *L, size_t w, size_t h) {
+  LuaByteGrid *buf = lua_newuserdata(L, sizeof(LuaByteGrid));
+  buf->grid = bytegrid_init(w, h);
+
+  luaL_getmetatable(L, "TeByteGrid");
+  lua_setmetatable(L, -2);
+
+  return buf->grid;
+}
+
+// buf = te.bytegrid.new(w, h, [value])
+static int l_bytegrid_new(lua_State *L) {
+  lua_Integer w = luaL_checkinteger(L, 1);
+  lua_Integer h = luaL_checkinteger(L, 2);
+  luaL_argcheck(L, w > 0, 1, "width must be positive");
+  luaL_argcheck(L, h > 0, 2, "height must be positive");
+  if ((lua_Unsigned)w > GRID_MAX_CELLS / (lua_Unsigned)h)
+    return luaL_error(L, "buffer of %I x %I cells is too large (at most %I)",
+                      w, h, (lua_Integer)GRID_MAX_CELLS);
+
+  ByteGrid *grid = push_bytegrid(L, w, h);
+  bytegrid_fill(grid, luaL_optinteger(L, 3, 0));
+
+  return 1;
+}
+
+// value = buf:get(x, y)
+static int l_bytegrid_get(lua_State *L) {
+  ByteGrid *grid = check_bytegrid(L, 1);
+
+  lua_pushinteger(L, grid->data[check_byte_index(L, grid, 2)]);
+
+  return 1;
+}
+
+// buf:set(x, y, value)
+static int l_bytegrid_set(lua_State *L) {
+  ByteGrid *grid = check_bytegrid(L, 1);
+  size_t i = check_byte_index(L, grid, 2);
+
+  grid->data[i] = luaL_checkinteger(L, 4);
+
+  return 0;
+}
+
+// buf:fill(value)
+static int l_bytegrid_fill(lua_State *L) {
+  ByteGrid *grid = check_bytegrid(L, 1);
+
+  bytegrid_fill(grid, luaL_checkinteger(L, 2));
+
+  return 0;
+}
+
+// buf:swap(other) exchanges the contents of two equally sized buffers
+static int l_bytegrid_swap(lua_State *L) {
+  LuaByteGrid *a = luaL_checkudata(L, 1, "TeByteGrid");
+  LuaByteGrid *b = luaL_checkudata(L, 2, "TeByteGrid");
+  luaL_argcheck(L, a->grid->w == b->grid->w && a->grid->h == b->grid->h, 2,
+                "buffers must have the same dimensions");
+
+  ByteGrid *tmp = a->grid;
+  a->grid = b->grid;
+  b->grid = tmp;
+
+  return 0;
+}
+
+// w, h = buf:getDimensions()
+static int l_bytegrid_getDimensions(lua_State *L) {
+  ByteGrid *grid = check_bytegrid(L, 1);
+
+  lua_pushinteger(L, grid->w);
+  lua_pushinteger(L, grid->h);
+
+  return 2;
+}
+
+// buf:toString() returns the raw bytes, e.g. for te.graphics.blitGlyphs
+static int l_bytegrid_toString(lua_State *L) {
+  ByteGrid *grid = check_bytegrid(L, 1);
+
+  lua_pushlstring(L, (const char *)grid->data, grid->w * grid->h);
+
+  return 1;
+}
+
+// buf[i] -> byte, other keys resolve to methods
+static int l_bytegrid_index(lua_State *L) {
+  ByteGrid *grid = check_bytegrid(L, 1);
+
+  if (lua_type(L, 2) == LUA_TNUMBER) {
+    lua_Integer i = lua_tointeger(L, 2) - 1;
+    if (i < 0 || i >= (lua_Integer)(grid->w * grid->h))
+      return 0;
+
+    lua_pushinteger(L, grid->data[i]);
+    return 1;
+  }
+
+  lua_getmetatable(L, 1);
+  lua_pushvalue(L, 2);
+  lua_rawget(L, -2);
+
+  return 1;
+}
+
+// buf[i] = byte
+static int l_bytegrid_newindex(lua_State *L) {
+  ByteGrid *grid = check_bytegrid(L, 1);
+  lua_Integer i = luaL_checkinteger(L, 2) - 1;
+  luaL_argcheck(L, i >= 0 && i < (lua_Integer)(grid->w * grid->h), 2,
+                "index out of range");
+
+  grid->data[i] = luaL_checkinteger(L, 3);
+
+  return 0;
+}
+
+static int l_bytegrid_len(lua_State *L) {
+  ByteGrid *grid = check_bytegrid(L, 1);
+
+  lua_pushinteger(L, grid->w * grid->h);
+
+  return 1;
+}
+
+static int l_bytegrid_gc(lua_State *L) {
+  LuaByteGrid *buf = luaL_checkudata(L, 1, "TeByteGrid");
+  bytegrid_free(buf->grid);
+
+  return 0;
+}
+
+// ---- te.sim ----
+
+static void check_same_size(lua_State *L, ByteGrid *a, ByteGrid *b, int arg) {
+  if (b && (a->w != b->w || a->h != b->h))
+    luaL_argerror(L, arg, "buffers must have the same dimensions");
+}
+
+static const char *const life_edges_names[] = {"wrap", "clamp", NULL};
+
+// population = te.sim.life(src, dst, [opts])
+// opts: rule ("B3/S23"), edges ("wrap" | "clamp"), counts (TeByteGrid),
+//       threads (0 = all job threads)
+static int l_sim_life(lua_State *L) {
+  ByteGrid *src = check_bytegrid(L, 1);
+  ByteGrid *dst = check_bytegrid(L, 2);
+  luaL_argcheck(L, src != dst, 2, "src and dst must be different buffers");
+  check_same_size(L, src, dst, 2);
+
+  LifeRule rule = LIFE_RULE_CONWAY;
+  LifeEdges edges = LIFE_EDGES_WRAP;
+  ByteGrid *counts = NULL;
+  lua_Integer threads = 0;
+
+  if (!lua_isnoneornil(L, 3)) {
+    luaL_checktype(L, 3, LUA_TTABLE);
+
+    lua_getfield(L, 3, "rule");
+    const char *text = lua_tostring(L, -1);
+    if (!lua_isnil(L, -1) && (!text || !life_parse_rule(text, &rule)))
+      return luaL_error(L, "invalid life rule");
+    lua_getfield(L, 3, "edges");
+    edges = luaL_checkoption(L, -1, "wrap", life_edges_names);
+    lua_getfield(L, 3, "counts");
+    counts = opt_bytegrid(L, -1);
+    lua_getfield(L, 3, "threads");
+    threads = luaL_optinteger(L, -1, 0);
+    lua_pop(L, 4);
+
+    check_same_size(L, src, counts, 3);
+  }
+
+  size_t population = life_step(src, dst, counts, rule, edges, threads);
+  lua_pushinteger(L, population);
+
+  return 1;
+}
+
+// te.sim.neighbors(cells, counts, [edges]) fills counts with the number of
+// live neighbors of every cell
+static int l_sim_neighbors(lua_State *L) {
+  ByteGrid *cells = check_bytegrid(L, 1);
+  ByteGrid *counts = check_bytegrid(L, 2);
+  check_same_size(L, cells, counts, 2);
+  LifeEdges edges = luaL_checkoption(L, 3, "wrap", life_edges_names);
+
+  life_step(cells, NULL, counts, LIFE_RULE_CONWAY, edges, 0);
+
+  return 0;
+}
+
+// te.sim.draw(cells, counts, colors, glyph, [x, y]) draws every live cell
+// onto the screen at (x, y) as `glyph`, counted from 1 like setCell's.
+// `colors` is either one color or a table mapping neighbor counts 0-8 to
+// colors, the bg is the current draw color.
+static int l_sim_draw(lua_State *L) {
+  ByteGrid *cells = check_bytegrid(L, 1);
+  ByteGrid *counts = opt_bytegrid(L, 2);
+  check_same_size(L, cells, counts, 2);
+  luaL_checkinteger(L, 4);
+  int glyph = opt_glyph(L, 4);
+  int ox = luaL_optinteger(L, 5, 1) - 1;
+  int oy = luaL_optinteger(L, 6, 1) - 1;
+
+  Engine *engine = lua_engine(L);
+
+  unsigned char lut[9];
+  if (lua_istable(L, 3)) {
+    for (int n = 0; n <= 8; n++) {
+      lua_rawgeti(L, 3, n);
+      lut[n] = luaL_optinteger(L, -1, VGA_WHITE);
+      lua_pop(L, 1);
+    }
+  } else {
+    memset(lut, luaL_checkinteger(L, 3), sizeof lut);
+  }
+
+  if (glyph < 0)
+    return 0;
+
+  Grid *grid = engine->grid;
+  for (size_t y = 0; y < cells->h; y++) {
+    int gy = oy + (int)y;
+    if (gy < 0 || gy >= (int)grid->h)
+      continue;
+
+    const unsigned char *row = &cells->data[y * cells->w];
+    const unsigned char *count_row =
+        counts ? &counts->data[y * cells->w] : NULL;
+
+    for (size_t x = 0; x < cells->w; x++) {
+      int gx = ox + (int)x;
+      if (!row[x] || gx < 0 || gx >= (int)grid->w)
+        continue;
+
+      unsigned char n = count_row && count_row[x] <= 8 ? count_row[x] : 8;
+      grid_set(grid, gx, gy,
+               (Cell){.glyph = glyph,
+                      .fg = counts ? lut[n] : lut[0],
+                      .bg = engine->renderer->bg,
+                      .flags = engine->renderer->flags});
+    }
+  }
+
+  return 0;
+}
+
+// ---- te.fov ----
+
+// te.fov.compute(opacity, out, lights, [opts]) fills `out` with the light
+// of every {x, y, radius, [intensity]} in `lights`, as seen through
+// `opacity` (nonzero blocks sight)
+// opts: falloff ("linear" | "none"), threads (0 = all job threads)
+static int l_fov_compute(lua_State *L) {
+  static const char *const falloffs[] = {"linear", "none", NULL};
+
+  ByteGrid *opacity = check_bytegrid(L, 1);
+  ByteGrid *out = check_bytegrid(L, 2);
+  check_same_size(L, opacity, out, 2);
+  luaL_checktype(L, 3, LUA_TTABLE);
+
+  FovFalloff falloff = FOV_FALLOFF_LINEAR;
+  lua_Integer threads = 0;
+  if (!lua_isnoneornil(L, 4)) {
+    luaL_checktype(L, 4, LUA_TTABLE);
+    lua_getfield(L, 4, "falloff");
+    falloff = luaL_checkoption(L, -1, "linear", falloffs);
+    lua_getfield(L, 4, "threads");
+    threads = luaL_optinteger(L, -1, 0);
+    lua_pop(L, 2);
+    luaL_argcheck(L, threads >= 0, 4, "threads must not be negative");
+  }
+
+  size_t count = lua_rawlen(L, 3);
+  FovLight *lights = lua_newuserdatauv(L, count * sizeof(FovLight), 0);
+  for (size_t i = 0; i < count; i++) {
+    lua_rawgeti(L, 3, i + 1);
+    luaL_argcheck(L, lua_istable(L, -1), 3, "lights must be {x, y, radius}");
+    for (int k = 1; k <= 4; k++)
+      lua_rawgeti(L, -k, k);
+    lua_Integer x = luaL_checkinteger(L, -4) - 1;
+    lua_Integer y = luaL_checkinteger(L, -3) - 1;
+    lua_Integer radius = luaL_checkinteger(L, -2);
+    lua_Integer intensity = luaL_optinteger(L, -1, 255);
+    lua_pop(L, 5);
+
+    luaL_argcheck(L, radius >= 0, 3, "light radius must not be negative");
+    luaL_argcheck(L,
+                  x >= -DRAW_COORD_LIMIT && x <= DRAW_COORD_LIMIT &&
+                      y >= -DRAW_COORD_LIMIT && y <= DRAW_COORD_LIMIT &&
+                      radius <= DRAW_COORD_LIMIT,
+                  3, "light out of range");
+    lights[i] = (FovLight){
+        .x = x,
+        .y = y,
+        .radius = radius,
+        .intensity = intensity < 0 ? 0 : intensity > 255 ? 255 : intensity,
+    };
+  }
+
+  fov_compute(opacity, out, lights, count, falloff, threads);
+
+  return 0;
+}
+
+// te.fov.shade(light, [dim], [x, y]) darkens the screen under a light
+// buffer placed at (x, y): unlit cells turn black, cells lit below `dim`
+// (default 128) take darker colors
+static int l_fov_shade(lua_State *L) {
+  ByteGrid *light = check_bytegrid(L, 1);
+  lua_Integer dim = luaL_optinteger(L, 2, 128);
+  int ox = luaL_optinteger(L, 3, 1) - 1;
+  int oy = luaL_optinteger(L, 4, 1) - 1;
+  luaL_argcheck(L, dim >= 0 && dim <= 255, 2, "dim must be 0 to 255");
+
+  Engine *engine = lua_engine(L);
+
+  fov_shade(engine->grid, light, ox, oy, dim);
+
+  return 0;
+}
+
+// ---- te.path ----
+//
+// Costs are TeByteGrid buffers: 0 blocks a cell, anything else is the price
+// of stepping onto it. Distances come back in those units.
+
+static const char *const path_moves_names[] = {"cardinal", "diagonal", NULL};
+
+static PathMoves opt_path_moves(lua_State *L, int arg) {
+  return luaL_checkoption(L, arg, "cardinal", path_moves_names);
+}
+
+static void push_distance(lua_State *L, uint32_t dist) {
+  if (dist == PATH_UNREACHABLE)
+    lua_pushnil(L);
+  else
+    lua_pushnumber(L, (lua_Number)dist / PATH_CARDINAL_STEP);
+}
+
+// Reads a flat {x1, y1, x2, y2, ...} list of cells in `costs` into a
+// scratch userdata left on the stack
+static uint32_t *check_path_cells(lua_State *L, int arg, const ByteGrid *costs,
+                                  size_t *count) {
+  luaL_checktype(L, arg, LUA_TTABLE);
+  *count = lua_rawlen(L, arg) / 2;
+  uint32_t *cells = lua_newuserdatauv(L, *count * sizeof(uint32_t), 0);
+
+  for (size_t i = 0; i < *count; i++) {
+    lua_rawgeti(L, arg, 2 * i + 1);
+    lua_rawgeti(L, arg, 2 * i + 2);
+    lua_Integer x = luaL_checkinteger(L, -2) - 1;
+    lua_Integer y = luaL_checkinteger(L, -1) - 1;
+    lua_pop(L, 2);
+    if (x < 0 || x >= (lua_Integer)costs->w || y < 0 ||
+        y >= (lua_Integer)costs->h)
+      luaL_argerror(L, arg, "cell out of range");
+    cells[i] = y * costs->w + x;
+  }
+
+  return cells;
+}
+
+// path, cost = te.path.find(costs, x1, y1, x2, y2, [moves]) runs A* and
+// returns the cells from start to goal as a flat {x1, y1, x2, y2, ...}
+// list, or nil when the goal cannot be reached. Upvalue 2 is the search
+// arena, reused across calls.
+static int l_path_find(lua_State *L) {
+  ByteGrid *costs = check_bytegrid(L, 1);
+  size_t start = check_byte_index(L, costs, 2);
+  size_t goal = check_byte_index(L, costs, 4);
+  PathMoves moves = opt_path_moves(L, 6);
+  PathArena *arena = lua_touserdata(L, lua_upvalueindex(2));
+
+  uint32_t cost;
+  size_t len = path_find(arena, costs, moves, start, goal, &cost);
+  if (len == 0) {
+    lua_pushnil(L);
+    return 1;
+  }
+
+  lua_createtable(L, 2 * len, 0);
+  for (size_t i = 0; i < len; i++) {
+    lua_pushinteger(L, arena->path[i] % costs->w + 1);
+    lua_rawseti(L, -2, 2 * i + 1);
+    lua_pushinteger(L, arena->path[i] / costs->w + 1);
+    lua_rawseti(L, -2, 2 * i + 2);
+  }
+  push_distance(L, cost);
+
+  return 2;
+}
+
+static int l_path_arena_gc(lua_State *L) {
+  path_arena_free(lua_touserdata(L, 1));
+
+  return 0;
+}
+
+typedef struct {
+  PathMap *map;
+} LuaPathMap;
+
+static PathMap *check_path_map(lua_State *L, int arg) {
+  return ((LuaPathMap *)luaL_checkudata(L, arg, "TePathMap"))->map;
+}
+
+static void check_map_costs(lua_State *L, const PathMap *map,
+                            const ByteGrid *costs, int arg) {
+  if (costs->w != map->w || costs->h != map->h)
+    luaL_argerror(L, arg, "costs must have the map's dimensions");
+}
+
+// Converts 1-based (x, y) arguments to a cell index, erroring when outside
+static size_t check_map_index(lua_State *L, const PathMap *map, int arg) {
+  lua_Integer x = luaL_checkinteger(L, arg) - 1;
+  lua_Integer y = luaL_checkinteger(L, arg + 1) - 1;
+  luaL_argcheck(L, x >= 0 && x < (lua_Integer)map->w, arg, "x out of range");
+  luaL_argcheck(L, y >= 0 && y < (lua_Integer)map->h, arg + 1,
+                "y out of range");
+  return y * map->w + x;
+}
+
+// map = te.path.newMap(costs, sources, [moves]) computes the distance from
+// every cell to the nearest of the flat {x1, y1, ...} list of sources
+static int l_path_newMap(lua_State *L) {
+  ByteGrid *costs = check_bytegrid(L, 1);
+  PathMoves moves = opt_path_moves(L, 3);
+  size_t count;
+  uint32_t *sources = check_path_cells(L, 2, costs, &count);
+
+  LuaPathMap *buf = lua_newuserdata(L, sizeof(LuaPathMap));
+  buf->map = path_map_init(costs->w, costs->h, moves);
+  path_map_compute(buf->map, costs, sources, count);
+
+  luaL_getmetatable(L, "TePathMap");
+  lua_setmetatable(L, -2);
+
+  return 1;
+}
+
+// map:compute(costs, sources) starts over with new sources
+static int l_path_map_compute(lua_State *L) {
+  PathMap *map = check_path_map(L, 1);
+  ByteGrid *costs = check_bytegrid(L, 2);
+  check_map_costs(L, map, costs, 2);
+  size_t count;
+  uint32_t *sources = check_path_cells(L, 3, costs, &count);
+
+  path_map_compute(map, costs, sources, count);
+
+  return 0;
+}
+
+// changed = map:update(costs) repairs the map after some costs changed,
+// much cheaper than compute when only a few did
+static int l_path_map_update(lua_State *L) {
+  PathMap *map = check_path_map(L, 1);
+  ByteGrid *costs = check_bytegrid(L, 2);
+  check_map_costs(L, map, costs, 2);
+
+  lua_pushinteger(L, path_map_update(map, costs));
+
+  return 1;
+}
+
+// distance = map:get(x, y), nil where no source is reachable
+static int l_path_map_get(lua_State *L) {
+  PathMap *map = check_path_map(L, 1);
+
+  push_distance(L, map->dist[check_map_index(L, map, 2)]);
+
+  return 1;
+}
+
+// x, y = map:next(x, y) is one step closer to the nearest source, nil at a
+// source or where none is reachable
+static int l_path_map_next(lua_State *L) {
+  PathMap *map = check_path_map(L, 1);
+  size_t next;
+
+  if (!path_map_next(map, check_map_index(L, map, 2), &next)) {
+    lua_pushnil(L);
+    return 1;
+  }
+
+  lua_pushinteger(L, next % map->w + 1);
+  lua_pushinteger(L, next / map->w + 1);
+
+  return 2;
+}
+
+// w, h = map:getDimensions()
+static int l_path_map_getDimensions(lua_State *L) {
+  PathMap *map = check_path_map(L, 1);
+
+  lua_pushinteger(L, map->w);
+  lua_pushinteger(L, map->h);
+
+  return 2;
+}
+
+// map[i] -> distance, other keys resolve to methods
+static int l_path_map_index(lua_State *L) {
+  PathMap *map = check_path_map(L, 1);
+
+  if (lua_type(L, 2) == LUA_TNUMBER) {
+    lua_Integer i = lua_tointeger(L, 2) - 1;
+    if (i < 0 || i >= (lua_Integer)(map->w * map->h))
+      return 0;
+
+    push_distance(L, map->dist[i]);
+    return 1;
+  }
+
+  lua_getmetatable(L, 1);
+  lua_pushvalue(L, 2);
+  lua_rawget(L, -2);
+
+  return 1;
+}
+
+static int l_path_map_len(lua_State *L) {
+  PathMap *map = check_path_map(L, 1);
+
+  lua_pushinteger(L, map->w * map->h);
+
+  return 1;
+}
+
+static int l_path_map_gc(lua_State *L) {
+  LuaPathMap *buf = luaL_checkudata(L, 1, "TePathMap");
+  path_map_free(buf->map);
+
+  return 0;
+}
+
+// ---- te.noise ----
+//
+// Noise is addressed by position, not by buffer: cell (i, j) of a filled
+// region holds te.noise.sample(ox + i - 1, oy + j - 1) mapped to 0-255, so
+// buffers filled with the same seed and offsets tile seamlessly.
+
+// The permutation table of the last seed used, upvalue 2 of te.noise
+typedef struct {
+  Noise noise;
+  uint64_t seed;
+  bool ready;
+} NoiseCache;
+
+static const Noise *cached_noise(lua_State *L, uint64_t seed) {
+  NoiseCache *cache = lua_touserdata(L, lua_upvalueindex(2));
+  if (!cache->ready || cache->seed != seed) {
+    noise_init(&cache->noise, seed);
+    cache->seed = seed;
+    cache->ready = true;
+  }
+
+  return &cache->noise;
+}
+
+// opts: type ("simplex" | "value"), fractal ("none" | "fbm" | "ridged"),
+//       seed, octaves (4), frequency (0.05), lacunarity (2), gain (0.5),
+//       z (samples 3D noise at that depth, for animation)
+static NoiseParams opt_noise_params(lua_State *L, int arg) {
+  static const char *const kinds[] = {"simplex", "value", NULL};
+  static const char *const fractals[] = {"none", "fbm", "ridged", NULL};
+
+  NoiseParams params = NOISE_PARAMS_DEFAULT;
+  if (lua_isnoneornil(L, arg))
+    return params;
+  luaL_checktype(L, arg, LUA_TTABLE);
+
+  lua_getfield(L, arg, "type");
+  params.kind = luaL_checkoption(L, -1, "simplex", kinds);
+  lua_getfield(L, arg, "fractal");
+  params.fractal = luaL_checkoption(L, -1, "none", fractals);
+  lua_getfield(L, arg, "seed");
+  params.seed = luaL_optinteger(L, -1, 0);
+  lua_getfield(L, arg, "octaves");
+  lua_Integer octaves = luaL_optinteger(L, -1, params.octaves);
+  lua_getfield(L, arg, "frequency");
+  params.frequency = luaL_optnumber(L, -1, params.frequency);
+  lua_getfield(L, arg, "lacunarity");
+  params.lacunarity = luaL_optnumber(L, -1, params.lacunarity);
+  lua_getfield(L, arg, "gain");
+  params.gain = luaL_optnumber(L, -1, params.gain);
+  lua_getfield(L, arg, "z");
+  params.volume = !lua_isnil(L, -1);
+  params.z = luaL_optnumber(L, -1, 0);
+  lua_pop(L, 8);
+
+  luaL_argcheck(L, octaves >= 1 && octaves <= 16, arg,
+                "octaves must be 1 to 16");
+  params.octaves = octaves;
+
+  return params;
+}
+
+// te.noise.fill(buf, [opts]) fills a buffer with noise in one call
+// opts: the noise options, plus x, y, w, h (the region, default the whole
+//       buffer) and ox, oy (the position sampled at its corner, default 0)
+static int l_noise_fill(lua_State *L) {
+  ByteGrid *buf = check_bytegrid(L, 1);
+  NoiseParams params = opt_noise_params(L, 2);
+
+  lua_Integer x = 0, y = 0, w = buf->w, h = buf->h;
+  lua_Number ox = 0, oy = 0;
+  if (!lua_isnoneornil(L, 2)) {
+    // Checked before any arithmetic, which huge values would overflow
+    lua_getfield(L, 2, "x");
+    x = luaL_optinteger(L, -1, 1);
+    lua_getfield(L, 2, "y");
+    y = luaL_optinteger(L, -1, 1);
+    luaL_argcheck(L,
+                  x >= 1 && x <= (lua_Integer)buf->w + 1 && y >= 1 &&
+                      y <= (lua_Integer)buf->h + 1,
+                  2, "region out of range");
+    x--;
+    y--;
+
+    lua_getfield(L, 2, "w");
+    w = luaL_optinteger(L, -1, (lua_Integer)buf->w - x);
+    lua_getfield(L, 2, "h");
+    h = luaL_optinteger(L, -1, (lua_Integer)buf->h - y);
+    lua_getfield(L, 2, "ox");
+    ox = luaL_optnumber(L, -1, 0);
+    lua_getfield(L, 2, "oy");
+    oy = luaL_optnumber(L, -1, 0);
+    lua_pop(L, 6);
+  }
+  luaL_argcheck(L,
+                w >= 0 && h >= 0 && w <= (lua_Integer)buf->w - x &&
+                    h <= (lua_Integer)buf->h - y,
+                2, "region out of range");
+
+  noise_fill(cached_noise(L, params.seed), &params, buf, x, y, w, h, ox, oy);
+
+  return 0;
+}
+
+// value = te.noise.sample(x, y, [opts]), in [-1, 1]
+static int l_noise_sample(lua_State *L) {
+  lua_Number x = luaL_checknumber(L, 1);
+  lua_Number y = luaL_checknumber(L, 2);
+  NoiseParams params = opt_noise_params(L, 3);
+
+  lua_pushnumber(L, noise_sample(cached_noise(L, params.seed), &params, x, y));
+
+  return 1;
+}
+
+// te.noise.draw(buf, levels, [x, y]) draws a buffer onto the screen at
+// (x, y) through a threshold table: levels is a list of {max, glyph, fg,
+// [bg]} in increasing order of max, every cell takes the first level its
+// value is at most. Cells above the last max are left alone, as are those
+// of a level whose glyph (counted from 1 like setCell's) is not valid.
+static int l_noise_draw(lua_State *L) {
+  ByteGrid *buf = check_bytegrid(L, 1);
+  luaL_checktype(L, 2, LUA_TTABLE);
+  int ox = luaL_optinteger(L, 3, 1) - 1;
+  int oy = luaL_optinteger(L, 4, 1) - 1;
+
+  Engine *engine = lua_engine(L);
+
+  // Every byte value resolved to a cell up front
+  Cell lut[256];
+  bool drawn[256] = {0};
+  size_t count = lua_rawlen(L, 2);
+  lua_Integer from = 0;
+  for (size_t i = 0; i < count && from <= 255; i++) {
+    lua_rawgeti(L, 2, i + 1);
+    luaL_argcheck(L, lua_istable(L, -1), 2,
+                  "levels must be {max, glyph, fg, [bg]}");
+    for (int k = 1; k <= 4; k++)
+      lua_rawgeti(L, -k, k);
+    lua_Integer max = luaL_checkinteger(L, -4);
+    luaL_checkinteger(L, -3);
+    int glyph = opt_glyph(L, -3);
+    Cell cell = {
+        .glyph = glyph,
+        .fg = luaL_checkinteger(L, -2),
+        .bg = luaL_optinteger(L, -1, engine->renderer->bg),
+        .flags = engine->renderer->flags,
+    };
+    lua_pop(L, 5);
+
+    for (; from <= max && from <= 255; from++) {
+      lut[from] = cell;
+      drawn[from] = glyph >= 0;
+    }
+  }
+
+  Grid *grid = engine->grid;
+  for (size_t y = 0; y < buf->h; y++) {
+    int gy = oy + (int)y;
+    if (gy < 0 || gy >= (int)grid->h)
+      continue;
+
+    const unsigned char *row = &buf->data[y * buf->w];
+    for (size_t x = 0; x < buf->w; x++) {
+      int gx = ox + (int)x;
+      if (!drawn[row[x]] || gx < 0 || gx >= (int)grid->w)
+        continue;
+
+      grid_set(grid, gx, gy, lut[row[x]]);
+    }
+  }
+
+  return 0;
+}
+
+// rng = te.noise.newRng([seed]), a generator independent of math.random
+// whose sequence depends only on the seed
+static int l_noise_newRng(lua_State *L) {
+  lua_Integer seed = luaL_optinteger(L, 1, 0);
+
+  NoiseRng *rng = lua_newuserdatauv(L, sizeof(NoiseRng), 0);
+  noise_rng_seed(rng, seed);
+  luaL_setmetatable(L, "TeRng");
+
+  return 1;
+}
+
+// rng:random([m, [n]]), the same forms as math.random
+static int l_rng_random(lua_State *L) {
+  NoiseRng *rng = luaL_checkudata(L, 1, "TeRng");
+
+  lua_Integer lo, hi;
+  switch (lua_gettop(L)) {
+  case 1:
+    lua_pushnumber(L, noise_rng_double(rng));
+    return 1;
+  case 2:
+    lo = 1;
+    hi = luaL_checkinteger(L, 2);
+    break;
+  default:
+    lo = luaL_checkinteger(L, 2);
+    hi = luaL_checkinteger(L, 3);
+    break;
+  }
+  luaL_argcheck(L, lo <= hi, lua_gettop(L), "interval is empty");
+
+  lua_pushinteger(L, noise_rng_range(rng, lo, hi));
+
+  return 1;
+}
+
+// rng:seed(seed) restarts the sequence
+static int l_rng_seed(lua_State *L) {
+  NoiseRng *rng = luaL_checkudata(L, 1, "TeRng");
+  noise_rng_seed(rng, luaL_checkinteger(L, 2));
+
+  return 0;
+}
+
+static const luaL_Reg graphics_funcs[] = {
+    {"setCell", l_setCell},       {"print", l_print},
+    {"clear", l_clear},           {"setColor", l_setColor},
+    {"blit", l_blit},             {"blitGlyphs", l_blitGlyphs},
+    {"blitColors", l_blitColors}, {"present", l_present},
+    {"setLayer", l_setLayer},     {"getLayer", l_getLayer},
+    {"setAttributes", l_setAttributes},
+    {"setPalette", l_setPalette},
+    {"setCycle", l_setCycle},
+    {"scroll", l_scroll},
+    {"rect", l_rect},
+    {"box", l_box},
+    {"line", l_line},
+    {"circle", l_circle},
+    {"fill", l_fill},
+    {"pushClip", l_pushClip},
+    {"popClip", l_popClip},
+    {NULL, NULL},
+};
+
+static const luaL_Reg window_funcs[] = {
+    {"getDimensions", l_getDimensions},
+    {"getFPS", l_getFPS},
+    {NULL, NULL},
+};
+
+static const luaL_Reg timer_funcs[] = {
+    {"setTickRate", l_setTickRate},
+    {"getTickRate", l_getTickRate},
+    {"setTargetFPS", l_setTargetFPS},
+    {"getTime", l_getTime},
+    {NULL, NULL},
+};
+
+static const luaL_Reg profiler_funcs[] = {
+    {"getStats", l_profiler_getStats},
+    {"setOverlay", l_profiler_setOverlay},
+    {NULL, NULL},
+};
+
+static const luaL_Reg keyboard_funcs[] = {
+    {"isDown", l_isDown},
+    {"setKeyRepeat", l_setKeyRepeat},
+    {NULL, NULL},
+};
+
+static const luaL_Reg mouse_funcs[] = {
+    {"getPosition", l_mouse_getPosition},
+    {"isDown", l_mouse_isDown},
+    {NULL, NULL},
+};
+
+static const luaL_Reg event_funcs[] = {
+    {"quit", l_quit},
+    {NULL, NULL},
+};
+
+static const luaL_Reg log_funcs[] = {
+#define X(level, _) {#level, l_log_##level},
+    SLOG_LEVELS(X)
+#undef X
+    {NULL, NULL},
+};
+
+static const luaL_Reg grid_funcs[] = {
+    {"new", l_grid_new},
+    {NULL, NULL},
+};
+
+static const luaL_Reg grid_buffer_methods[] = {
+    {"get", l_grid_get},
+    {"set", l_grid_set},
+    {"fill", l_grid_fill},
+    {"copy", l_grid_copy},
+    {"swap", l_grid_swap},
+    {"getDimensions", l_grid_getDimensions},
+    {"__len", l_grid_len},
+    {"__gc", l_grid_gc},
+    {NULL, NULL},
+};
+
+static const luaL_Reg bytegrid_funcs[] = {
+    {"new", l_bytegrid_new},
+    {NULL, NULL},
+};
+
+static const luaL_Reg bytegrid_methods[] = {
+    {"get", l_bytegrid_get},
+    {"set", l_bytegrid_set},
+    {"fill", l_bytegrid_fill},
+    {"swap", l_bytegrid_swap},
+    {"getDimensions", l_bytegrid_getDimensions},
+    {"toString", l_bytegrid_toString},
+    {"__len", l_bytegrid_len},
+    {"__gc", l_bytegrid_gc},
+    {NULL, NULL},
+};
+
+static const luaL_Reg sim_funcs[] = {
+    {"life", l_sim_life},
+    {"neighbors", l_sim_neighbors},
+    {"draw", l_sim_draw},
+    {NULL, NULL},
+};
+
+static const luaL_Reg fov_funcs[] = {
+    {"compute", l_fov_compute},
+    {"shade", l_fov_shade},
+    {NULL, NULL},
+};
+
+static const luaL_Reg path_funcs[] = {
+    {"find", l_path_find},
+    {"newMap", l_path_newMap},
+    {NULL, NULL},
+};
+
+static const luaL_Reg path_map_methods[] = {
+    {"compute", l_path_map_compute},
+    {"update", l_path_map_update},
+    {"get", l_path_map_get},
+    {"next", l_path_map_next},
+    {"getDimensions", l_path_map_getDimensions},
+    {"__len", l_path_map_len},
+    {"__gc", l_path_map_gc},
+    {NULL, NULL},
+};
+
+static const luaL_Reg noise_funcs[] = {
+    {"fill", l_noise_fill},
+    {"sample", l_noise_sample},
+    {"draw", l_noise_draw},
+    {"newRng", l_noise_newRng},
+    {NULL, NULL},
+};
+
+static const luaL_Reg rng_methods[] = {
+    {"random", l_rng_random},
+    {"seed", l_rng_seed},
+    {NULL, NULL},
+};
+
+static const luaL_Reg audio_funcs[] = {
+    {"newSource", l_newSource},
+    {NULL, NULL},
+};
+
+static const luaL_Reg synth_funcs[] = {
+    {"new", l_synth_new},
+    {"frequency", l_synth_frequency},
+    {NULL, NULL},
+};
+
+static const luaL_Reg resources_funcs[] = {
+    {"preload", l_resources_preload},
+    {"getStats", l_resources_getStats},
+    {"collect", l_resources_collect},
+    {"setBudget", l_resources_setBudget},
+    {NULL, NULL},
+};
+
+static const luaL_Reg sound_source_methods[] = {
+    {"play", l_sound_play},
+    {"stop", l_sound_stop},
+    {"isPlaying", l_sound_is_playing},
+    {"setVolume", l_sound_set_volume},
+    {"setPitch", l_sound_set_pitch},
+    {"setPan", l_sound_set_pan},
+    {"note", l_sound_note},
+    {"setSequence", l_sound_set_sequence},
+    {"__gc", l_sound_gc},
+    {NULL, NULL},
+};
+
+// Sets te.<name> to a table of `funcs` closing over the engine
+static void register_module(lua_State *L, Engine *engine, const char *name,
+                            const luaL_Reg *funcs) {
+  lua_newtable(L);
+  lua_pushlightuserdata(L, engine);
+  luaL_setfuncs(L, funcs, 1);
+  lua_setfield(L, -2, name);
+}
+
+// Creates a metatable that indexes itself for method lookups
+static void register_metatable(lua_State *L, Engine *engine, const char *name,
+                               const luaL_Reg *methods) {
+  luaL_newmetatable(L, name);
+  lua_pushlightuserdata(L, engine);
+  luaL_setfuncs(L, methods, 1);
+
+  // __index
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+
+  lua_pop(L, 1); // pop metatable
+}
+
+void register_lua_api(Engine *engine) {
+  lua_State *L = engine->L;
+
+  // ---- te table ----
+  lua_newtable(L);
+
+  register_module(L, engine, "graphics", graphics_funcs);
+  register_module(L, engine, "window", window_funcs);
+  register_module(L, engine, "timer", timer_funcs);
+  register_module(L, engine, "profiler", profiler_funcs);
+  register_module(L, engine, "mouse", mouse_funcs);
+
+  // ---- te.keyboard, with the key name -> keycode table as upvalue 2 ----
+  lua_newtable(L);
+  lua_pushlightuserdata(L, engine);
+  lua_createtable(L, 0, 64);
+#define KEYDEF(key, str)                                                       \
+  lua_pushinteger(L, key);                                                     \
+  lua_setfield(L, -2, str);
+#include "input/keycodes.def"
+#undef KEYDEF
+  luaL_setfuncs(L, keyboard_funcs, 2);
+  lua_setfield(L, -2, "keyboard");
+
+  lua_createtable(L, 512, 0);
+#define KEYDEF(key, str)                                                       \
+  lua_pushstring(L, str);                                                      \
+  lua_rawseti(L, -2, key);
+#include "input/keycodes.def"
+#undef KEYDEF
+  lua_setfield(L, LUA_REGISTRYINDEX, KEY_NAMES_REGISTRY);
+  register_module(L, engine, "event", event_funcs);
+  register_module(L, engine, "log", log_funcs);
+  register_module(L, engine, "audio", audio_funcs);
+  lua_getfield(L, -1, "audio");
+  register_module(L, engine, "synth", synth_funcs);
+  lua_pop(L, 1);
+  register_module(L, engine, "resources", resources_funcs);
+  register_module(L, engine, "grid", grid_funcs);
+  register_module(L, engine, "bytegrid", bytegrid_funcs);
+  register_module(L, engine, "sim", sim_funcs);
+  register_module(L, engine, "fov", fov_funcs);
+
+  // ---- te.path, with the A* search arena as upvalue 2 ----
+  lua_newtable(L);
+  lua_pushlightuserdata(L, engine);
+  PathArena *arena = lua_newuserdatauv(L, sizeof(PathArena), 0);
+  *arena = (PathArena){0};
+  lua_createtable(L, 0, 1);
+  lua_pushcfunction(L, l_path_arena_gc);
+  lua_setfield(L, -2, "__gc");
+  lua_setmetatable(L, -2);
+  luaL_setfuncs(L, path_funcs, 2);
+  lua_setfield(L, -2, "path");
+
+  // ---- te.noise, with the permutation table cache as upvalue 2 ----
+  lua_newtable(L);
+  lua_pushlightuserdata(L, engine);
+  NoiseCache *cache = lua_newuserdatauv(L, sizeof(NoiseCache), 0);
+  cache->ready = false;
+  luaL_setfuncs(L, noise_funcs, 2);
+  lua_setfield(L, -2, "noise");
+
+  // ---- set te global ----
+  lua_setglobal(L, "te");
+
+  // ---- SoundSource metatable ----
+  register_metatable(L, engine, "TeSoundSource", sound_source_methods);
+
+  // ---- Grid buffer metatable, with integer fast paths for [] ----
+  register_metatable(L, engine, "TeGrid", grid_buffer_methods);
+  luaL_getmetatable(L, "TeGrid");
+  lua_pushcfunction(L, l_grid_index);
+  lua_setfield(L, -2, "__index");
+  lua_pushcfunction(L, l_grid_newindex);
+  lua_setfield(L, -2, "__newindex");
+  lua_pop(L, 1);
+
+  // ---- Byte grid metatable ----
+  register_metatable(L, engine, "TeByteGrid", bytegrid_methods);
+  luaL_getmetatable(L, "TeByteGrid");
+  lua_pushcfunction(L, l_bytegrid_index);
+  lua_setfield(L, -2, "__index");
+  lua_pushcfunction(L, l_bytegrid_newindex);
+  lua_setfield(L, -2, "__newindex");
+  lua_pop(L, 1);
+
+  // ---- Path map metatable ----
+  register_metatable(L, engine, "TePathMap", path_map_methods);
+  luaL_getmetatable(L, "TePathMap");
+  lua_pushcfunction(L, l_path_map_index);
+  lua_setfield(L, -2, "__index");
+  lua_pop(L, 1);
+
+  // ---- Random generator metatable ----
+  register_metatable(L, engine, "TeRng", rng_methods);
+
+  // ---- Define VGA color constants ----
+#define X(name, r, g, b)                                                       \
   lua_pushinteger(L, VGA_##name);                                              \
   lua_setglobal(L, #name);
   VGA_COLOR_LIST
 #undef X
+
+  lua_pushinteger(L, VGA_TRANSPARENT);
+  lua_setglobal(L, "TRANSPARENT");
+
+  // ---- Define cell attribute constants ----
+#define X(name, bit)                                                           \
+  lua_pushinteger(L, CELL_##name);                                             \
+  lua_setglobal(L, #name);
+  CELL_ATTRIBUTE_LIST
+#undef X
 }
 
 void call_load(lua_State *L) {
@@ -423,7 +2395,7 @@ void call_update(lua_State *L, double dt) {
   lua_pop(L, 1); // pop te table
 }
 
-void call_draw(lua_State *L) {
+void call_draw(lua_State *L, float alpha) {
   lua_getglobal(L, "te");
   lua_getfield(L, -1, "draw");
   if (!lua_isfunction(L, -1)) {
@@ -432,7 +2404,11 @@ void call_draw(lua_State *L) {
     return;
   }
 
-  if (lua_pcall(L, 0, 0, 0) != LUA_OK) {
+  // Push arguments
+  lua_pushnumber(L, alpha);
+
+  // Call with 1 arg, 0 return values
+  if (lua_pcall(L, 1, 0, 0) != LUA_OK) {
     error("failed calling te.draw: %s", lua_tostring(L, -1));
     lua_pop(L, 1);
   }
@@ -440,22 +2416,113 @@ void call_draw(lua_State *L) {
   lua_pop(L, 1); // pop te table
 }
 
-void call_keypressed(lua_State *L, const char *key) {
-  lua_getglobal(L, "te");
-  lua_getfield(L, -1, "keypressed");
-  if (!lua_isfunction(L, -1)) {
-    lua_pop(L, 2);
+void call_preloaded(lua_State *L, int tag) {
+  if (tag == LUA_NOREF)
     return;
+
+  lua_rawgeti(L, LUA_REGISTRYINDEX, tag);
+  luaL_unref(L, LUA_REGISTRYINDEX, tag);
+
+  if (lua_pcall(L, 0, 0, 0) != LUA_OK) {
+    error("failed calling a preload callback: %s", lua_tostring(L, -1));
+    lua_pop(L, 1);
   }
+}
 
-  // Push arguments
-  lua_pushstring(L, key);
+static const char *input_callbacks[INPUT_EVENT_COUNT] = {
+#define X(name, callback) callback,
+    INPUT_EVENTS(X)
+#undef X
+};
+
+// Pushes the te callback arguments of `event`, returns how many or -1 when
+// the event has no Lua representation
+static int push_event_args(lua_State *L, const InputEvent *event,
+                           int key_names) {
+  switch (event->type) {
+  case INPUT_KEY_PRESSED:
+  case INPUT_KEY_REPEAT:
+  case INPUT_KEY_RELEASED:
+    if (lua_rawgeti(L, key_names, event->key) == LUA_TNIL) {
+      lua_pop(L, 1);
+      return -1;
+    }
+    if (event->type == INPUT_KEY_RELEASED)
+      return 1;
+    lua_pushboolean(L, event->type == INPUT_KEY_REPEAT);
+    return 2;
+
+  case INPUT_TEXT: {
+    int size;
+    const char *utf8 = CodepointToUTF8(event->codepoint, &size);
+    lua_pushlstring(L, utf8, size);
+    return 1;
+  }
 
-  // Call with 1 arg, 0 return values
+  // Lua -> C index conversion, in reverse
+  case INPUT_MOUSE_MOVED:
+    lua_pushinteger(L, event->mouse.x + 1);
+    lua_pushinteger(L, event->mouse.y + 1);
+    return 2;
+
+  case INPUT_MOUSE_PRESSED:
+  case INPUT_MOUSE_RELEASED:
+    lua_pushinteger(L, event->mouse.x + 1);
+    lua_pushinteger(L, event->mouse.y + 1);
+    lua_pushinteger(L, event->mouse.button + 1);
+    return 3;
+
+  case INPUT_EVENT_COUNT:
+    break;
+  }
+
+  return -1;
+}
+
+// Drains the input queue into the te callbacks. Runs inside one protected
+// call per frame.
+static int l_dispatch_input(lua_State *L) {
+  Input *input = lua_touserdata(L, 1);
+
+  lua_getfield(L, LUA_REGISTRYINDEX, KEY_NAMES_REGISTRY);
+  int key_names = lua_gettop(L);
+
+  // Look each callback up once per batch
+  lua_getglobal(L, "te");
+  int callbacks = lua_gettop(L);
+  for (int i = 0; i < INPUT_EVENT_COUNT; i++)
+    lua_getfield(L, callbacks, input_callbacks[i]);
+
+  InputEvent event;
+  while (input_pop(input, &event)) {
+    int callback = callbacks + 1 + event.type;
+    if (!lua_isfunction(L, callback))
+      continue;
+
+    lua_pushvalue(L, callback);
+    int nargs = push_event_args(L, &event, key_names);
+    if (nargs < 0) {
+      lua_pop(L, 1);
+      continue;
+    }
+
+    lua_call(L, nargs, 0);
+  }
+
+  return 0;
+}
+
+void call_input(lua_State *L, Input *input) {
+  if (input->count == 0)
+    return;
+
+  lua_pushcfunction(L, l_dispatch_input);
+  lua_pushlightuserdata(L, input);
+
+  // An error drops the rest of this frame's events
   if (lua_pcall(L, 1, 0, 0) != LUA_OK) {
-    error("failed calling te.keypressed: %s", lua_tostring(L, -1));
+    error("failed dispatching input: %s", lua_tostring(L, -1));
     lua_pop(L, 1);
+    input_clear(input);
   }
-
-  lua_pop(L, 1); // pop te table
 }
@@ -7,7 +7,11 @@
 void register_lua_api(Engine *engine);
 void call_load(lua_State *L);
 void call_update(lua_State *L, double dt);
-void call_draw(lua_State *L);
-void call_keypressed(lua_State *L, const char *key);
+void call_draw(lua_State *L, float alpha);
+void call_input(lua_State *L, Input *input);
+
+// Runs the callback of a finished te.resources.preload, `tag` is the
+// registry reference it was made with
+void call_preloaded(lua_State *L, int tag);
 
 #endif // LUA_API_H_
@@ -0,0 +1,276 @@
+#include "lua_profiler.h"
+#include "clock.h"
+#include "slog.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LUA_PROFILER_MAX_DEPTH 64
+
+// A distinct function, identified by where it is defined and what it was
+// called as
+typedef struct {
+  uint64_t hash;
+  char *label;
+} ProfileFrame;
+
+// A distinct call stack, root first, with the time charged to it
+typedef struct {
+  uint64_t hash;
+  int depth;
+  int *frames;
+  double seconds;
+} ProfileStack;
+
+// Open addressing table mapping hashes to indices into an entry array
+typedef struct {
+  uint64_t *hashes;
+  int *indices; // -1 marks an empty slot
+  size_t capacity;
+} HashIndex;
+
+struct LuaProfiler {
+  lua_State *L;
+  double last_sample;
+
+  ProfileFrame *frames;
+  size_t frame_count, frame_capacity;
+  HashIndex frame_index;
+
+  ProfileStack *stacks;
+  size_t stack_count, stack_capacity;
+  HashIndex stack_index;
+};
+
+// The hook has no user data, and there is one Lua state per engine
+static LuaProfiler *active_profiler = NULL;
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t len) {
+  const unsigned char *bytes = data;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+
+static void index_init(HashIndex *index, size_t capacity) {
+  index->capacity = capacity;
+  index->hashes = calloc(capacity, sizeof(uint64_t));
+  index->indices = malloc(capacity * sizeof(int));
+  assert(index->hashes && index->indices);
+  memset(index->indices, 0xFF, capacity * sizeof(int));
+}
+
+static void index_free(HashIndex *index) {
+  free(index->hashes);
+  free(index->indices);
+}
+
+// Returns the slot holding `hash` or the empty slot where it belongs
+static size_t index_slot(const HashIndex *index, uint64_t hash) {
+  size_t slot = hash & (index->capacity - 1);
+  while (index->indices[slot] != -1 && index->hashes[slot] != hash)
+    slot = (slot + 1) & (index->capacity - 1);
+  return slot;
+}
+
+static void index_insert(HashIndex *index, uint64_t hash, int value,
+                         size_t count) {
+  // Keep the load factor under 1/2, rehashing into twice the space
+  if ((count + 1) * 2 > index->capacity) {
+    HashIndex grown;
+    index_init(&grown, index->capacity * 2);
+    for (size_t i = 0; i < index->capacity; i++) {
+      if (index->indices[i] != -1) {
+        size_t slot = index_slot(&grown, index->hashes[i]);
+        grown.hashes[slot] = index->hashes[i];
+        grown.indices[slot] = index->indices[i];
+      }
+    }
+    index_free(index);
+    *index = grown;
+  }
+
+  size_t slot = index_slot(index, hash);
+  index->hashes[slot] = hash;
+  index->indices[slot] = value;
+}
+
+static int intern_frame(LuaProfiler *profiler, lua_Debug *ar) {
+  const char *name = ar->name;
+  if (!name)
+    name = strcmp(ar->what, "main") == 0 ? "main chunk" : "?";
+
+  uint64_t hash = fnv1a(FNV_OFFSET, ar->source, strlen(ar->source));
+  hash = fnv1a(hash, &ar->linedefined, sizeof ar->linedefined);
+  hash = fnv1a(hash, name, strlen(name));
+
+  size_t slot = index_slot(&profiler->frame_index, hash);
+  if (profiler->frame_index.indices[slot] != -1)
+    return profiler->frame_index.indices[slot];
+
+  if (profiler->frame_count == profiler->frame_capacity) {
+    profiler->frame_capacity *= 2;
+    profiler->frames = realloc(profiler->frames, profiler->frame_capacity *
+                                                     sizeof(ProfileFrame));
+    assert(profiler->frames);
+  }
+
+  // Collapsed stacks separate frames with ';', the weight follows the last
+  // space so spaces inside a label are fine
+  char label[256];
+  if (ar->linedefined >= 0) {
+    snprintf(label, sizeof label, "%s (%s:%d)", name, ar->short_src,
+             ar->linedefined);
+  } else {
+    snprintf(label, sizeof label, "%s [C]", name);
+  }
+  for (char *c = label; *c; c++) {
+    if (*c == ';')
+      *c = ',';
+  }
+
+  int id = profiler->frame_count++;
+  profiler->frames[id] = (ProfileFrame){.hash = hash, .label = strdup(label)};
+  index_insert(&profiler->frame_index, hash, id, id);
+
+  return id;
+}
+
+static void charge_stack(LuaProfiler *profiler, const int *frames, int depth,
+                         double seconds) {
+  uint64_t hash = fnv1a(FNV_OFFSET, frames, depth * sizeof(int));
+
+  size_t slot = index_slot(&profiler->stack_index, hash);
+  int id = profiler->stack_index.indices[slot];
+
+  if (id == -1) {
+    if (profiler->stack_count == profiler->stack_capacity) {
+      profiler->stack_capacity *= 2;
+      profiler->stacks = realloc(profiler->stacks, profiler->stack_capacity *
+                                                       sizeof(ProfileStack));
+      assert(profiler->stacks);
+    }
+
+    id = profiler->stack_count++;
+    profiler->stacks[id] = (ProfileStack){
+        .hash = hash,
+        .depth = depth,
+        .frames = malloc(depth * sizeof(int)),
+    };
+    assert(profiler->stacks[id].frames);
+    memcpy(profiler->stacks[id].frames, frames, depth * sizeof(int));
+    index_insert(&profiler->stack_index, hash, id, id);
+  }
+
+  profiler->stacks[id].seconds += seconds;
+}
+
+static void sample_hook(lua_State *L, lua_Debug *hook_ar) {
+  (void)hook_ar;
+  LuaProfiler *profiler = active_profiler;
+  if (!profiler)
+    return;
+
+  double now = clock_seconds();
+  double elapsed = now - profiler->last_sample;
+  profiler->last_sample = now;
+
+  // Walk from the running function towards the root, then store root first
+  int leaf_first[LUA_PROFILER_MAX_DEPTH];
+  int depth = 0;
+  lua_Debug ar;
+
+  while (depth < LUA_PROFILER_MAX_DEPTH && lua_getstack(L, depth, &ar)) {
+    lua_getinfo(L, "Sn", &ar);
+    leaf_first[depth++] = intern_frame(profiler, &ar);
+  }
+
+  if (depth == 0)
+    return;
+
+  int root_first[LUA_PROFILER_MAX_DEPTH];
+  for (int i = 0; i < depth; i++)
+    root_first[i] = leaf_first[depth - 1 - i];
+
+  charge_stack(profiler, root_first, depth, elapsed);
+}
+
+LuaProfiler *lua_profiler_start(lua_State *L) {
+  assert(!active_profiler && "only one Lua profiler can run at a time");
+
+  LuaProfiler *profiler = calloc(1, sizeof(LuaProfiler));
+  assert(profiler);
+
+  profiler->L = L;
+  profiler->last_sample = clock_seconds();
+
+  profiler->frame_capacity = 256;
+  profiler->frames = malloc(profiler->frame_capacity * sizeof(ProfileFrame));
+  profiler->stack_capacity = 1024;
+  profiler->stacks = malloc(profiler->stack_capacity * sizeof(ProfileStack));
+  assert(profiler->frames && profiler->stacks);
+  index_init(&profiler->frame_index, 512);
+  index_init(&profiler->stack_index, 2048);
+
+  active_profiler = profiler;
+  lua_sethook(L, sample_hook, LUA_MASKCOUNT, LUA_PROFILER_INTERVAL);
+  info("Lua sampling profiler started");
+
+  return profiler;
+}
+
+void lua_profiler_resume(LuaProfiler *profiler) {
+  if (profiler)
+    profiler->last_sample = clock_seconds();
+}
+
+bool lua_profiler_write(const LuaProfiler *profiler, const char *path) {
+  FILE *f = fopen(path, "w");
+  if (!f) {
+    error("Failed to open %s for the Lua profile", path);
+    return false;
+  }
+
+  for (size_t i = 0; i < profiler->stack_count; i++) {
+    const ProfileStack *stack = &profiler->stacks[i];
+    long micros = (long)(stack->seconds * 1e6);
+    if (micros <= 0)
+      continue;
+
+    for (int d = 0; d < stack->depth; d++) {
+      const ProfileFrame *frame = &profiler->frames[stack->frames[d]];
+      fprintf(f, "%s%s", d ? ";" : "", frame->label);
+    }
+    fprintf(f, " %ld\n", micros);
+  }
+
+  fclose(f);
+  info("Wrote Lua profile (%zu stacks) to %s", profiler->stack_count, path);
+
+  return true;
+}
+
+void lua_profiler_stop(LuaProfiler *profiler) {
+  if (!profiler)
+    return;
+
+  if (profiler->L)
+    lua_sethook(profiler->L, NULL, 0, 0);
+  active_profiler = NULL;
+
+  for (size_t i = 0; i < profiler->frame_count; i++)
+    free(profiler->frames[i].label);
+  for (size_t i = 0; i < profiler->stack_count; i++)
+    free(profiler->stacks[i].frames);
+  free(profiler->frames);
+  free(profiler->stacks);
+  index_free(&profiler->frame_index);
+  index_free(&profiler->stack_index);
+  free(profiler);
+}
@@ -0,0 +1,25 @@
+#ifndef LUA_PROFILER_H_
+#define LUA_PROFILER_H_
+
+#include "lua.h"
+#include <stdbool.h>
+
+// Sampling profiler for game scripts. A count hook fires every
+// LUA_PROFILER_INTERVAL VM instructions and charges the time since the
+// previous sample to the current Lua call stack.
+#define LUA_PROFILER_INTERVAL 1000
+
+typedef struct LuaProfiler LuaProfiler;
+
+LuaProfiler *lua_profiler_start(lua_State *L);
+void lua_profiler_stop(LuaProfiler *profiler);
+
+// Call before handing control to Lua so time spent in the engine between
+// callbacks is not charged to the next sample
+void lua_profiler_resume(LuaProfiler *profiler);
+
+// Writes collapsed stacks ("root;caller;callee <microseconds>" per line)
+// as consumed by flamegraph.pl, inferno and speedscope
+bool lua_profiler_write(const LuaProfiler *profiler, const char *path);
+
+#endif // LUA_PROFILER_H_
@@ -1,6 +1,10 @@
 #define SLOG_IMPLEMENTATION
 #include "slog.h"
 
+#include "bench.h"
+#include "bundle.h"
+#include "chunk_cache.h"
+#include "clock.h"
 #include "engine.h"
 #include "globals.h"
 #include "raylib.h"
@@ -9,17 +13,144 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#ifdef TE_EMBEDDED_BUNDLE
+#include "generated/embedded_bundle.h"
+#endif
 
 static void usage(const char *prog_name) {
   printf("Usage:\n"
-         "    %s run  path/to/game\n"
-         "    %s init new/game/path\n",
-         prog_name, prog_name);
+         "    %s run  [options] path/to/game[.te]\n"
+         "    %s init new/game/path\n"
+         "    %s compile path/to/game\n"
+         "    %s pack path/to/game [out.te]\n"
+         "    %s bench [api|upload] [iterations]\n"
+         "\n"
+         "Run options:\n"
+         "    --headless        render on the CPU without a window or audio\n"
+         "    --size COLSxROWS  grid size in headless mode (default 80x25)\n"
+         "    --frames N        exit after N frames\n"
+         "    --dump PATH       write headless frames to PATH (.png, .ppm or\n"
+         "                      raw RGB24), %%d becomes the frame number\n"
+         "    --tick-rate HZ    run te.update at a fixed rate (default: once\n"
+         "                      per frame with a variable dt)\n"
+         "    --max-ticks N     cap catch-up updates per frame (default 5)\n"
+         "    --fps N           limit the frame rate\n"
+         "    --vsync           sync frames to the display refresh\n"
+         "    --scale N         draw the grid at its native resolution and\n"
+         "                      upscale it N times (default 1)\n"
+         "    --wait MODE       how to wait for the next frame: sleep\n"
+         "                      (default), yield or spin\n"
+         "    --frame-stats PATH\n"
+         "                      write per-phase frame timings at exit (.json,\n"
+         "                      otherwise CSV), F3 shows them live\n"
+         "    --audio-buffer FRAMES\n"
+         "                      music stream buffer size, smaller cuts\n"
+         "                      latency, larger rides out stalls\n"
+         "    --profile         sample Lua call stacks, written at exit and\n"
+         "                      on F4 as collapsed stacks for flamegraphs\n"
+         "    --profile-out PATH\n"
+         "                      where --profile writes (default\n"
+         "                      te-profile.folded)\n",
+         prog_name, prog_name, prog_name, prog_name, prog_name);
+}
+
+// Parses `run` options into `config`, returns false on a malformed command
+// line
+static bool parse_run_args(int argc, char *argv[], EngineConfig *config) {
+  for (int i = 0; i < argc; i++) {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+
+    if (strcmp(arg, "--headless") == 0) {
+      config->headless = true;
+    } else if (strcmp(arg, "--size") == 0 && value) {
+      if (sscanf(value, "%zux%zu", &config->cols, &config->rows) != 2 ||
+          config->cols == 0 || config->rows == 0) {
+        error("Invalid --size '%s', expected COLSxROWS", value);
+        return false;
+      }
+      i++;
+    } else if (strcmp(arg, "--frames") == 0 && value) {
+      config->max_frames = strtol(value, NULL, 10);
+      i++;
+    } else if (strcmp(arg, "--dump") == 0 && value) {
+      config->frame_out = value;
+      i++;
+    } else if (strcmp(arg, "--tick-rate") == 0 && value) {
+      config->tick_rate = atoi(value);
+      i++;
+    } else if (strcmp(arg, "--max-ticks") == 0 && value) {
+      config->max_ticks = atoi(value);
+      i++;
+    } else if (strcmp(arg, "--fps") == 0 && value) {
+      config->target_fps = atoi(value);
+      i++;
+    } else if (strcmp(arg, "--frame-stats") == 0 && value) {
+      config->frame_stats_out = value;
+      i++;
+    } else if (strcmp(arg, "--audio-buffer") == 0 && value) {
+      config->audio_buffer_frames = atoi(value);
+      i++;
+    } else if (strcmp(arg, "--profile") == 0) {
+      config->lua_profile = true;
+    } else if (strcmp(arg, "--profile-out") == 0 && value) {
+      config->lua_profile = true;
+      config->lua_profile_out = value;
+      i++;
+    } else if (strcmp(arg, "--scale") == 0 && value) {
+      config->scale = atoi(value);
+      if (config->scale < 1) {
+        error("Invalid --scale '%s', expected a whole number from 1", value);
+        return false;
+      }
+      i++;
+    } else if (strcmp(arg, "--vsync") == 0) {
+      config->vsync = true;
+    } else if (strcmp(arg, "--wait") == 0 && value) {
+      if (strcmp(value, "sleep") == 0) {
+        config->wait = CLOCK_WAIT_SLEEP;
+      } else if (strcmp(value, "yield") == 0) {
+        config->wait = CLOCK_WAIT_YIELD;
+      } else if (strcmp(value, "spin") == 0) {
+        config->wait = CLOCK_WAIT_SPIN;
+      } else {
+        error("Invalid --wait '%s', expected sleep, yield or spin", value);
+        return false;
+      }
+      i++;
+    } else if (arg[0] == '-') {
+      error("Unknown or incomplete option '%s'", arg);
+      return false;
+    } else if (!config->game_path) {
+      config->game_path = arg;
+    } else {
+      error("Unexpected argument '%s'", arg);
+      return false;
+    }
+  }
+
+  if (!config->game_path) {
+    error("No game path was provided!");
+    return false;
+  }
+
+  if (config->frame_out && !config->headless) {
+    warning("--dump only applies to --headless runs, ignoring it");
+  }
+
+  return true;
 }
 
 static bool verify_game_path(const char *game_path) {
+  // Bundles are checked when the engine maps them
+  if (IsFileExtension(game_path, BUNDLE_EXTENSION) && FileExists(game_path))
+    return true;
+
   if (!DirectoryExists(game_path)) {
-    error("Game path should be a directory!");
+    error("Game path should be a directory or a %s bundle!",
+          BUNDLE_EXTENSION);
     return false;
   }
 
@@ -31,6 +162,42 @@ static bool verify_game_path(const char *game_path) {
   return true;
 }
 
+// te compile: prebuilds the bytecode cache of every Lua file in a game
+static int compile_game(const char *game_path) {
+  if (!verify_game_path(game_path))
+    return EXIT_FAILURE;
+
+  double start = clock_seconds();
+  ChunkCache *cache = chunk_cache_init(game_path);
+  size_t built;
+  size_t failed = chunk_cache_build_all(cache, &built);
+  chunk_cache_free(cache);
+
+  info("Compiled %zu Lua files into %s/%s in %.1f ms", built, game_path,
+       CHUNK_CACHE_DIR, (clock_seconds() - start) * 1000.0);
+
+  return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// te pack: writes a game directory into a single bundle, by default next to
+// it as path/to/game.te
+static int pack_game(const char *game_path, const char *out_path) {
+  if (!verify_game_path(game_path) || !DirectoryExists(game_path))
+    return EXIT_FAILURE;
+
+  char default_out[4096];
+  if (!out_path) {
+    size_t len = strlen(game_path);
+    while (len > 1 && game_path[len - 1] == '/')
+      len--;
+    snprintf(default_out, sizeof default_out, "%.*s%s", (int)len, game_path,
+             BUNDLE_EXTENSION);
+    out_path = default_out;
+  }
+
+  return bundle_write(game_path, out_path) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
 static void slog_engine_handler(Slog_Record *record) {
   Engine *engine = record->ctx;
 
@@ -87,19 +254,64 @@ int main(int argc, char *argv[]) {
   Engine *engine;
   slog_set_handler(slog_engine_handler, .ctx = engine);
 
-  if (argc != 2) {
+  EngineConfig config = {
+      .cols = 80,
+      .rows = 25,
+      .max_ticks = 5,
+      .wait = CLOCK_WAIT_SLEEP,
+      .lua_profile_out = "te-profile.folded",
+  };
+
+#ifdef TE_EMBEDDED_BUNDLE
+  // Started without arguments, a binary with a linked-in bundle runs it
+  if (argc < 2) {
+    config.game_path = prog_name;
+    config.bundle_data = embedded_bundle;
+    config.bundle_size = sizeof embedded_bundle;
+  }
+#endif
+
+  if (argc < 2 && !config.bundle_data) {
     error("An incorrect number of arguments was provided!");
     usage(prog_name);
     return EXIT_FAILURE;
   }
 
-  const char *game_path = argv[1];
+  if (config.bundle_data) {
+    // The linked-in bundle runs, there are no arguments to parse
+  } else if (strcmp(argv[1], "bench") == 0) {
+    return bench_main(argc - 2, argv + 2);
+  } else if (strcmp(argv[1], "compile") == 0) {
+    if (argc != 3) {
+      usage(prog_name);
+      return EXIT_FAILURE;
+    }
+    return compile_game(argv[2]);
+  } else if (strcmp(argv[1], "pack") == 0) {
+    if (argc != 3 && argc != 4) {
+      usage(prog_name);
+      return EXIT_FAILURE;
+    }
+    return pack_game(argv[2], argc == 4 ? argv[3] : NULL);
+  } else if (strcmp(argv[1], "run") == 0) {
+    if (!parse_run_args(argc - 2, argv + 2, &config)) {
+      usage(prog_name);
+      return EXIT_FAILURE;
+    }
+  } else if (argc == 2) {
+    // `te path/to/game` is shorthand for `te run path/to/game`
+    config.game_path = argv[1];
+  } else {
+    error("Unknown command '%s'", argv[1]);
+    usage(prog_name);
+    return EXIT_FAILURE;
+  }
 
-  if (!verify_game_path(game_path)) {
+  if (!config.bundle_data && !verify_game_path(config.game_path)) {
     return EXIT_FAILURE;
   }
 
-  engine = engine_init(game_path);
+  engine = engine_init(config);
   int exit_code = engine_run(engine);
   engine_free(engine);
 
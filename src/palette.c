@@ -0,0 +1,65 @@
+#include "palette.h"
+#include <math.h>
+
+Palette palette_default(void) {
+  return (Palette){
+      .colors =
+          {
+#define X(name, r, g, b) {r, g, b},
+              VGA_COLOR_LIST
+#undef X
+          },
+  };
+}
+
+bool palette_blink_on(double time) {
+  return (long)floor(time * PALETTE_BLINK_HZ * 2.0) % 2 == 0;
+}
+
+int palette_cycle_step(const PaletteCycle *cycle, double time) {
+  if (cycle->count <= 0)
+    return 0;
+
+  // Reduced with fmod, as fast rates over long runs overflow a long
+  double step = fmod(floor(time * cycle->rate), cycle->count);
+  if (!isfinite(step))
+    return 0;
+  return step < 0 ? (int)step + cycle->count : (int)step;
+}
+
+static unsigned char cycle_color(const PaletteCycle *cycle, int step,
+                                 unsigned char color) {
+  if (color < cycle->first || color >= cycle->first + cycle->count)
+    return color;
+  return cycle->first + (color - cycle->first + step) % cycle->count;
+}
+
+CellLook palette_resolve(const Palette *palette, Cell cell, double time) {
+  CellLook look = {
+      .fg = cell.fg,
+      .bg = cell.bg,
+      .glyph = !(cell.flags & CELL_BLINK) || palette_blink_on(time),
+      .underline = cell.flags & CELL_UNDERLINE,
+  };
+
+  int group = (cell.flags & CELL_CYCLE_MASK) >> CELL_CYCLE_SHIFT;
+  if (group > 0) {
+    const PaletteCycle *cycle = &palette->cycles[group - 1];
+    int step = palette_cycle_step(cycle, time);
+    if (look.fg != VGA_TRANSPARENT)
+      look.fg = cycle_color(cycle, step, look.fg);
+    if (look.bg != VGA_TRANSPARENT)
+      look.bg = cycle_color(cycle, step, look.bg);
+  }
+
+  if (cell.flags & CELL_BRIGHT && look.fg != VGA_TRANSPARENT)
+    look.fg |= 8;
+
+  if (cell.flags & CELL_REVERSE) {
+    unsigned char fg = look.fg;
+    look.fg = look.bg;
+    look.bg = fg;
+  }
+
+  return look;
+}
@@ -0,0 +1,46 @@
+#ifndef PALETTE_H_
+#define PALETTE_H_
+
+#include "colors.h"
+#include "grid.h"
+#include <stdbool.h>
+
+// Cycle groups a cell can be in, numbered from 1 in its flags
+#define PALETTE_CYCLE_GROUPS 3
+
+// Full on and off periods per second of CELL_BLINK glyphs
+#define PALETTE_BLINK_HZ 2.0
+
+// Rotates colors [first, first + count) by one step `rate` times a second,
+// negative rates run backwards. A count of 0 turns the group off.
+typedef struct {
+  int first, count;
+  float rate;
+} PaletteCycle;
+
+// The colors cell indices resolve to, uploaded to the grid shader when they
+// change and read by the headless rasterizer
+typedef struct {
+  unsigned char colors[VGA_COLOR_COUNT][3];
+  PaletteCycle cycles[PALETTE_CYCLE_GROUPS]; // group 1 first
+} Palette;
+
+// A cell after its attributes are applied at some point in time
+typedef struct {
+  unsigned char fg, bg; // palette indices or VGA_TRANSPARENT
+  bool glyph;           // false in the off phase of a blink
+  bool underline;
+} CellLook;
+
+// The standard VGA colors, no cycles
+Palette palette_default(void);
+
+bool palette_blink_on(double time);
+
+// Steps `cycle` has advanced at `time`, in [0, count)
+int palette_cycle_step(const PaletteCycle *cycle, double time);
+
+// What shader.glsl draws for `cell` at `time` seconds
+CellLook palette_resolve(const Palette *palette, Cell cell, double time);
+
+#endif // PALETTE_H_
@@ -0,0 +1,177 @@
+#include "profiler.h"
+#include "clock.h"
+#include "slog.h"
+#include <assert.h>
+#include <raylib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+const char *profiler_phase_names[PROFILER_PHASE_COUNT] = {
+#define X(_, name) name,
+    PROFILER_PHASES(X)
+#undef X
+};
+
+Profiler *profiler_init(void) {
+  Profiler *profiler = calloc(1, sizeof(Profiler));
+  assert(profiler);
+
+  return profiler;
+}
+
+void profiler_free(Profiler *profiler) {
+  if (!profiler)
+    return;
+
+  free(profiler->saved);
+  free(profiler);
+}
+
+void profiler_begin(Profiler *profiler, ProfilerPhase phase) {
+  profiler->start[phase] = clock_seconds();
+}
+
+// Phases may run several times per frame (e.g. fixed-rate updates), their
+// times add up
+void profiler_end(Profiler *profiler, ProfilerPhase phase) {
+  profiler->current[phase] += clock_seconds() - profiler->start[phase];
+}
+
+void profiler_end_frame(Profiler *profiler) {
+  size_t slot = profiler->frames % PROFILER_HISTORY;
+
+  for (int phase = 0; phase < PROFILER_PHASE_COUNT; phase++) {
+    profiler->samples[phase][slot] = profiler->current[phase];
+    profiler->current[phase] = 0.0;
+  }
+
+  profiler->frames++;
+}
+
+static size_t sample_count(const Profiler *profiler) {
+  return profiler->frames < PROFILER_HISTORY ? profiler->frames
+                                             : PROFILER_HISTORY;
+}
+
+static int compare_double(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+ProfilerStats profiler_stats(const Profiler *profiler, ProfilerPhase phase) {
+  size_t n = sample_count(profiler);
+  if (n == 0)
+    return (ProfilerStats){0};
+
+  double sorted[PROFILER_HISTORY];
+  memcpy(sorted, profiler->samples[phase], n * sizeof(double));
+  qsort(sorted, n, sizeof(double), compare_double);
+
+  double sum = 0.0;
+  for (size_t i = 0; i < n; i++)
+    sum += sorted[i];
+
+  return (ProfilerStats){
+      .min = sorted[0],
+      .avg = sum / n,
+      .p99 = sorted[(n * 99) / 100 < n ? (n * 99) / 100 : n - 1],
+      .max = sorted[n - 1],
+  };
+}
+
+static void overlay_line(Grid *grid, size_t y, const char *text) {
+  size_t len = strlen(text);
+  if (len > grid->w || y >= grid->h)
+    return;
+
+  size_t x = grid->w - len;
+  for (size_t i = 0; i < len; i++) {
+    grid_set(grid, x + i, y,
+             (Cell){.glyph = (unsigned char)text[i],
+                    .fg = VGA_YELLOW,
+                    .bg = VGA_BLUE});
+  }
+}
+
+// Draws a table of per-phase timings (in ms) in the top-right corner
+void profiler_draw_overlay(Profiler *profiler, Grid *grid) {
+  size_t rows = PROFILER_PHASE_COUNT + 1;
+  if (rows > grid->h)
+    rows = grid->h;
+
+  profiler->saved = realloc(profiler->saved, grid->w * rows * sizeof(Cell));
+  assert(profiler->saved);
+  for (size_t y = 0; y < rows; y++) {
+    memcpy(&profiler->saved[y * grid->w], grid_cell(grid, 0, y),
+           grid->w * sizeof(Cell));
+  }
+  profiler->saved_rows = rows;
+
+  overlay_line(grid, 0, " phase       avg     p99     max ");
+
+  for (int phase = 0; phase < PROFILER_PHASE_COUNT; phase++) {
+    ProfilerStats stats = profiler_stats(profiler, phase);
+    overlay_line(grid, phase + 1,
+                 TextFormat(" %-8s %6.2f  %6.2f  %6.2f ",
+                            profiler_phase_names[phase], stats.avg * 1e3,
+                            stats.p99 * 1e3, stats.max * 1e3));
+  }
+}
+
+void profiler_restore_overlay(Profiler *profiler, Grid *grid) {
+  for (size_t y = 0; y < profiler->saved_rows; y++) {
+    for (size_t x = 0; x < grid->w; x++)
+      grid_set(grid, x, y, profiler->saved[y * grid->w + x]);
+  }
+  profiler->saved_rows = 0;
+}
+
+// Writes the recorded frames oldest first, in ms. A .json path produces an
+// object of per-phase arrays, anything else CSV with one row per frame.
+bool profiler_dump(const Profiler *profiler, const char *path) {
+  FILE *f = fopen(path, "w");
+  if (!f) {
+    error("Failed to open %s for the frame profile", path);
+    return false;
+  }
+
+  size_t n = sample_count(profiler);
+  size_t first = profiler->frames - n;
+  bool json = IsFileExtension(path, ".json");
+
+  if (json) {
+    fprintf(f, "{\n  \"frames\": %zu", profiler->frames);
+    for (int phase = 0; phase < PROFILER_PHASE_COUNT; phase++) {
+      fprintf(f, ",\n  \"%s\": [", profiler_phase_names[phase]);
+      for (size_t i = 0; i < n; i++) {
+        fprintf(f, "%s%.4f", i ? ", " : "",
+                profiler->samples[phase][(first + i) % PROFILER_HISTORY] *
+                    1e3);
+      }
+      fprintf(f, "]");
+    }
+    fprintf(f, "\n}\n");
+  } else {
+    fprintf(f, "frame");
+    for (int phase = 0; phase < PROFILER_PHASE_COUNT; phase++)
+      fprintf(f, ",%s", profiler_phase_names[phase]);
+    fprintf(f, "\n");
+
+    for (size_t i = 0; i < n; i++) {
+      fprintf(f, "%zu", first + i);
+      for (int phase = 0; phase < PROFILER_PHASE_COUNT; phase++) {
+        fprintf(f, ",%.4f",
+                profiler->samples[phase][(first + i) % PROFILER_HISTORY] *
+                    1e3);
+      }
+      fprintf(f, "\n");
+    }
+  }
+
+  fclose(f);
+  info("Wrote frame profile to %s", path);
+
+  return true;
+}
@@ -0,0 +1,61 @@
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include "grid.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+#define PROFILER_HISTORY 240
+
+#define PROFILER_PHASES(X)                                                     \
+  X(WATCH, "watch")     /* hot reload polling */                               \
+  X(LOAD, "load")       /* finishing background resource loads */             \
+  X(INPUT, "input")     /* input dispatch */                                   \
+  X(UPDATE, "update")   /* te.update */                                        \
+  X(AUDIO, "audio")     /* freeing finished voices */                          \
+  X(DRAW, "draw")       /* te.draw */                                          \
+  X(UPLOAD, "upload")   /* grid texture upload / CPU raster */                 \
+  X(PRESENT, "present") /* shader pass and EndDrawing */                       \
+  X(FRAME, "frame")     /* the whole frame, including pacing */
+
+typedef enum {
+#define X(name, _) PROFILER_##name,
+  PROFILER_PHASES(X)
+#undef X
+      PROFILER_PHASE_COUNT
+} ProfilerPhase;
+
+extern const char *profiler_phase_names[PROFILER_PHASE_COUNT];
+
+typedef struct {
+  double min, avg, p99, max; // seconds
+} ProfilerStats;
+
+// Per-phase timings of the last PROFILER_HISTORY frames
+typedef struct {
+  double samples[PROFILER_PHASE_COUNT][PROFILER_HISTORY];
+  size_t frames; // frames recorded so far
+
+  double start[PROFILER_PHASE_COUNT];
+  double current[PROFILER_PHASE_COUNT];
+
+  bool overlay;
+  Cell *saved;       // rows under the overlay while it is drawn
+  size_t saved_rows; // 0 when nothing needs restoring
+} Profiler;
+
+Profiler *profiler_init(void);
+void profiler_free(Profiler *profiler);
+
+void profiler_begin(Profiler *profiler, ProfilerPhase phase);
+void profiler_end(Profiler *profiler, ProfilerPhase phase);
+void profiler_end_frame(Profiler *profiler);
+
+ProfilerStats profiler_stats(const Profiler *profiler, ProfilerPhase phase);
+// Draws the timing table over the top rows of `grid`, and puts the cells
+// it covered back once the frame has been presented
+void profiler_draw_overlay(Profiler *profiler, Grid *grid);
+void profiler_restore_overlay(Profiler *profiler, Grid *grid);
+bool profiler_dump(const Profiler *profiler, const char *path);
+
+#endif // PROFILER_H_
@@ -0,0 +1,197 @@
+#include "raster.h"
+#include "colors.h"
+#include "globals.h"
+#include "slog.h"
+#include <assert.h>
+#include <raylib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+Raster *raster_init(Image atlas, size_t cols, size_t rows) {
+  Raster *raster = calloc(1, sizeof(Raster));
+  assert(raster);
+
+  raster->glyph_w = GLYPH_W;
+  raster->glyph_h = GLYPH_H;
+  raster->w = cols * GLYPH_W;
+  raster->h = rows * GLYPH_H;
+
+  raster->pixels = calloc(raster->w * raster->h, 3);
+  assert(raster->pixels);
+
+  // Flatten the 16x16 glyph atlas into one coverage tile per glyph, using
+  // the red channel just like the shader does
+  assert(atlas.format == PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+  assert(atlas.width == 16 * GLYPH_W && atlas.height == 16 * GLYPH_H);
+
+  raster->coverage = malloc(256 * GLYPH_W * GLYPH_H);
+  assert(raster->coverage);
+
+  const unsigned char *src = atlas.data;
+  for (int glyph = 0; glyph < 256; glyph++) {
+    int ax = (glyph & 15) * GLYPH_W;
+    int ay = (glyph >> 4) * GLYPH_H;
+    unsigned char *tile = &raster->coverage[glyph * GLYPH_W * GLYPH_H];
+
+    for (int y = 0; y < GLYPH_H; y++) {
+      for (int x = 0; x < GLYPH_W; x++) {
+        tile[y * GLYPH_W + x] = src[((ay + y) * atlas.width + ax + x) * 4];
+      }
+    }
+  }
+
+  return raster;
+}
+
+// Draws one layer of a cell over the pixels already there. Transparent
+// colors resolve to those pixels, or to black on the bottom layer.
+static void raster_cell(Raster *raster, size_t cx, size_t cy, Cell cell,
+                        bool bottom, const Palette *palette, double time) {
+  static const unsigned char black[3] = {0, 0, 0};
+
+  if (!bottom && cell.fg == VGA_TRANSPARENT && cell.bg == VGA_TRANSPARENT)
+    return;
+
+  CellLook look = palette_resolve(palette, cell, time);
+  const unsigned char *fg = palette->colors[look.fg & 15];
+  const unsigned char *bg = palette->colors[look.bg & 15];
+  const unsigned char *tile =
+      &raster->coverage[cell.glyph * raster->glyph_w * raster->glyph_h];
+
+  for (size_t y = 0; y < raster->glyph_h; y++) {
+    unsigned char *out =
+        &raster->pixels[((cy * raster->glyph_h + y) * raster->w +
+                         cx * raster->glyph_w) *
+                        3];
+    bool underline = look.underline && y == raster->glyph_h - 1;
+
+    for (size_t x = 0; x < raster->glyph_w; x++) {
+      int a = underline ? 255 : *tile;
+      if (!look.glyph)
+        a = 0;
+      tile++;
+
+      const unsigned char *below = bottom ? black : out;
+      const unsigned char *b = look.bg == VGA_TRANSPARENT ? below : bg;
+      const unsigned char *f = look.fg == VGA_TRANSPARENT ? b : fg;
+      for (int c = 0; c < 3; c++) {
+        out[c] = (b[c] * (255 - a) + f[c] * a + 127) / 255;
+      }
+      out += 3;
+    }
+  }
+}
+
+// Records what the next frame is drawn with, returns whether it differs
+// from the last one
+static bool raster_update_state(Raster *raster, Grid *const *layers,
+                                size_t count, const Palette *palette,
+                                double time) {
+  bool changed = !raster->drawn ||
+                 memcmp(&raster->palette, palette, sizeof(Palette)) != 0 ||
+                 raster->blink_on != palette_blink_on(time);
+
+  raster->drawn = true;
+  raster->palette = *palette;
+  raster->blink_on = palette_blink_on(time);
+  for (int i = 0; i < PALETTE_CYCLE_GROUPS; i++) {
+    int step = palette_cycle_step(&palette->cycles[i], time);
+    changed |= raster->cycle_steps[i] != step;
+    raster->cycle_steps[i] = step;
+  }
+  for (size_t i = 0; i < count; i++) {
+    changed |= raster->origins[i] != layers[i]->origin;
+    raster->origins[i] = layers[i]->origin;
+  }
+
+  return changed;
+}
+
+// Redraws every cell that is dirty in any of the `count` layers, compositing
+// the whole stack back to front, and marks the layers clean. Everything is
+// redrawn when the palette, an animation step or a layer's scroll origin
+// changed.
+void raster_layers(Raster *raster, Grid *const *layers, size_t count,
+                   const Palette *palette, double time) {
+  assert(count <= ENGINE_MAX_LAYERS);
+
+  // Each dirty cell composites the whole stack, so the bottom layer is
+  // enough to cover everything
+  if (raster_update_state(raster, layers, count, palette, time) && count > 0)
+    grid_mark_dirty(layers[0], 0, 0, layers[0]->w, layers[0]->h);
+
+  for (size_t i = 0; i < count; i++) {
+    const Grid *grid = layers[i];
+
+    // Dirty spans are kept per storage row, each maps back to one screen
+    // row through the layer's origin
+    for (size_t row = grid->dirty_y0; row < grid->dirty_y1; row++) {
+      size_t y = (row + grid->h - grid->origin) % grid->h;
+
+      for (size_t x = grid->dirty[row].x0; x < grid->dirty[row].x1; x++) {
+        for (size_t l = 0; l < count; l++) {
+          raster_cell(raster, x, y, *grid_cell(layers[l], x, y), l == 0,
+                      palette, time);
+        }
+      }
+    }
+  }
+
+  for (size_t i = 0; i < count; i++)
+    grid_clear_dirty(layers[i]);
+}
+
+// Copies `path` into `out` with its first "%d" replaced by `frame`. The
+// path comes from the command line, so it is never used as a format string
+// and any other % is kept as it is.
+static bool frame_path(char *out, size_t size, const char *path, long frame) {
+  const char *mark = strstr(path, "%d");
+  int len = mark ? snprintf(out, size, "%.*s%ld%s", (int)(mark - path), path,
+                            frame, mark + 2)
+                 : snprintf(out, size, "%s", path);
+  return len >= 0 && (size_t)len < size;
+}
+
+// Writes the framebuffer to `path`. The extension picks the format: .png and
+// .ppm write one image per frame (a %d in the path is replaced by the frame
+// number), anything else appends the raw RGB24 frame so a stream of frames
+// can be piped to another process.
+bool raster_write(const Raster *raster, const char *path, long frame) {
+  char file[4096];
+  if (!frame_path(file, sizeof file, path, frame)) {
+    error("Frame output path is too long: %s", path);
+    return false;
+  }
+
+  if (IsFileExtension(path, ".png")) {
+    Image image = {.data = raster->pixels,
+                   .width = raster->w,
+                   .height = raster->h,
+                   .mipmaps = 1,
+                   .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8};
+    return ExportImage(image, file);
+  }
+
+  bool ppm = IsFileExtension(path, ".ppm");
+  FILE *f = fopen(file, (ppm || frame == 0) ? "wb" : "ab");
+  if (!f) {
+    error("Failed to open frame output %s", file);
+    return false;
+  }
+
+  if (ppm)
+    fprintf(f, "P6\n%zu %zu\n255\n", raster->w, raster->h);
+
+  size_t size = raster->w * raster->h * 3;
+  bool ok = fwrite(raster->pixels, 1, size, f) == size;
+  fclose(f);
+
+  return ok;
+}
+
+void raster_free(Raster *raster) {
+  free(raster->coverage);
+  free(raster->pixels);
+  free(raster);
+}
@@ -0,0 +1,35 @@
+#ifndef RASTER_H_
+#define RASTER_H_
+
+#include "engine.h"
+#include "grid.h"
+#include "palette.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// CPU rasterizer used in headless mode. Produces the same picture as
+// shader.glsl into an RGB24 framebuffer.
+typedef struct {
+  size_t glyph_w, glyph_h;
+  unsigned char *coverage; // 256 glyphs, glyph_w * glyph_h bytes each
+
+  size_t w, h;           // framebuffer size in pixels
+  unsigned char *pixels; // RGB24, w * h * 3 bytes
+
+  // What the pixels were drawn with. When any of it changes every cell is
+  // redrawn, since attributes animate and layers scroll without marking
+  // cells dirty.
+  bool drawn;
+  Palette palette;
+  bool blink_on;
+  int cycle_steps[PALETTE_CYCLE_GROUPS];
+  size_t origins[ENGINE_MAX_LAYERS]; // Grid.origin of each layer
+} Raster;
+
+Raster *raster_init(Image atlas, size_t cols, size_t rows);
+void raster_layers(Raster *raster, Grid *const *layers, size_t count,
+                   const Palette *palette, double time);
+bool raster_write(const Raster *raster, const char *path, long frame);
+void raster_free(Raster *raster);
+
+#endif // RASTER_H_
@@ -0,0 +1,171 @@
+#include "reload.h"
+#include "lauxlib.h"
+#include "lua.h"
+#include "lua_api.h"
+#include "slog.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+// Turns "enemies/boss.lua" into "enemies.boss" and "ui/init.lua" into "ui",
+// matching the game directory entries in package.path. Returns false for
+// files that are not Lua modules.
+static bool module_name(const char *path, char *buf, size_t size) {
+  size_t len = strlen(path);
+  if (len <= 4 || strcmp(path + len - 4, ".lua") != 0 || len - 4 >= size)
+    return false;
+
+  len -= 4;
+  memcpy(buf, path, len);
+  buf[len] = '\0';
+
+  if (len > 5 && strcmp(buf + len - 5, "/init") == 0)
+    buf[len - 5] = '\0';
+
+  for (char *c = buf; *c; c++) {
+    if (*c == '/')
+      *c = '.';
+  }
+
+  return true;
+}
+
+// Makes the table at `old` a copy of the table at `new`, so every reference
+// to the old module sees the new functions
+static void patch_table(lua_State *L, int old, int new) {
+  // Clearing existing fields is allowed while traversing
+  lua_pushnil(L);
+  while (lua_next(L, old) != 0) {
+    lua_pop(L, 1);
+    lua_pushvalue(L, -1);
+    if (lua_rawget(L, new) == LUA_TNIL) {
+      lua_pushvalue(L, -2);
+      lua_pushnil(L);
+      lua_rawset(L, old);
+    }
+    lua_pop(L, 1);
+  }
+
+  lua_pushnil(L);
+  while (lua_next(L, new) != 0) {
+    lua_pushvalue(L, -2);
+    lua_insert(L, -2);
+    lua_rawset(L, old);
+  }
+}
+
+// Re-requires a module that is in package.loaded. On error the old module
+// stays loaded.
+static void reload_module(lua_State *L, const char *name) {
+  int top = lua_gettop(L);
+
+  lua_getfield(L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+  int loaded = lua_gettop(L);
+  lua_getfield(L, loaded, name);
+  int old = lua_gettop(L);
+
+  lua_pushnil(L);
+  lua_setfield(L, loaded, name);
+
+  lua_getglobal(L, "require");
+  lua_pushstring(L, name);
+  if (lua_pcall(L, 1, 1, 0) != LUA_OK) {
+    error("Failed to reload module %s: %s", name, lua_tostring(L, -1));
+    lua_pushvalue(L, old);
+    lua_setfield(L, loaded, name);
+    lua_settop(L, top);
+    return;
+  }
+
+  int new = lua_gettop(L);
+  if (lua_istable(L, old) && lua_istable(L, new) &&
+      !lua_rawequal(L, old, new)) {
+    patch_table(L, old, new);
+    lua_pushvalue(L, old);
+    lua_setfield(L, loaded, name);
+  }
+
+  info("Reloaded module %s", name);
+  lua_settop(L, top);
+}
+
+// Calls te.<name>(args...) with `nargs` arguments on top of the stack and
+// leaves one result. A missing hook leaves nil.
+static bool call_hook(lua_State *L, const char *name, int nargs) {
+  lua_getglobal(L, "te");
+  lua_getfield(L, -1, name);
+  lua_remove(L, -2);
+
+  if (!lua_isfunction(L, -1)) {
+    lua_pop(L, 1 + nargs);
+    lua_pushnil(L);
+    return false;
+  }
+
+  lua_insert(L, -1 - nargs);
+  if (lua_pcall(L, nargs, 1, 0) != LUA_OK) {
+    error("failed calling te.%s: %s", name, lua_tostring(L, -1));
+    lua_pop(L, 1);
+    lua_pushnil(L);
+  }
+
+  return true;
+}
+
+// Writes the module name of `path` into `name` if that module is currently
+// loaded. Modules that were never required load fresh when they are.
+static bool loaded_module(lua_State *L, const char *path, char *name,
+                          size_t size) {
+  if (!module_name(path, name, size))
+    return false;
+
+  lua_getfield(L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+  bool loaded = lua_getfield(L, -1, name) != LUA_TNIL;
+  lua_pop(L, 2);
+
+  return loaded;
+}
+
+void reload_lua_changes(Engine *engine, char **paths, size_t count) {
+  lua_State *L = engine->L;
+  int top = lua_gettop(L);
+  char name[256];
+
+  bool main_changed = false;
+  size_t module_count = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (strcmp(paths[i], "main.lua") == 0) {
+      main_changed = true;
+    } else if (loaded_module(L, paths[i], name, sizeof name)) {
+      module_count++;
+    }
+  }
+
+  if (!main_changed && module_count == 0)
+    return;
+
+  info("Reloading %zu module(s)%s", module_count,
+       main_changed ? " and main.lua" : "");
+
+  call_hook(L, "unload", 0);
+  int state = lua_gettop(L);
+
+  for (size_t i = 0; i < count; i++) {
+    if (strcmp(paths[i], "main.lua") != 0 &&
+        loaded_module(L, paths[i], name, sizeof name))
+      reload_module(L, name);
+  }
+
+  if (main_changed) {
+    if (chunk_cache_dofile(engine->chunk_cache, L, "main.lua") != LUA_OK) {
+      error("Failed to reload main.lua: %s", lua_tostring(L, -1));
+      lua_pop(L, 1);
+    }
+  }
+
+  lua_pushvalue(L, state);
+  if (!call_hook(L, "reload", 1) && main_changed)
+    call_load(L);
+
+  lua_settop(L, top);
+}
@@ -0,0 +1,14 @@
+#ifndef RELOAD_H_
+#define RELOAD_H_
+
+#include "engine.h"
+#include <stddef.h>
+
+// Applies a batch of changed game files (paths relative to the game
+// directory). Changed modules that were require()d are reloaded in place and
+// a changed main.lua is re-run. The game can carry state over by returning
+// it from te.unload(), which is passed to te.reload(state) afterwards.
+// Without te.reload, a changed main.lua runs te.load again.
+void reload_lua_changes(Engine *engine, char **paths, size_t count);
+
+#endif // RELOAD_H_
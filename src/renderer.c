@@ -4,40 +4,156 @@
 #include "generated/shaders/shader.glsl.h"
 #include "globals.h"
 #include "grid.h"
+#include "slog.h"
 #include <assert.h>
 #include <raylib.h>
 #include <stdlib.h>
 
+// Seconds the cell attributes have been animating. Headless runs follow the
+// virtual clock of the main loop, so frame dumps are reproducible.
+static double render_time(const Engine *engine) {
+  if (engine->config.headless) {
+    int fps = engine->config.target_fps > 0 ? engine->config.target_fps : 60;
+    return (double)engine->frame / fps;
+  }
+  return GetTime();
+}
+
+static void render_frame_headless(Engine *engine) {
+  profiler_begin(engine->profiler, PROFILER_UPLOAD);
+  raster_layers(engine->renderer->raster, engine->layers, ENGINE_MAX_LAYERS,
+                &engine->renderer->palette, render_time(engine));
+  profiler_end(engine->profiler, PROFILER_UPLOAD);
+
+  profiler_begin(engine->profiler, PROFILER_PRESENT);
+  if (engine->config.frame_out &&
+      !raster_write(engine->renderer->raster, engine->config.frame_out,
+                    engine->frame)) {
+    error("Failed to write frame %ld", engine->frame);
+  }
+  profiler_end(engine->profiler, PROFILER_PRESENT);
+}
+
+static void upload_palette(Renderer *renderer) {
+  float colors[VGA_COLOR_COUNT][3];
+  for (int i = 0; i < VGA_COLOR_COUNT; i++) {
+    for (int c = 0; c < 3; c++)
+      colors[i][c] = renderer->palette.colors[i][c] / 255.0f;
+  }
+
+  int cycles[PALETTE_CYCLE_GROUPS][2];
+  float rates[PALETTE_CYCLE_GROUPS];
+  for (int i = 0; i < PALETTE_CYCLE_GROUPS; i++) {
+    cycles[i][0] = renderer->palette.cycles[i].first;
+    cycles[i][1] = renderer->palette.cycles[i].count;
+    rates[i] = renderer->palette.cycles[i].rate;
+  }
+
+  GridShader *gs = &renderer->grid_shader;
+  SetShaderValueV(gs->shader, gs->paletteLoc, colors, SHADER_UNIFORM_VEC3,
+                  VGA_COLOR_COUNT);
+  SetShaderValueV(gs->shader, gs->cyclesLoc, cycles, SHADER_UNIFORM_IVEC2,
+                  PALETTE_CYCLE_GROUPS);
+  SetShaderValueV(gs->shader, gs->cycleRatesLoc, rates, SHADER_UNIFORM_FLOAT,
+                  PALETTE_CYCLE_GROUPS);
+  renderer->palette_dirty = false;
+}
+
+// Runs the grid shader over the grid's pixels in the current framebuffer.
+// The quad is raylib's 1x1 white texture stretched over them: the shader
+// works from gl_FragCoord alone.
+static void draw_grid(Renderer *renderer) {
+  BeginShaderMode(renderer->grid_shader.shader);
+  {
+    SetShaderValueTexture(renderer->grid_shader.shader,
+                          renderer->grid_shader.glyphAtlasTextureLoc,
+                          renderer->atlas.texture);
+    for (int i = 0; i < ENGINE_MAX_LAYERS; i++) {
+      SetShaderValueTexture(renderer->grid_shader.shader,
+                            renderer->grid_shader.layerTextureLocs[i],
+                            renderer->layers[i].texture);
+    }
+
+    DrawRectangle(0, 0, renderer->layers[0].w * renderer->atlas.glyph_w,
+                  renderer->layers[0].h * renderer->atlas.glyph_h, WHITE);
+  }
+  EndShaderMode();
+}
+
 void render_frame(Engine *engine) {
-  UnloadTexture(engine->renderer->grid_texture);
-  engine->renderer->grid_texture = grid_render_texture(engine->grid);
+  if (engine->config.headless) {
+    render_frame_headless(engine);
+    return;
+  }
 
+  profiler_begin(engine->profiler, PROFILER_UPLOAD);
+  for (int i = 0; i < ENGINE_MAX_LAYERS; i++) {
+    texture_stream_upload(&engine->renderer->layers[i], engine->layers[i]);
+  }
+  if (engine->renderer->palette_dirty)
+    upload_palette(engine->renderer);
+
+  // A scrolled layer only uploaded its new rows, the rest is found through
+  // its origin
+  int origins[ENGINE_MAX_LAYERS];
+  for (int i = 0; i < ENGINE_MAX_LAYERS; i++)
+    origins[i] = engine->layers[i]->origin;
+  SetShaderValueV(engine->renderer->grid_shader.shader,
+                  engine->renderer->grid_shader.rowOriginsLoc, origins,
+                  SHADER_UNIFORM_INT, ENGINE_MAX_LAYERS);
+
+  // Animated attributes only need the clock, the cells stay as they are
+  float time = render_time(engine);
+  SetShaderValue(engine->renderer->grid_shader.shader,
+                 engine->renderer->grid_shader.timeLoc, &time,
+                 SHADER_UNIFORM_FLOAT);
+  profiler_end(engine->profiler, PROFILER_UPLOAD);
+
+  profiler_begin(engine->profiler, PROFILER_PRESENT);
   BeginDrawing();
   {
-    ClearBackground(BLACK);
-    BeginShaderMode(engine->renderer->grid_shader.shader);
-    {
-      SetShaderValueTexture(engine->renderer->grid_shader.shader,
-                            engine->renderer->grid_shader.glyphAtlasTextureLoc,
-                            engine->renderer->atlas.texture);
-      SetShaderValueTexture(engine->renderer->grid_shader.shader,
-                            engine->renderer->grid_shader.gridTextureLoc,
-                            engine->renderer->grid_texture);
-
-      DrawTexture(engine->renderer->dummy, 0, 0, WHITE);
+    Renderer *renderer = engine->renderer;
+    if (renderer->scale > 1) {
+      BeginTextureMode(renderer->target);
+      draw_grid(renderer);
+      EndTextureMode();
+
+      // Render textures are stored bottom-up, hence the negative height
+      int w = renderer->target.texture.width;
+      int h = renderer->target.texture.height;
+      ClearBackground(BLACK);
+      DrawTexturePro(renderer->target.texture, (Rectangle){0, 0, w, -h},
+                     (Rectangle){0, 0, w * renderer->scale,
+                                 h * renderer->scale},
+                     (Vector2){0, 0}, 0.0f, WHITE);
+    } else {
+      ClearBackground(BLACK);
+      draw_grid(renderer);
     }
-    EndShaderMode();
   }
   EndDrawing();
+  profiler_end(engine->profiler, PROFILER_PRESENT);
 }
 
 Renderer *renderer_init(Engine *engine) {
-  Renderer *renderer = malloc(sizeof(Renderer));
+  Renderer *renderer = calloc(1, sizeof(Renderer));
   assert(renderer);
 
+  renderer->fg = VGA_WHITE;
+  renderer->bg = VGA_BLACK;
+  renderer->palette = palette_default();
+  renderer->palette_dirty = true;
+
   Image atlas =
       LoadImageFromMemory(".png", assets_images_Mx437_IBM_BIOS_16px_png,
                           assets_images_Mx437_IBM_BIOS_16px_png_len);
+
+  if (engine->config.headless) {
+    renderer->raster = raster_init(atlas, engine->grid->w, engine->grid->h);
+    UnloadImage(atlas);
+    return renderer;
+  }
+
   renderer->atlas = (GlyphAtlas){.texture = LoadTextureFromImage(atlas),
                                  .glyph_w = GLYPH_W,
                                  .glyph_h = GLYPH_H};
@@ -49,28 +165,65 @@ Renderer *renderer_init(Engine *engine) {
   // Cache shader locations
   renderer->grid_shader.glyphAtlasTextureLoc =
       GetShaderLocation(renderer->grid_shader.shader, "fontAtlasTexture");
-  renderer->grid_shader.gridTextureLoc =
-      GetShaderLocation(renderer->grid_shader.shader, "gridTexture");
+  for (int i = 0; i < ENGINE_MAX_LAYERS; i++) {
+    renderer->grid_shader.layerTextureLocs[i] = GetShaderLocation(
+        renderer->grid_shader.shader, TextFormat("layer%dTexture", i));
+  }
   renderer->grid_shader.cellSizeLoc =
       GetShaderLocation(renderer->grid_shader.shader, "cellSize");
-  renderer->grid_shader.gridSizeLoc =
-      GetShaderLocation(renderer->grid_shader.shader, "gridSize");
+  renderer->grid_shader.viewHeightLoc =
+      GetShaderLocation(renderer->grid_shader.shader, "viewHeight");
+  renderer->grid_shader.rowOriginsLoc =
+      GetShaderLocation(renderer->grid_shader.shader, "rowOrigins");
+  renderer->grid_shader.timeLoc =
+      GetShaderLocation(renderer->grid_shader.shader, "time");
+  renderer->grid_shader.paletteLoc =
+      GetShaderLocation(renderer->grid_shader.shader, "palette");
+  renderer->grid_shader.cyclesLoc =
+      GetShaderLocation(renderer->grid_shader.shader, "cycles");
+  renderer->grid_shader.cycleRatesLoc =
+      GetShaderLocation(renderer->grid_shader.shader, "cycleRates");
 
-  renderer->grid_texture = grid_render_texture(engine->grid);
+  for (int i = 0; i < ENGINE_MAX_LAYERS; i++) {
+    renderer->layers[i] = texture_stream_init(engine->grid->w, engine->grid->h);
+    grid_mark_dirty(engine->layers[i], 0, 0, engine->grid->w,
+                    engine->grid->h);
+  }
 
-  Image img = GenImageColor(GetScreenWidth(), GetScreenHeight(), WHITE);
-  renderer->dummy = LoadTextureFromImage(img);
-  UnloadImage(img);
+  // Native resolution: one atlas pixel per framebuffer pixel
+  int view_height = GetScreenHeight();
+  renderer->scale = engine->config.scale > 1 ? engine->config.scale : 1;
+  if (renderer->scale > 1) {
+    renderer->target = LoadRenderTexture(engine->grid->w * GLYPH_W,
+                                         engine->grid->h * GLYPH_H);
+    SetTextureFilter(renderer->target.texture, TEXTURE_FILTER_POINT);
+    view_height = renderer->target.texture.height;
+  }
 
-  renderer->fg = VGA_WHITE;
-  renderer->bg = VGA_BLACK;
+  int cell_size[2] = {renderer->atlas.glyph_w, renderer->atlas.glyph_h};
+  SetShaderValue(renderer->grid_shader.shader,
+                 renderer->grid_shader.cellSizeLoc, cell_size,
+                 SHADER_UNIFORM_IVEC2);
+
+  SetShaderValue(renderer->grid_shader.shader,
+                 renderer->grid_shader.viewHeightLoc, &view_height,
+                 SHADER_UNIFORM_INT);
 
   return renderer;
 }
 
 void renderer_free(Renderer *renderer) {
+  if (renderer->raster) {
+    raster_free(renderer->raster);
+    free(renderer);
+    return;
+  }
+
   UnloadTexture(renderer->atlas.texture);
   UnloadShader(renderer->grid_shader.shader);
-  UnloadTexture(renderer->dummy);
+  if (renderer->scale > 1)
+    UnloadRenderTexture(renderer->target);
+  for (int i = 0; i < ENGINE_MAX_LAYERS; i++)
+    texture_stream_free(&renderer->layers[i]);
   free(renderer);
 }
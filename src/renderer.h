@@ -2,7 +2,11 @@
 #define RENDERER_H_
 
 #include "colors.h"
+#include "draw.h"
 #include "engine.h"
+#include "palette.h"
+#include "raster.h"
+#include "texture_stream.h"
 #include <raylib.h>
 #include <stddef.h>
 
@@ -15,19 +19,42 @@ typedef struct {
 typedef struct {
   Shader shader;
   int glyphAtlasTextureLoc;
-  int gridTextureLoc;
+  int layerTextureLocs[ENGINE_MAX_LAYERS];
   int cellSizeLoc;
-  int gridSizeLoc;
+  int viewHeightLoc;
+  int rowOriginsLoc;
+  int timeLoc;
+  int paletteLoc;
+  int cyclesLoc;
+  int cycleRatesLoc;
 } GridShader;
 
 struct Renderer {
   GlyphAtlas atlas;
   GridShader grid_shader;
-  Texture dummy;
-  Texture grid_texture;
+
+  // With an integer scale above 1 the grid pass renders at the atlas's
+  // native resolution into `target`, which is then upscaled to the window
+  int scale;
+  RenderTexture target;
+
+  // Long-lived copy of each layer on the GPU, patched with dirty regions
+  TextureStream layers[ENGINE_MAX_LAYERS];
+
+  // CPU framebuffer, only used in headless mode
+  Raster *raster;
+
+  // Cell colors resolve through this, re-uploaded when dirty
+  Palette palette;
+  bool palette_dirty;
 
   VGA_Color fg;
   VGA_Color bg;
+  unsigned char flags; // Cell.flags of cells drawn from Lua
+
+  // te.graphics.pushClip stack, drawing from Lua stays inside the top entry
+  DrawClip clips[DRAW_CLIP_DEPTH];
+  int clip_depth;
 };
 
 Renderer *renderer_init(Engine *engine);
@@ -0,0 +1,406 @@
+#include "resources.h"
+#include "clock.h"
+#include "slog.h"
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct Preload {
+  int tag;
+  Resource **items; // each holds a reference until the preload completes
+  size_t count;
+  Preload *next;
+};
+
+static size_t bucket_of(const char *path) {
+  uint32_t hash = 2166136261u;
+  for (const char *c = path; *c; c++) {
+    hash ^= (unsigned char)*c;
+    hash *= 16777619u;
+  }
+  return hash % RESOURCES_BUCKETS;
+}
+
+static void unload(Resource *r) {
+  if (r->owns_data)
+    UnloadFileData(r->data);
+  if (IsWaveValid(r->wave))
+    UnloadWave(r->wave);
+  if (IsSoundValid(r->sound))
+    UnloadSound(r->sound);
+  free(r->path);
+  free(r);
+}
+
+static void unlink_resource(Resources *res, Resource *r) {
+  Resource **link = &res->buckets[bucket_of(r->path)];
+  while (*link != r)
+    link = &(*link)->next;
+  *link = r->next;
+}
+
+// Finds the entry for `path`, dropping a failed one nobody holds so the
+// load is retried (the file may have been fixed since). Called with
+// Resources.lock held, as the worker may be writing the entry's state.
+static Resource *lookup(Resources *res, const char *path, ResourceKind kind) {
+  for (Resource *r = res->buckets[bucket_of(path)]; r; r = r->next) {
+    if (r->kind != kind || strcmp(r->path, path) != 0)
+      continue;
+
+    if (r->state == RESOURCE_FAILED && r->refs == 0) {
+      unlink_resource(res, r);
+      unload(r);
+      return NULL;
+    }
+    return r;
+  }
+  return NULL;
+}
+
+static Resource *insert(Resources *res, const char *path, ResourceKind kind) {
+  Resource *r = calloc(1, sizeof(Resource));
+  assert(r);
+  r->path = strdup(path);
+  r->kind = kind;
+  r->state = RESOURCE_QUEUED;
+
+  size_t bucket = bucket_of(path);
+  r->next = res->buckets[bucket];
+  res->buckets[bucket] = r;
+
+  return r;
+}
+
+// Reads and decodes on any thread, touching nothing but `r`
+static void decode(const Resources *res, Resource *r) {
+  if (res->bundle) {
+    BundleFile file;
+    if (bundle_find(res->bundle, r->path, &file)) {
+      r->data = (unsigned char *)file.data;
+      r->size = file.size;
+    }
+  } else {
+    char full[4096];
+    snprintf(full, sizeof full, "%s/%s", res->game_path, r->path);
+
+    int size;
+    r->data = LoadFileData(full, &size);
+    r->size = size;
+    r->owns_data = r->data != NULL;
+  }
+
+  if (r->kind != RESOURCE_SOUND || !r->data)
+    return;
+
+  // Sounds keep the PCM, the encoded bytes are done with
+  r->wave = LoadWaveFromMemory(GetFileExtension(r->path), r->data, r->size);
+  if (r->owns_data)
+    UnloadFileData(r->data);
+  r->data = NULL;
+  r->size = 0;
+  r->owns_data = false;
+}
+
+// Hands the decoded data to the audio device, main thread only
+static void finish(Resource *r) {
+  if (r->kind == RESOURCE_FILE) {
+    r->state = r->data ? RESOURCE_READY : RESOURCE_FAILED;
+    r->bytes = r->owns_data ? r->size : 0;
+    return;
+  }
+
+  if (!IsWaveValid(r->wave)) {
+    r->state = RESOURCE_FAILED;
+    return;
+  }
+
+  // Without an audio device (headless) sources are silent and never play
+  if (IsAudioDeviceReady()) {
+    r->sound = LoadSoundFromWave(r->wave);
+    r->bytes = (size_t)r->wave.frameCount * r->wave.channels *
+               r->wave.sampleSize / 8;
+  }
+  UnloadWave(r->wave);
+  r->wave = (Wave){0};
+  r->state = IsSoundValid(r->sound) || !IsAudioDeviceReady()
+                 ? RESOURCE_READY
+                 : RESOURCE_FAILED;
+}
+
+// Finishes decoded entries, at least one, until `deadline`
+static void drain(Resources *res, double deadline) {
+  for (;;) {
+    pthread_mutex_lock(&res->lock);
+    Resource *r = res->decoded_queue;
+    if (r) {
+      res->decoded_queue = r->next_job;
+      if (!res->decoded_queue)
+        res->decoded_tail = NULL;
+    }
+    pthread_mutex_unlock(&res->lock);
+
+    if (!r)
+      return;
+
+    finish(r);
+    if (clock_seconds() >= deadline)
+      return;
+  }
+}
+
+static void *worker_main(void *arg) {
+  Resources *res = arg;
+
+  pthread_mutex_lock(&res->lock);
+  for (;;) {
+    while (!res->jobs && !res->stop)
+      pthread_cond_wait(&res->wake, &res->lock);
+    if (res->stop)
+      break;
+
+    Resource *r = res->jobs;
+    res->jobs = r->next_job;
+    if (!res->jobs)
+      res->jobs_tail = NULL;
+    pthread_mutex_unlock(&res->lock);
+
+    decode(res, r);
+
+    pthread_mutex_lock(&res->lock);
+    r->state = RESOURCE_DECODED;
+    r->next_job = NULL;
+    if (res->decoded_tail)
+      res->decoded_tail->next_job = r;
+    else
+      res->decoded_queue = r;
+    res->decoded_tail = r;
+    pthread_cond_broadcast(&res->decoded);
+  }
+  pthread_mutex_unlock(&res->lock);
+
+  return NULL;
+}
+
+Resources *resources_init(const char *game_path, const Bundle *bundle) {
+  Resources *res = calloc(1, sizeof(Resources));
+  assert(res);
+
+  res->game_path = game_path;
+  res->bundle = bundle;
+  res->budget = RESOURCES_FRAME_BUDGET_MS / 1000.0;
+
+  pthread_mutex_init(&res->lock, NULL);
+  pthread_cond_init(&res->wake, NULL);
+  pthread_cond_init(&res->decoded, NULL);
+  if (pthread_create(&res->worker, NULL, worker_main, res) != 0)
+    fatal("Failed to start the resource loader thread");
+
+  return res;
+}
+
+void resources_free(Resources *res) {
+  if (!res)
+    return;
+
+  pthread_mutex_lock(&res->lock);
+  res->stop = true;
+  pthread_cond_signal(&res->wake);
+  pthread_mutex_unlock(&res->lock);
+  pthread_join(res->worker, NULL);
+
+  while (res->preloads) {
+    Preload *next = res->preloads->next;
+    free(res->preloads->items);
+    free(res->preloads);
+    res->preloads = next;
+  }
+
+  for (size_t i = 0; i < RESOURCES_BUCKETS; i++) {
+    while (res->buckets[i]) {
+      Resource *next = res->buckets[i]->next;
+      unload(res->buckets[i]);
+      res->buckets[i] = next;
+    }
+  }
+
+  pthread_cond_destroy(&res->decoded);
+  pthread_cond_destroy(&res->wake);
+  pthread_mutex_destroy(&res->lock);
+  free(res);
+}
+
+bool resources_exists(const Resources *res, const char *path) {
+  BundleFile file;
+  if (res->bundle)
+    return bundle_find(res->bundle, path, &file);
+
+  char full[4096];
+  snprintf(full, sizeof full, "%s/%s", res->game_path, path);
+  return FileExists(full);
+}
+
+Resource *resources_acquire(Resources *res, const char *path,
+                            ResourceKind kind) {
+  pthread_mutex_lock(&res->lock);
+  Resource *r = lookup(res, path, kind);
+
+  // A preload has it in flight: wait for the worker, then finish it along
+  // with everything decoded before it
+  bool decoded = false;
+  if (r) {
+    while (r->state == RESOURCE_QUEUED)
+      pthread_cond_wait(&res->decoded, &res->lock);
+    decoded = r->state == RESOURCE_DECODED;
+  }
+  pthread_mutex_unlock(&res->lock);
+
+  if (r) {
+    res->hits++;
+    if (decoded)
+      drain(res, INFINITY);
+  } else {
+    res->misses++;
+    r = insert(res, path, kind);
+    decode(res, r);
+    finish(r);
+  }
+
+  if (r->state == RESOURCE_FAILED) {
+    if (r->refs == 0) {
+      unlink_resource(res, r);
+      unload(r);
+    }
+    return NULL;
+  }
+
+  r->refs++;
+  return r;
+}
+
+void resources_release(Resources *res, Resource *resource) {
+  (void)res;
+  assert(resource->refs > 0);
+  resource->refs--;
+}
+
+void resources_preload(Resources *res, const char *const *paths,
+                       const ResourceKind *kinds, size_t count, int tag) {
+  Preload *preload = malloc(sizeof(Preload));
+  assert(preload);
+  *preload = (Preload){
+      .tag = tag,
+      .items = malloc((count > 0 ? count : 1) * sizeof(Resource *)),
+      .count = count,
+  };
+  assert(preload->items);
+
+  pthread_mutex_lock(&res->lock);
+  for (size_t i = 0; i < count; i++) {
+    Resource *r = lookup(res, paths[i], kinds[i]);
+    if (r) {
+      res->hits++;
+    } else {
+      res->misses++;
+      r = insert(res, paths[i], kinds[i]);
+      if (res->jobs_tail)
+        res->jobs_tail->next_job = r;
+      else
+        res->jobs = r;
+      res->jobs_tail = r;
+    }
+
+    r->refs++;
+    preload->items[i] = r;
+  }
+  pthread_cond_signal(&res->wake);
+  pthread_mutex_unlock(&res->lock);
+
+  // Appended, so preloads complete in the order they were made
+  Preload **link = &res->preloads;
+  while (*link)
+    link = &(*link)->next;
+  *link = preload;
+}
+
+static bool preload_done(const Preload *preload) {
+  for (size_t i = 0; i < preload->count; i++) {
+    ResourceState state = preload->items[i]->state;
+    if (state == RESOURCE_QUEUED || state == RESOURCE_DECODED)
+      return false;
+  }
+  return true;
+}
+
+size_t resources_update(Resources *res, int *tags, size_t max_tags) {
+  if (!res->preloads)
+    return 0;
+
+  drain(res, clock_seconds() + res->budget);
+
+  size_t done = 0;
+  Preload **link = &res->preloads;
+  while (*link && done < max_tags) {
+    Preload *preload = *link;
+
+    pthread_mutex_lock(&res->lock);
+    bool complete = preload_done(preload);
+    pthread_mutex_unlock(&res->lock);
+
+    if (!complete) {
+      link = &preload->next;
+      continue;
+    }
+
+    for (size_t i = 0; i < preload->count; i++)
+      resources_release(res, preload->items[i]);
+
+    tags[done++] = preload->tag;
+    *link = preload->next;
+    free(preload->items);
+    free(preload);
+  }
+
+  return done;
+}
+
+size_t resources_collect(Resources *res) {
+  size_t freed = 0;
+
+  // Entries in flight are held by their preload, so refs == 0 is settled
+  for (size_t i = 0; i < RESOURCES_BUCKETS; i++) {
+    Resource **link = &res->buckets[i];
+    while (*link) {
+      Resource *r = *link;
+      if (r->refs > 0) {
+        link = &r->next;
+        continue;
+      }
+
+      freed += r->bytes;
+      *link = r->next;
+      unload(r);
+    }
+  }
+
+  return freed;
+}
+
+ResourceStats resources_stats(Resources *res) {
+  ResourceStats stats = {.hits = res->hits, .misses = res->misses};
+
+  pthread_mutex_lock(&res->lock);
+  for (size_t i = 0; i < RESOURCES_BUCKETS; i++) {
+    for (Resource *r = res->buckets[i]; r; r = r->next) {
+      stats.bytes += r->bytes;
+      stats.count++;
+      if (r->state == RESOURCE_QUEUED || r->state == RESOURCE_DECODED)
+        stats.pending++;
+    }
+  }
+  pthread_mutex_unlock(&res->lock);
+
+  return stats;
+}
@@ -0,0 +1,103 @@
+#ifndef RESOURCES_H_
+#define RESOURCES_H_
+
+#include "bundle.h"
+#include <pthread.h>
+#include <raylib.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define RESOURCES_BUCKETS 256
+
+// Main thread time per frame spent finishing background loads
+#define RESOURCES_FRAME_BUDGET_MS 2.0
+
+typedef enum {
+  RESOURCE_SOUND, // decoded PCM, shared by sources through sound aliases
+  RESOURCE_FILE,  // the raw bytes, like the encoded data music streams from
+} ResourceKind;
+
+typedef enum {
+  RESOURCE_QUEUED,  // waiting for or on the worker
+  RESOURCE_DECODED, // waiting for the main thread
+  RESOURCE_READY,
+  RESOURCE_FAILED,
+} ResourceState;
+
+typedef struct Resource {
+  char *path; // relative to the game, the cache key
+  ResourceKind kind;
+  ResourceState state; // under Resources.lock until ready or failed
+  int refs;            // handles held by sources, main thread only
+  size_t bytes;        // resident size, 0 for data mapped from a bundle
+
+  // Decoded by the worker
+  unsigned char *data;
+  size_t size;
+  bool owns_data; // false when data points into the bundle
+  Wave wave;
+
+  Sound sound; // RESOURCE_SOUND, uploaded on the main thread
+
+  struct Resource *next;     // in its bucket
+  struct Resource *next_job; // in the work or decoded queue
+} Resource;
+
+typedef struct Preload Preload;
+
+typedef struct {
+  size_t bytes; // resident across all entries
+  size_t hits, misses;
+  size_t count;   // entries, referenced or not
+  size_t pending; // entries still loading
+} ResourceStats;
+
+// Game assets keyed by path. Handles are refcounted, entries nobody holds
+// stay resident for the next acquire until resources_collect. Preloads
+// decode on a worker thread and finish on the main thread in
+// resources_update.
+typedef struct {
+  const char *game_path;
+  const Bundle *bundle; // files are read from here when set
+  double budget;        // seconds per resources_update
+
+  Resource *buckets[RESOURCES_BUCKETS];
+  size_t hits, misses;
+  Preload *preloads;
+
+  pthread_t worker;
+  pthread_mutex_t lock;
+  pthread_cond_t wake, decoded;
+  Resource *jobs, *jobs_tail;             // for the worker
+  Resource *decoded_queue, *decoded_tail; // for the main thread
+  bool stop;
+} Resources;
+
+Resources *resources_init(const char *game_path, const Bundle *bundle);
+void resources_free(Resources *res);
+
+// True when `path` exists, without loading it
+bool resources_exists(const Resources *res, const char *path);
+
+// Returns a handle to a loaded resource, loading it on this thread on a
+// miss and waiting for it when a preload is in flight. Returns NULL when
+// the file is missing or fails to decode.
+Resource *resources_acquire(Resources *res, const char *path,
+                            ResourceKind kind);
+void resources_release(Resources *res, Resource *resource);
+
+// Queues loads of `count` paths, `tag` is handed back by resources_update
+// once every one of them is ready or failed
+void resources_preload(Resources *res, const char *const *paths,
+                       const ResourceKind *kinds, size_t count, int tag);
+
+// Finishes decoded loads until the frame budget runs out. Writes the tags
+// of completed preloads to `tags` and returns how many, up to `max_tags`.
+size_t resources_update(Resources *res, int *tags, size_t max_tags);
+
+// Unloads every entry without handles, returns the bytes freed
+size_t resources_collect(Resources *res);
+
+ResourceStats resources_stats(Resources *res);
+
+#endif // RESOURCES_H_
@@ -0,0 +1,283 @@
+#include "fov.h"
+#include "../colors.h"
+#include "../jobs.h"
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// One step down the VGA intensity ladder, used by fov_shade
+static const unsigned char dim_color[VGA_COLOR_COUNT] = {
+    [VGA_BLACK] = VGA_BLACK,
+    [VGA_BLUE] = VGA_DARK_GRAY,
+    [VGA_GREEN] = VGA_DARK_GRAY,
+    [VGA_CYAN] = VGA_DARK_GRAY,
+    [VGA_RED] = VGA_DARK_GRAY,
+    [VGA_MAGENTA] = VGA_DARK_GRAY,
+    [VGA_BROWN] = VGA_DARK_GRAY,
+    [VGA_LIGHT_GRAY] = VGA_DARK_GRAY,
+    [VGA_DARK_GRAY] = VGA_BLACK,
+    [VGA_LIGHT_BLUE] = VGA_BLUE,
+    [VGA_LIGHT_GREEN] = VGA_GREEN,
+    [VGA_LIGHT_CYAN] = VGA_CYAN,
+    [VGA_LIGHT_RED] = VGA_RED,
+    [VGA_LIGHT_MAGENTA] = VGA_MAGENTA,
+    [VGA_YELLOW] = VGA_BROWN,
+    [VGA_WHITE] = VGA_LIGHT_GRAY,
+};
+
+// A slope num / den (den > 0) from the light, compared exactly
+typedef struct {
+  int num, den;
+} Slope;
+
+// Half-open cell rectangle [x0, x1) x [y0, y1) of the grid
+typedef struct {
+  int x0, y0, x1, y1;
+} FovArea;
+
+// One light being cast into its own buffer covering `bounds`, so lights
+// never share memory while they run
+typedef struct {
+  const ByteGrid *opacity;
+  FovLight light;
+  FovFalloff falloff;
+  int extent;
+  FovArea bounds;
+  int quadrant;
+  unsigned char *area;
+} FovScan;
+
+// Rows scanned out from a light: its radius, capped at the grid's larger
+// side as no cell a light can see into is further. The falloff still
+// follows the radius.
+static int light_extent(const FovLight *light, const ByteGrid *opacity) {
+  int side = opacity->w > opacity->h ? opacity->w : opacity->h;
+  return light->radius < side ? light->radius : side;
+}
+
+// The part of the grid within the light's extent, all it can reach
+static FovArea light_bounds(const FovLight *light, const ByteGrid *opacity) {
+  int e = light_extent(light, opacity);
+  FovArea area = {
+      .x0 = light->x - e > 0 ? light->x - e : 0,
+      .y0 = light->y - e > 0 ? light->y - e : 0,
+      .x1 = light->x + e + 1 < (int)opacity->w ? light->x + e + 1
+                                                : (int)opacity->w,
+      .y1 = light->y + e + 1 < (int)opacity->h ? light->y + e + 1
+                                                : (int)opacity->h,
+  };
+  if (area.x1 < area.x0)
+    area.x1 = area.x0;
+  if (area.y1 < area.y0)
+    area.y1 = area.y0;
+  return area;
+}
+
+static size_t area_size(const FovArea *area) {
+  return (size_t)(area->x1 - area->x0) * (size_t)(area->y1 - area->y0);
+}
+
+static int floor_div(int a, int b) { return a / b - (a % b != 0 && a < 0); }
+
+static int ceil_div(int a, int b) { return a / b + (a % b != 0 && a > 0); }
+
+// Offset from the light of column `col` of the row `depth` cells out in
+// the current quadrant (north, east, south, west)
+static void transform(const FovScan *scan, int depth, int col, int *dx,
+                      int *dy) {
+  switch (scan->quadrant) {
+  case 0:
+    *dx = col, *dy = -depth;
+    break;
+  case 1:
+    *dx = depth, *dy = col;
+    break;
+  case 2:
+    *dx = col, *dy = depth;
+    break;
+  default:
+    *dx = -depth, *dy = col;
+    break;
+  }
+}
+
+// Cells outside the grid block sight
+static bool is_opaque(const FovScan *scan, int dx, int dy) {
+  int x = scan->light.x + dx;
+  int y = scan->light.y + dy;
+  if (x < 0 || y < 0 || x >= (int)scan->opacity->w ||
+      y >= (int)scan->opacity->h)
+    return true;
+  return scan->opacity->data[y * scan->opacity->w + x] != 0;
+}
+
+static void reveal(FovScan *scan, int dx, int dy) {
+  int64_t r = scan->light.radius;
+  int64_t d2 = (int64_t)dx * dx + (int64_t)dy * dy;
+  int x = scan->light.x + dx;
+  int y = scan->light.y + dy;
+  if (x < 0 || y < 0 || x >= (int)scan->opacity->w ||
+      y >= (int)scan->opacity->h || d2 > r * (r + 1))
+    return;
+
+  int value = scan->light.intensity;
+  if (scan->falloff == FOV_FALLOFF_LINEAR) {
+    double d = sqrt((double)d2);
+    value = (int)lround(value * (1.0 - d / (r + 1)));
+    if (value < 1)
+      value = 1;
+  }
+
+  const FovArea *b = &scan->bounds;
+  unsigned char *cell = &scan->area[(size_t)(y - b->y0) * (b->x1 - b->x0) +
+                                    (x - b->x0)];
+  if (value > *cell)
+    *cell = value;
+}
+
+// Scans the row `depth` cells out between two slopes, recursing into the
+// next row for every run of transparent cells
+static void scan_row(FovScan *scan, int depth, Slope start, Slope end) {
+  if (depth > scan->extent)
+    return;
+
+  // Columns whose centers fall within the slopes, ties rounded inwards
+  int min_col = floor_div(2 * depth * start.num + start.den, 2 * start.den);
+  int max_col = ceil_div(2 * depth * end.num - end.den, 2 * end.den);
+
+  int prev = -1; // -1 before the first cell, then whether it was opaque
+  for (int col = min_col; col <= max_col; col++) {
+    int dx, dy;
+    transform(scan, depth, col, &dx, &dy);
+    bool opaque = is_opaque(scan, dx, dy);
+
+    // Floors only when their center is inside the view, for symmetry
+    bool symmetric = col * start.den >= depth * start.num &&
+                     col * end.den <= depth * end.num;
+    if (opaque || symmetric)
+      reveal(scan, dx, dy);
+
+    Slope edge = {2 * col - 1, 2 * depth};
+    if (prev == 1 && !opaque)
+      start = edge;
+    if (prev == 0 && opaque)
+      scan_row(scan, depth + 1, start, edge);
+    prev = opaque;
+  }
+
+  if (prev == 0)
+    scan_row(scan, depth + 1, start, end);
+}
+
+static void cast(FovScan *scan) {
+  reveal(scan, 0, 0);
+  for (scan->quadrant = 0; scan->quadrant < 4; scan->quadrant++)
+    scan_row(scan, 1, (Slope){-1, 1}, (Slope){1, 1});
+}
+
+typedef struct {
+  const ByteGrid *opacity;
+  const FovLight *lights;
+  FovFalloff falloff;
+  unsigned char **areas;
+} FovJob;
+
+static void fov_lights(void *ctx, size_t begin, size_t end) {
+  FovJob *job = ctx;
+
+  for (size_t i = begin; i < end; i++) {
+    FovScan scan = {
+        .opacity = job->opacity,
+        .light = job->lights[i],
+        .falloff = job->falloff,
+        .extent = light_extent(&job->lights[i], job->opacity),
+        .bounds = light_bounds(&job->lights[i], job->opacity),
+        .area = job->areas[i],
+    };
+    cast(&scan);
+  }
+}
+
+void fov_compute(const ByteGrid *opacity, ByteGrid *out,
+                 const FovLight *lights, size_t count, FovFalloff falloff,
+                 size_t threads) {
+  assert(out->w == opacity->w && out->h == opacity->h);
+  bytegrid_fill(out, 0);
+  if (count == 0)
+    return;
+
+  size_t total = 0;
+  for (size_t i = 0; i < count; i++) {
+    assert(lights[i].radius >= 0);
+    FovArea bounds = light_bounds(&lights[i], opacity);
+    total += area_size(&bounds);
+  }
+
+  unsigned char *memory = calloc(total > 0 ? total : 1, 1);
+  unsigned char **areas = malloc(count * sizeof(unsigned char *));
+  assert(memory && areas);
+  for (size_t i = 0, offset = 0; i < count; i++) {
+    FovArea bounds = light_bounds(&lights[i], opacity);
+    areas[i] = memory + offset;
+    offset += area_size(&bounds);
+  }
+
+  FovJob job = {
+      .opacity = opacity,
+      .lights = lights,
+      .falloff = falloff,
+      .areas = areas,
+  };
+  if (count == 1)
+    fov_lights(&job, 0, 1);
+  else
+    jobs_parallel_for(count, threads, fov_lights, &job);
+
+  // Adding up is a fraction of the casting, so it stays on this thread
+  for (size_t i = 0; i < count; i++) {
+    FovArea b = light_bounds(&lights[i], opacity);
+    const unsigned char *value = areas[i];
+
+    for (int y = b.y0; y < b.y1; y++) {
+      unsigned char *cell = &out->data[(size_t)y * out->w + b.x0];
+      for (int x = b.x0; x < b.x1; x++, cell++, value++) {
+        if (*value)
+          *cell = *cell + *value > 255 ? 255 : *cell + *value;
+      }
+    }
+  }
+
+  free(areas);
+  free(memory);
+}
+
+static unsigned char shade_color(unsigned char color, unsigned char level,
+                                 unsigned char dim) {
+  if (color == VGA_TRANSPARENT || level >= dim)
+    return color;
+  return level == 0 ? VGA_BLACK : dim_color[color & 15];
+}
+
+void fov_shade(Grid *grid, const ByteGrid *light, int ox, int oy,
+               unsigned char dim) {
+  for (size_t y = 0; y < light->h; y++) {
+    int gy = oy + (int)y;
+    if (gy < 0 || gy >= (int)grid->h)
+      continue;
+
+    for (size_t x = 0; x < light->w; x++) {
+      int gx = ox + (int)x;
+      unsigned char level = light->data[y * light->w + x];
+      if (gx < 0 || gx >= (int)grid->w || level >= dim)
+        continue;
+
+      Cell cell = *grid_cell(grid, gx, gy);
+      cell.fg = shade_color(cell.fg, level, dim);
+      cell.bg = shade_color(cell.bg, level, dim);
+      grid_set(grid, gx, gy, cell);
+    }
+  }
+}
@@ -0,0 +1,34 @@
+#ifndef FOV_H_
+#define FOV_H_
+
+#include "../bytegrid.h"
+#include "../grid.h"
+#include <stddef.h>
+
+typedef struct {
+  int x, y;                // 0-based cell
+  int radius;              // in cells, the light reaches a circle this wide
+  unsigned char intensity; // at the light, 255 is full
+} FovLight;
+
+typedef enum {
+  FOV_FALLOFF_LINEAR, // fades out towards the radius
+  FOV_FALLOFF_NONE,   // every visible cell gets the full intensity
+} FovFalloff;
+
+// Lights `out` with every light in `lights`, as seen through `opacity`
+// (nonzero bytes block sight, walls themselves are lit). Symmetric
+// shadowcasting: a cell lit from a light would light it in turn. Lights
+// add up, saturating at 255, and are cast in parallel on up to `threads`
+// job threads, 0 uses the whole pool.
+void fov_compute(const ByteGrid *opacity, ByteGrid *out,
+                 const FovLight *lights, size_t count, FovFalloff falloff,
+                 size_t threads);
+
+// Darkens the cells of `grid` under `light` placed at (ox, oy): unlit cells
+// turn black and cells lit below `dim` take darker colors. Transparent
+// colors are kept.
+void fov_shade(Grid *grid, const ByteGrid *light, int ox, int oy,
+               unsigned char dim);
+
+#endif // FOV_H_
@@ -0,0 +1,32 @@
+#ifndef LIFE_H_
+#define LIFE_H_
+
+#include "../bytegrid.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// Life-like birth/survival rule. Bit n of `birth` set means a dead cell with
+// n live neighbors comes alive, bit n of `survive` keeps a live one alive.
+typedef struct {
+  unsigned short birth, survive;
+} LifeRule;
+
+#define LIFE_RULE_CONWAY                                                       \
+  (LifeRule) { .birth = 1 << 3, .survive = 1 << 2 | 1 << 3 }
+
+typedef enum {
+  LIFE_EDGES_WRAP,  // the grid is a torus
+  LIFE_EDGES_CLAMP, // everything outside the grid is dead
+} LifeEdges;
+
+bool life_parse_rule(const char *text, LifeRule *rule);
+
+// Advances `src` one generation into `dst` (any nonzero byte counts as
+// alive, outputs are 0 or 1). When `counts` is given it receives each
+// cell's live neighbor count in `src`; with a NULL `dst` only the counts are
+// computed. Rows are split into bands across `threads` job threads, 0 uses
+// the whole pool. Returns the new population.
+size_t life_step(const ByteGrid *src, ByteGrid *dst, ByteGrid *counts,
+                 LifeRule rule, LifeEdges edges, size_t threads);
+
+#endif // LIFE_H_
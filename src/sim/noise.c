@@ -0,0 +1,315 @@
+#include "noise.h"
+#include "../jobs.h"
+#include <assert.h>
+#include <math.h>
+
+static inline uint64_t rotl(uint64_t x, int k) {
+  return (x << k) | (x >> (64 - k));
+}
+
+static uint64_t splitmix64(uint64_t *state) {
+  uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+void noise_rng_seed(NoiseRng *rng, uint64_t seed) {
+  for (int i = 0; i < 4; i++)
+    rng->s[i] = splitmix64(&seed);
+}
+
+uint64_t noise_rng_next(NoiseRng *rng) {
+  uint64_t *s = rng->s;
+  uint64_t result = rotl(s[1] * 5, 7) * 9;
+  uint64_t t = s[1] << 17;
+
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = rotl(s[3], 45);
+
+  return result;
+}
+
+double noise_rng_double(NoiseRng *rng) {
+  // The top 53 bits fill a double's mantissa exactly
+  return (noise_rng_next(rng) >> 11) * 0x1.0p-53;
+}
+
+int64_t noise_rng_range(NoiseRng *rng, int64_t lo, int64_t hi) {
+  uint64_t span = (uint64_t)hi - (uint64_t)lo + 1;
+  if (span == 0)
+    return (int64_t)noise_rng_next(rng); // the full 64-bit range
+
+  // Rejects the top partial copy of [0, span) so every value is as likely
+  uint64_t limit = UINT64_MAX - UINT64_MAX % span;
+  uint64_t x;
+  do {
+    x = noise_rng_next(rng);
+  } while (x >= limit);
+
+  return lo + (int64_t)(x % span);
+}
+
+void noise_init(Noise *noise, uint64_t seed) {
+  NoiseRng rng;
+  noise_rng_seed(&rng, seed);
+
+  for (int i = 0; i < 256; i++)
+    noise->perm[i] = i;
+  for (int i = 255; i > 0; i--) {
+    int j = noise_rng_range(&rng, 0, i);
+    unsigned char tmp = noise->perm[i];
+    noise->perm[i] = noise->perm[j];
+    noise->perm[j] = tmp;
+  }
+
+  // Doubled so hashes of lattice corners never need wrapping
+  for (int i = 0; i < 256; i++)
+    noise->perm[256 + i] = noise->perm[i];
+}
+
+// Gradients to the edge midpoints of a cube, 2D uses their x and y
+static const float grad3[12][3] = {
+    {1, 1, 0},  {-1, 1, 0},  {1, -1, 0},  {-1, -1, 0}, {1, 0, 1},  {-1, 0, 1},
+    {1, 0, -1}, {-1, 0, -1}, {0, 1, 1},   {0, -1, 1},  {0, 1, -1}, {0, -1, -1},
+};
+
+static inline int fast_floor(float x) {
+  int i = (int)x;
+  return x < i ? i - 1 : i;
+}
+
+// Contribution of one simplex corner at offset (x, y) with gradient `g`
+static inline float corner2(int g, float x, float y) {
+  float t = 0.5f - x * x - y * y;
+  if (t < 0.0f)
+    return 0.0f;
+  t *= t;
+  return t * t * (grad3[g][0] * x + grad3[g][1] * y);
+}
+
+float noise_simplex2(const Noise *noise, float x, float y) {
+  const float F2 = 0.36602540378f; // (sqrt(3) - 1) / 2
+  const float G2 = 0.21132486540f; // (3 - sqrt(3)) / 6
+  const unsigned char *perm = noise->perm;
+
+  // Skew to find the simplex cell, then unskew back to offsets in it
+  float s = (x + y) * F2;
+  int i = fast_floor(x + s);
+  int j = fast_floor(y + s);
+  float t = (i + j) * G2;
+  float x0 = x - (i - t);
+  float y0 = y - (j - t);
+
+  // The lower or upper triangle of the skewed square
+  int i1 = x0 > y0;
+  int j1 = !i1;
+
+  float x1 = x0 - i1 + G2;
+  float y1 = y0 - j1 + G2;
+  float x2 = x0 - 1.0f + 2.0f * G2;
+  float y2 = y0 - 1.0f + 2.0f * G2;
+
+  int ii = i & 255;
+  int jj = j & 255;
+  int g0 = perm[ii + perm[jj]] % 12;
+  int g1 = perm[ii + i1 + perm[jj + j1]] % 12;
+  int g2 = perm[ii + 1 + perm[jj + 1]] % 12;
+
+  // Scaled so the result spans about [-1, 1]
+  return 70.0f *
+         (corner2(g0, x0, y0) + corner2(g1, x1, y1) + corner2(g2, x2, y2));
+}
+
+static inline float corner3(int g, float x, float y, float z) {
+  float t = 0.6f - x * x - y * y - z * z;
+  if (t < 0.0f)
+    return 0.0f;
+  t *= t;
+  return t * t * (grad3[g][0] * x + grad3[g][1] * y + grad3[g][2] * z);
+}
+
+float noise_simplex3(const Noise *noise, float x, float y, float z) {
+  const float F3 = 1.0f / 3.0f;
+  const float G3 = 1.0f / 6.0f;
+  const unsigned char *perm = noise->perm;
+
+  float s = (x + y + z) * F3;
+  int i = fast_floor(x + s);
+  int j = fast_floor(y + s);
+  int k = fast_floor(z + s);
+  float t = (i + j + k) * G3;
+  float x0 = x - (i - t);
+  float y0 = y - (j - t);
+  float z0 = z - (k - t);
+
+  // Which of the six tetrahedra of the skewed cube the point is in, given
+  // by the order of its offsets
+  int i1, j1, k1, i2, j2, k2;
+  if (x0 >= y0) {
+    if (y0 >= z0) {
+      i1 = 1, j1 = 0, k1 = 0, i2 = 1, j2 = 1, k2 = 0;
+    } else if (x0 >= z0) {
+      i1 = 1, j1 = 0, k1 = 0, i2 = 1, j2 = 0, k2 = 1;
+    } else {
+      i1 = 0, j1 = 0, k1 = 1, i2 = 1, j2 = 0, k2 = 1;
+    }
+  } else {
+    if (y0 < z0) {
+      i1 = 0, j1 = 0, k1 = 1, i2 = 0, j2 = 1, k2 = 1;
+    } else if (x0 < z0) {
+      i1 = 0, j1 = 1, k1 = 0, i2 = 0, j2 = 1, k2 = 1;
+    } else {
+      i1 = 0, j1 = 1, k1 = 0, i2 = 1, j2 = 1, k2 = 0;
+    }
+  }
+
+  float x1 = x0 - i1 + G3, y1 = y0 - j1 + G3, z1 = z0 - k1 + G3;
+  float x2 = x0 - i2 + 2.0f * G3, y2 = y0 - j2 + 2.0f * G3,
+        z2 = z0 - k2 + 2.0f * G3;
+  float x3 = x0 - 1.0f + 3.0f * G3, y3 = y0 - 1.0f + 3.0f * G3,
+        z3 = z0 - 1.0f + 3.0f * G3;
+
+  int ii = i & 255;
+  int jj = j & 255;
+  int kk = k & 255;
+  int g0 = perm[ii + perm[jj + perm[kk]]] % 12;
+  int g1 = perm[ii + i1 + perm[jj + j1 + perm[kk + k1]]] % 12;
+  int g2 = perm[ii + i2 + perm[jj + j2 + perm[kk + k2]]] % 12;
+  int g3 = perm[ii + 1 + perm[jj + 1 + perm[kk + 1]]] % 12;
+
+  return 32.0f * (corner3(g0, x0, y0, z0) + corner3(g1, x1, y1, z1) +
+                  corner3(g2, x2, y2, z2) + corner3(g3, x3, y3, z3));
+}
+
+static inline float smooth(float t) { return t * t * (3.0f - 2.0f * t); }
+
+static inline float lerp(float a, float b, float t) { return a + (b - a) * t; }
+
+// Lattice value in [-1, 1]
+static inline float lattice2(const unsigned char *perm, int i, int j) {
+  return perm[(i & 255) + perm[j & 255]] * (2.0f / 255.0f) - 1.0f;
+}
+
+static inline float lattice3(const unsigned char *perm, int i, int j, int k) {
+  return perm[(i & 255) + perm[(j & 255) + perm[k & 255]]] *
+             (2.0f / 255.0f) -
+         1.0f;
+}
+
+float noise_value2(const Noise *noise, float x, float y) {
+  int i = fast_floor(x);
+  int j = fast_floor(y);
+  float u = smooth(x - i);
+  float v = smooth(y - j);
+
+  float a = lerp(lattice2(noise->perm, i, j), lattice2(noise->perm, i + 1, j),
+                 u);
+  float b = lerp(lattice2(noise->perm, i, j + 1),
+                 lattice2(noise->perm, i + 1, j + 1), u);
+  return lerp(a, b, v);
+}
+
+float noise_value3(const Noise *noise, float x, float y, float z) {
+  int i = fast_floor(x);
+  int j = fast_floor(y);
+  int k = fast_floor(z);
+  float u = smooth(x - i);
+  float v = smooth(y - j);
+  float w = smooth(z - k);
+  const unsigned char *p = noise->perm;
+
+  float a = lerp(lattice3(p, i, j, k), lattice3(p, i + 1, j, k), u);
+  float b = lerp(lattice3(p, i, j + 1, k), lattice3(p, i + 1, j + 1, k), u);
+  float c = lerp(lattice3(p, i, j, k + 1), lattice3(p, i + 1, j, k + 1), u);
+  float d = lerp(lattice3(p, i, j + 1, k + 1),
+                 lattice3(p, i + 1, j + 1, k + 1), u);
+  return lerp(lerp(a, b, v), lerp(c, d, v), w);
+}
+
+static float octave(const Noise *noise, const NoiseParams *params, float x,
+                    float y, float z) {
+  if (params->kind == NOISE_VALUE) {
+    return params->volume ? noise_value3(noise, x, y, z)
+                          : noise_value2(noise, x, y);
+  }
+  return params->volume ? noise_simplex3(noise, x, y, z)
+                        : noise_simplex2(noise, x, y);
+}
+
+float noise_sample(const Noise *noise, const NoiseParams *params, float x,
+                   float y) {
+  float f = params->frequency;
+  float z = params->z * f;
+  x *= f;
+  y *= f;
+
+  if (params->fractal == NOISE_FRACTAL_NONE)
+    return octave(noise, params, x, y, z);
+
+  float sum = 0.0f;
+  float amplitude = 1.0f;
+  float total = 0.0f;
+  for (int i = 0; i < params->octaves; i++) {
+    // Each octave is shifted so their lattices do not line up at the origin
+    float n =
+        octave(noise, params, x + i * 31.7f, y + i * 17.3f, z + i * 7.9f);
+    if (params->fractal == NOISE_FRACTAL_RIDGED) {
+      n = 1.0f - fabsf(n);
+      n = n * n * 2.0f - 1.0f;
+    }
+
+    sum += n * amplitude;
+    total += amplitude;
+    amplitude *= params->gain;
+    x *= params->lacunarity;
+    y *= params->lacunarity;
+    z *= params->lacunarity;
+  }
+
+  return total > 0.0f ? sum / total : 0.0f;
+}
+
+typedef struct {
+  const Noise *noise;
+  const NoiseParams *params;
+  ByteGrid *out;
+  size_t x, y, w;
+  float ox, oy;
+} NoiseJob;
+
+static void noise_band(void *ctx, size_t y0, size_t y1) {
+  NoiseJob *job = ctx;
+
+  for (size_t y = y0; y < y1; y++) {
+    unsigned char *row = &job->out->data[(job->y + y) * job->out->w + job->x];
+    for (size_t x = 0; x < job->w; x++) {
+      float n =
+          noise_sample(job->noise, job->params, job->ox + x, job->oy + y);
+      float v = (n + 1.0f) * 127.5f;
+      row[x] = v <= 0.0f ? 0 : v >= 255.0f ? 255 : (unsigned char)(v + 0.5f);
+    }
+  }
+}
+
+void noise_fill(const Noise *noise, const NoiseParams *params, ByteGrid *out,
+                size_t x, size_t y, size_t w, size_t h, float ox, float oy) {
+  assert(x + w <= out->w && y + h <= out->h);
+
+  NoiseJob job = {
+      .noise = noise,
+      .params = params,
+      .out = out,
+      .x = x,
+      .y = y,
+      .w = w,
+      .ox = ox,
+      .oy = oy,
+  };
+
+  jobs_parallel_for(h, 0, noise_band, &job);
+}
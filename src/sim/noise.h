@@ -0,0 +1,77 @@
+#ifndef NOISE_H_
+#define NOISE_H_
+
+#include "../bytegrid.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// xoshiro256**, seeded through splitmix64 so any seed (0 included) works
+typedef struct {
+  uint64_t s[4];
+} NoiseRng;
+
+void noise_rng_seed(NoiseRng *rng, uint64_t seed);
+uint64_t noise_rng_next(NoiseRng *rng);
+
+// Uniform in [0, 1)
+double noise_rng_double(NoiseRng *rng);
+
+// Uniform in [lo, hi], unbiased
+int64_t noise_rng_range(NoiseRng *rng, int64_t lo, int64_t hi);
+
+typedef enum {
+  NOISE_SIMPLEX,
+  NOISE_VALUE, // blockier and cheaper, smoothstepped lattice values
+} NoiseKind;
+
+typedef enum {
+  NOISE_FRACTAL_NONE,
+  NOISE_FRACTAL_FBM,    // octaves summed, each finer and fainter
+  NOISE_FRACTAL_RIDGED, // octaves folded into sharp crests, for mountains
+} NoiseFractal;
+
+typedef struct {
+  NoiseKind kind;
+  NoiseFractal fractal;
+  uint64_t seed;
+  int octaves;
+  float frequency;  // of the first octave, in features per cell
+  float lacunarity; // frequency multiplier per octave
+  float gain;       // amplitude multiplier per octave
+
+  bool volume; // 3D noise sliced at `z`, otherwise 2D
+  float z;
+} NoiseParams;
+
+#define NOISE_PARAMS_DEFAULT                                                   \
+  (NoiseParams) {                                                              \
+    .kind = NOISE_SIMPLEX, .fractal = NOISE_FRACTAL_NONE, .octaves = 4,        \
+    .frequency = 0.05f, .lacunarity = 2.0f, .gain = 0.5f                       \
+  }
+
+// Permutation table shuffled from a seed, the only state noise depends on
+typedef struct {
+  unsigned char perm[512];
+} Noise;
+
+void noise_init(Noise *noise, uint64_t seed);
+
+// Single octaves in about [-1, 1]
+float noise_simplex2(const Noise *noise, float x, float y);
+float noise_simplex3(const Noise *noise, float x, float y, float z);
+float noise_value2(const Noise *noise, float x, float y);
+float noise_value3(const Noise *noise, float x, float y, float z);
+
+// `params` at cell (x, y), in [-1, 1]
+float noise_sample(const Noise *noise, const NoiseParams *params, float x,
+                   float y);
+
+// Fills the w x h region of `out` at (x, y) with noise mapped to 0-255.
+// Cell (cx, cy) of the region samples the noise at (ox + cx, oy + cy), so
+// neighboring regions filled with matching offsets line up. Rows are split
+// into bands across the job pool.
+void noise_fill(const Noise *noise, const NoiseParams *params, ByteGrid *out,
+                size_t x, size_t y, size_t w, size_t h, float ox, float oy);
+
+#endif // NOISE_H_
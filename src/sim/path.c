@@ -0,0 +1,402 @@
+#include "path.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NOT_QUEUED UINT32_MAX
+
+// Cardinal moves first, so 4-way searches use the first four
+static const int move_dx[8] = {1, -1, 0, 0, 1, 1, -1, -1};
+static const int move_dy[8] = {0, 0, 1, -1, 1, -1, 1, -1};
+
+static int move_count(PathMoves moves) {
+  return moves == PATH_MOVES_DIAGONAL ? 8 : 4;
+}
+
+// The cell move `m` from `cell` lands on, false when it leaves the grid.
+// With `costs` a diagonal move past a blocked corner is refused as well.
+static bool neighbor(size_t w, size_t h, const unsigned char *costs,
+                     size_t cell, int m, size_t *to) {
+  size_t x = cell % w;
+  size_t y = cell / w;
+  long nx = (long)x + move_dx[m];
+  long ny = (long)y + move_dy[m];
+  if (nx < 0 || ny < 0 || nx >= (long)w || ny >= (long)h)
+    return false;
+  if (costs && m >= 4 && (!costs[y * w + nx] || !costs[ny * w + x]))
+    return false;
+
+  *to = ny * w + nx;
+  return true;
+}
+
+// Price of entering a cell of cost `cost` with move `m`
+static uint32_t step_cost(unsigned char cost, int m) {
+  return cost * (m < 4 ? PATH_CARDINAL_STEP : PATH_DIAGONAL_STEP);
+}
+
+static void heap_init(PathHeap *heap, size_t n) {
+  heap->cells = malloc(n * sizeof(uint32_t));
+  heap->slots = malloc(n * sizeof(uint32_t));
+  assert(heap->cells && heap->slots);
+  memset(heap->slots, 0xFF, n * sizeof(uint32_t));
+  heap->count = 0;
+}
+
+static void heap_free(PathHeap *heap) {
+  free(heap->cells);
+  free(heap->slots);
+}
+
+static void heap_place(PathHeap *heap, size_t i, uint32_t cell) {
+  heap->cells[i] = cell;
+  heap->slots[cell] = i;
+}
+
+static void heap_up(PathHeap *heap, const uint32_t *keys, size_t i) {
+  uint32_t cell = heap->cells[i];
+  while (i > 0) {
+    size_t parent = (i - 1) / 2;
+    if (keys[heap->cells[parent]] <= keys[cell])
+      break;
+    heap_place(heap, i, heap->cells[parent]);
+    i = parent;
+  }
+  heap_place(heap, i, cell);
+}
+
+static void heap_down(PathHeap *heap, const uint32_t *keys, size_t i) {
+  uint32_t cell = heap->cells[i];
+  for (;;) {
+    size_t child = 2 * i + 1;
+    if (child >= heap->count)
+      break;
+    if (child + 1 < heap->count &&
+        keys[heap->cells[child + 1]] < keys[heap->cells[child]])
+      child++;
+    if (keys[cell] <= keys[heap->cells[child]])
+      break;
+    heap_place(heap, i, heap->cells[child]);
+    i = child;
+  }
+  heap_place(heap, i, cell);
+}
+
+// Queues `cell`, or moves it up when it is queued and its key decreased
+static void heap_push(PathHeap *heap, const uint32_t *keys, uint32_t cell) {
+  size_t i = heap->slots[cell];
+  if (i == NOT_QUEUED) {
+    i = heap->count++;
+    heap->cells[i] = cell;
+  }
+  heap_up(heap, keys, i);
+}
+
+static uint32_t heap_pop(PathHeap *heap, const uint32_t *keys) {
+  uint32_t top = heap->cells[0];
+  heap->slots[top] = NOT_QUEUED;
+
+  uint32_t last = heap->cells[--heap->count];
+  if (heap->count > 0) {
+    heap->cells[0] = last;
+    heap_down(heap, keys, 0);
+  }
+
+  return top;
+}
+
+// Empties the heap in O(queued cells), leaving every slot NOT_QUEUED
+static void heap_clear(PathHeap *heap) {
+  for (size_t i = 0; i < heap->count; i++)
+    heap->slots[heap->cells[i]] = NOT_QUEUED;
+  heap->count = 0;
+}
+
+static void arena_reserve(PathArena *arena, size_t n) {
+  if (n <= arena->capacity)
+    return;
+
+  path_arena_free(arena);
+  heap_init(&arena->heap, n);
+  arena->g = malloc(n * sizeof(uint32_t));
+  arena->f = malloc(n * sizeof(uint32_t));
+  arena->parent = malloc(n * sizeof(uint32_t));
+  arena->stamp = calloc(n, sizeof(uint32_t));
+  arena->path = malloc(n * sizeof(uint32_t));
+  assert(arena->g && arena->f && arena->parent && arena->stamp && arena->path);
+  arena->capacity = n;
+}
+
+void path_arena_free(PathArena *arena) {
+  if (arena->capacity > 0)
+    heap_free(&arena->heap);
+  free(arena->g);
+  free(arena->f);
+  free(arena->parent);
+  free(arena->stamp);
+  free(arena->path);
+  *arena = (PathArena){0};
+}
+
+// Cheapest possible cost from `a` to `b` when every cell costs 1, which
+// never overestimates and keeps A* optimal without a closed set
+static uint32_t heuristic(size_t w, PathMoves moves, size_t a, size_t b) {
+  size_t ax = a % w, ay = a / w;
+  size_t bx = b % w, by = b / w;
+  uint32_t dx = ax > bx ? ax - bx : bx - ax;
+  uint32_t dy = ay > by ? ay - by : by - ay;
+
+  if (moves == PATH_MOVES_CARDINAL)
+    return (dx + dy) * PATH_CARDINAL_STEP;
+
+  uint32_t lo = dx < dy ? dx : dy;
+  uint32_t hi = dx < dy ? dy : dx;
+  return hi * PATH_CARDINAL_STEP +
+         lo * (PATH_DIAGONAL_STEP - PATH_CARDINAL_STEP);
+}
+
+size_t path_find(PathArena *arena, const ByteGrid *costs, PathMoves moves,
+                 size_t start, size_t goal, uint32_t *cost) {
+  size_t w = costs->w;
+  size_t n = w * costs->h;
+  const unsigned char *c = costs->data;
+  if (start != goal && !c[goal])
+    return 0;
+
+  arena_reserve(arena, n);
+  if (++arena->generation == 0) {
+    memset(arena->stamp, 0, arena->capacity * sizeof(uint32_t));
+    arena->generation = 1;
+  }
+  uint32_t gen = arena->generation;
+
+  arena->g[start] = 0;
+  arena->f[start] = heuristic(w, moves, start, goal);
+  arena->parent[start] = start;
+  arena->stamp[start] = gen;
+  heap_push(&arena->heap, arena->f, start);
+
+  bool found = false;
+  while (arena->heap.count > 0) {
+    uint32_t cell = heap_pop(&arena->heap, arena->f);
+    if (cell == goal) {
+      found = true;
+      break;
+    }
+
+    for (int m = 0; m < move_count(moves); m++) {
+      size_t next;
+      if (!neighbor(w, costs->h, c, cell, m, &next) || !c[next])
+        continue;
+
+      uint64_t g = (uint64_t)arena->g[cell] + step_cost(c[next], m);
+      uint64_t f = g + heuristic(w, moves, next, goal);
+      if (f >= PATH_UNREACHABLE ||
+          (arena->stamp[next] == gen && g >= arena->g[next]))
+        continue;
+
+      arena->g[next] = g;
+      arena->f[next] = f;
+      arena->parent[next] = cell;
+      arena->stamp[next] = gen;
+      heap_push(&arena->heap, arena->f, next);
+    }
+  }
+  heap_clear(&arena->heap);
+
+  if (!found)
+    return 0;
+
+  size_t len = 1;
+  for (size_t cell = goal; cell != start; cell = arena->parent[cell])
+    len++;
+  for (size_t i = len, cell = goal; i > 0; cell = arena->parent[cell])
+    arena->path[--i] = cell;
+
+  if (cost)
+    *cost = arena->g[goal];
+  return len;
+}
+
+PathMap *path_map_init(size_t w, size_t h, PathMoves moves) {
+  PathMap *map = calloc(1, sizeof(PathMap));
+  assert(map);
+
+  size_t n = w * h;
+  map->w = w;
+  map->h = h;
+  map->moves = moves;
+  map->dist = malloc(n * sizeof(uint32_t));
+  map->costs = calloc(n, 1);
+  map->is_source = calloc(n, 1);
+  // Each cell is invalidated at most once as a dependent and once as a
+  // changed cell
+  map->work = malloc(4 * n * sizeof(uint32_t));
+  assert(map->dist && map->costs && map->is_source && map->work);
+  memset(map->dist, 0xFF, n * sizeof(uint32_t));
+  heap_init(&map->heap, n);
+
+  return map;
+}
+
+void path_map_free(PathMap *map) {
+  heap_free(&map->heap);
+  free(map->dist);
+  free(map->costs);
+  free(map->is_source);
+  free(map->work);
+  free(map);
+}
+
+// Dijkstra from the cells queued in map->heap. Distances grow away from the
+// sources by the cost of entering the cell one step closer to them.
+static void propagate(PathMap *map) {
+  while (map->heap.count > 0) {
+    uint32_t cell = heap_pop(&map->heap, map->dist);
+    if (!map->costs[cell])
+      continue; // a blocked source, nothing can step onto it
+
+    for (int m = 0; m < move_count(map->moves); m++) {
+      size_t next;
+      if (!neighbor(map->w, map->h, map->costs, cell, m, &next) ||
+          !map->costs[next])
+        continue;
+
+      uint64_t d = (uint64_t)map->dist[cell] + step_cost(map->costs[cell], m);
+      if (d < map->dist[next]) {
+        map->dist[next] = d;
+        heap_push(&map->heap, map->dist, next);
+      }
+    }
+  }
+}
+
+void path_map_compute(PathMap *map, const ByteGrid *costs,
+                      const uint32_t *sources, size_t count) {
+  size_t n = map->w * map->h;
+  assert(costs->w == map->w && costs->h == map->h);
+
+  memcpy(map->costs, costs->data, n);
+  memset(map->dist, 0xFF, n * sizeof(uint32_t));
+  memset(map->is_source, 0, n);
+
+  for (size_t i = 0; i < count; i++) {
+    map->is_source[sources[i]] = 1;
+    map->dist[sources[i]] = 0;
+    heap_push(&map->heap, map->dist, sources[i]);
+  }
+
+  propagate(map);
+}
+
+// Appends `cell` to the work list with its distance, which is forgotten.
+// Cells without a distance are only added when `force`d.
+static size_t invalidate(PathMap *map, size_t cell, size_t count,
+                         bool force) {
+  if (!force && (map->is_source[cell] || map->dist[cell] == PATH_UNREACHABLE))
+    return count;
+
+  map->work[2 * count] = cell;
+  map->work[2 * count + 1] = map->dist[cell];
+  map->dist[cell] = PATH_UNREACHABLE;
+  return count + 1;
+}
+
+size_t path_map_update(PathMap *map, const ByteGrid *costs) {
+  size_t n = map->w * map->h;
+  int moves = move_count(map->moves);
+  size_t changed = 0;
+  size_t count = 0;
+  assert(costs->w == map->w && costs->h == map->h);
+
+  // A changed cell and its neighbors, which may have stepped onto it or
+  // past it diagonally
+  for (size_t cell = 0; cell < n; cell++) {
+    if (map->costs[cell] == costs->data[cell])
+      continue;
+
+    map->costs[cell] = costs->data[cell];
+    changed++;
+    count = invalidate(map, cell, count, true);
+    for (int m = 0; m < 8; m++) {
+      size_t next;
+      if (neighbor(map->w, map->h, NULL, cell, m, &next))
+        count = invalidate(map, next, count, false);
+    }
+  }
+
+  if (changed == 0)
+    return 0;
+
+  // Then every cell whose distance came through an invalidated one. The
+  // list grows while it is walked.
+  for (size_t i = 0; i < count; i++) {
+    size_t cell = map->work[2 * i];
+    uint64_t old = map->work[2 * i + 1];
+    if (old == PATH_UNREACHABLE)
+      continue;
+
+    for (int m = 0; m < moves; m++) {
+      size_t next;
+      if (neighbor(map->w, map->h, NULL, cell, m, &next) &&
+          map->dist[next] == old + step_cost(map->costs[cell], m))
+        count = invalidate(map, next, count, false);
+    }
+  }
+
+  // Reseed the invalidated cells from their neighbors that kept a distance
+  // and let Dijkstra settle the rest
+  for (size_t i = 0; i < count; i++) {
+    size_t cell = map->work[2 * i];
+
+    if (map->is_source[cell]) {
+      map->dist[cell] = 0;
+      heap_push(&map->heap, map->dist, cell);
+      continue;
+    }
+    if (!map->costs[cell])
+      continue;
+
+    uint64_t best = PATH_UNREACHABLE;
+    for (int m = 0; m < moves; m++) {
+      size_t next;
+      if (!neighbor(map->w, map->h, map->costs, cell, m, &next) ||
+          map->dist[next] == PATH_UNREACHABLE || !map->costs[next])
+        continue;
+
+      uint64_t d = (uint64_t)map->dist[next] + step_cost(map->costs[next], m);
+      if (d < best)
+        best = d;
+    }
+
+    if (best < PATH_UNREACHABLE) {
+      map->dist[cell] = best;
+      heap_push(&map->heap, map->dist, cell);
+    }
+  }
+
+  propagate(map);
+
+  return changed;
+}
+
+bool path_map_next(const PathMap *map, size_t cell, size_t *next) {
+  if (map->dist[cell] == 0 || map->dist[cell] == PATH_UNREACHABLE)
+    return false;
+
+  uint64_t best = PATH_UNREACHABLE;
+  for (int m = 0; m < move_count(map->moves); m++) {
+    size_t to;
+    if (!neighbor(map->w, map->h, map->costs, cell, m, &to) ||
+        map->dist[to] >= map->dist[cell] || !map->costs[to])
+      continue;
+
+    uint64_t d = (uint64_t)map->dist[to] + step_cost(map->costs[to], m);
+    if (d < best) {
+      best = d;
+      *next = to;
+    }
+  }
+
+  return best < PATH_UNREACHABLE;
+}
@@ -0,0 +1,77 @@
+#ifndef PATH_H_
+#define PATH_H_
+
+#include "../bytegrid.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Cost grids hold the price of entering each cell, 0 blocks it. Distances
+// are in tenths of a cardinal step onto a cell of cost 1, so diagonal steps
+// can cost about sqrt(2) times as much while staying integers.
+#define PATH_CARDINAL_STEP 10
+#define PATH_DIAGONAL_STEP 14
+
+#define PATH_UNREACHABLE UINT32_MAX
+
+typedef enum {
+  PATH_MOVES_CARDINAL, // 4-way
+  PATH_MOVES_DIAGONAL, // 8-way, never cutting past a blocked corner
+} PathMoves;
+
+// Indexed binary min-heap of cells ordered by a key array, sized for a whole
+// grid up front so searches never allocate
+typedef struct {
+  uint32_t *cells;
+  uint32_t *slots; // heap position of every cell, UINT32_MAX when out
+  size_t count;
+} PathHeap;
+
+// Reusable scratch memory of path_find, grown to the largest grid searched
+typedef struct {
+  size_t capacity;
+  PathHeap heap;
+  uint32_t *g, *f, *parent;
+  uint32_t *stamp; // g, f and parent are valid where stamp == generation
+  uint32_t generation;
+  uint32_t *path; // the last path found, start first
+} PathArena;
+
+// Multi-source Dijkstra map: the cost of the cheapest path from every cell
+// to the nearest source. Stepping downhill with path_map_next from any cell
+// leads to a source, so one map steers any number of agents (a flow field).
+typedef struct {
+  size_t w, h;
+  PathMoves moves;
+  uint32_t *dist;
+  unsigned char *costs; // the costs the distances were computed with
+  unsigned char *is_source;
+  PathHeap heap;
+  uint32_t *work; // (cell, old distance) pairs invalidated by an update
+} PathMap;
+
+void path_arena_free(PathArena *arena);
+
+// A* from `start` to `goal` (cell indices). Returns the number of cells on
+// the path, written to arena->path including both ends, or 0 when there is
+// none. `cost` receives its total in distance units.
+size_t path_find(PathArena *arena, const ByteGrid *costs, PathMoves moves,
+                 size_t start, size_t goal, uint32_t *cost);
+
+PathMap *path_map_init(size_t w, size_t h, PathMoves moves);
+void path_map_free(PathMap *map);
+
+// Computes every distance from scratch towards `sources` (cell indices)
+void path_map_compute(PathMap *map, const ByteGrid *costs,
+                      const uint32_t *sources, size_t count);
+
+// Brings the distances up to date with `costs` after a few cells changed,
+// repairing only the part of the map that depended on them. Returns the
+// number of changed cells.
+size_t path_map_update(PathMap *map, const ByteGrid *costs);
+
+// The neighbor of `cell` one step closer to a source, false at a source or
+// where no source is reachable
+bool path_map_next(const PathMap *map, size_t cell, size_t *next);
+
+#endif // PATH_H_
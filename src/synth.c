@@ -0,0 +1,315 @@
+#include "synth.h"
+#include "slog.h"
+#include <assert.h>
+#include <ctype.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+const char *const synth_wave_names[SYNTH_WAVE_COUNT + 1] = {
+#define X(_, name) name,
+    SYNTH_WAVES(X)
+#undef X
+        NULL,
+};
+
+// raylib's stream callbacks take no user pointer, so the one mixer the
+// callback fills is global
+static Synth *active_synth;
+
+// Saturates, so a math.huge duration holds for as long as it can be counted
+static uint32_t seconds_to_samples(float seconds, int sample_rate) {
+  double samples = (double)seconds * sample_rate;
+  if (!(samples > 0.0))
+    return 0;
+  return samples < UINT32_MAX ? (uint32_t)samples : UINT32_MAX;
+}
+
+// Starts `note`, or releases on a rest. The level carries over so a
+// retrigger does not click.
+static void trigger(SynthChannel *ch, SynthNote note, int sample_rate) {
+  if (note.freq <= 0.0f) {
+    if (ch->stage != SYNTH_ENV_OFF)
+      ch->stage = SYNTH_ENV_RELEASE;
+    return;
+  }
+
+  ch->note = note;
+  ch->held_left = seconds_to_samples(note.duration, sample_rate);
+  ch->stage = SYNTH_ENV_ATTACK;
+}
+
+static void advance_sequence(SynthChannel *ch, int sample_rate) {
+  if (!ch->sequencing || ch->step_left-- > 0)
+    return;
+
+  if (ch->step == ch->step_count && ch->loop)
+    ch->step = 0;
+
+  if (ch->step == ch->step_count) {
+    ch->sequencing = false;
+    return;
+  }
+
+  SynthNote note = ch->steps[ch->step++];
+  trigger(ch, note, sample_rate);
+
+  // This sample is the first of the step
+  uint32_t samples = seconds_to_samples(note.duration, sample_rate);
+  ch->step_left = samples > 0 ? samples - 1 : 0;
+}
+
+// Advances the ADSR envelope by one sample and returns its level
+static float envelope(SynthChannel *ch, int sample_rate) {
+  const SynthPatch *p = &ch->patch;
+
+  if (ch->stage != SYNTH_ENV_OFF && ch->stage != SYNTH_ENV_RELEASE) {
+    if (ch->held_left == 0)
+      ch->stage = SYNTH_ENV_RELEASE;
+    else
+      ch->held_left--;
+  }
+
+  switch (ch->stage) {
+  case SYNTH_ENV_OFF:
+    return 0.0f;
+  case SYNTH_ENV_ATTACK:
+    ch->level += p->attack > 0.0f ? 1.0f / (p->attack * sample_rate) : 1.0f;
+    if (ch->level >= 1.0f) {
+      ch->level = 1.0f;
+      ch->stage = SYNTH_ENV_DECAY;
+    }
+    break;
+  case SYNTH_ENV_DECAY:
+    ch->level -= p->decay > 0.0f
+                     ? (1.0f - p->sustain) / (p->decay * sample_rate)
+                     : 1.0f;
+    if (ch->level <= p->sustain) {
+      ch->level = p->sustain;
+      ch->stage = SYNTH_ENV_SUSTAIN;
+    }
+    break;
+  case SYNTH_ENV_SUSTAIN:
+    ch->level = p->sustain;
+    break;
+  case SYNTH_ENV_RELEASE:
+    // The full-scale rate, so a release from a quiet sustain is shorter
+    ch->level -= p->release > 0.0f ? 1.0f / (p->release * sample_rate) : 1.0f;
+    if (ch->level <= 0.0f) {
+      ch->level = 0.0f;
+      ch->stage = SYNTH_ENV_OFF;
+    }
+    break;
+  }
+
+  return ch->level;
+}
+
+static float oscillate(SynthChannel *ch, int sample_rate) {
+  float out;
+  switch (ch->patch.wave) {
+  case SYNTH_PULSE:
+    out = ch->phase < ch->patch.duty ? 1.0f : -1.0f;
+    break;
+  case SYNTH_TRIANGLE:
+    out = 4.0f * fabsf(ch->phase - 0.5f) - 1.0f;
+    break;
+  case SYNTH_NOISE:
+    out = ch->lfsr & 1 ? 1.0f : -1.0f;
+    break;
+  case SYNTH_SQUARE:
+  default:
+    out = ch->phase < 0.5f ? 1.0f : -1.0f;
+    break;
+  }
+
+  ch->phase += ch->note.freq * ch->pitch / sample_rate;
+  if (ch->phase >= 1.0f) {
+    ch->phase -= floorf(ch->phase);
+
+    // Noise steps its shift register once per period, like the NES
+    uint16_t bit = (ch->lfsr ^ (ch->lfsr >> 1)) & 1;
+    ch->lfsr = (ch->lfsr >> 1) | (bit << 14);
+  }
+
+  return out;
+}
+
+void synth_render(SynthChannel *channels, size_t count, float *out,
+                  size_t frames, int sample_rate) {
+  memset(out, 0, frames * 2 * sizeof(float));
+
+  for (size_t c = 0; c < count; c++) {
+    SynthChannel *ch = &channels[c];
+    if (!ch->in_use || (ch->stage == SYNTH_ENV_OFF && !ch->sequencing))
+      continue;
+
+    float gain = ch->volume * SYNTH_CHANNEL_GAIN;
+    float left = fminf(1.0f, 2.0f * (1.0f - ch->pan));
+    float right = fminf(1.0f, 2.0f * ch->pan);
+
+    for (size_t i = 0; i < frames; i++) {
+      advance_sequence(ch, sample_rate);
+      float level = envelope(ch, sample_rate);
+      if (level == 0.0f)
+        continue;
+
+      float sample = oscillate(ch, sample_rate) * level * ch->note.volume;
+      out[2 * i] += sample * gain * left;
+      out[2 * i + 1] += sample * gain * right;
+    }
+  }
+
+  for (size_t i = 0; i < frames * 2; i++)
+    out[i] = fmaxf(-1.0f, fminf(1.0f, out[i]));
+}
+
+static void synth_callback(void *buffer, unsigned int frames) {
+  Synth *synth = active_synth;
+
+  pthread_mutex_lock(&synth->lock);
+  synth_render(synth->channels, SYNTH_MAX_CHANNELS, buffer, frames,
+               SYNTH_SAMPLE_RATE);
+  pthread_mutex_unlock(&synth->lock);
+}
+
+Synth *synth_init(void) {
+  assert(!active_synth);
+
+  Synth *synth = calloc(1, sizeof(Synth));
+  assert(synth);
+  pthread_mutex_init(&synth->lock, NULL);
+
+  synth->stream = LoadAudioStream(SYNTH_SAMPLE_RATE, 32, 2);
+  if (!IsAudioStreamValid(synth->stream)) {
+    error("Failed to open the synth stream");
+    pthread_mutex_destroy(&synth->lock);
+    free(synth);
+    return NULL;
+  }
+
+  active_synth = synth;
+  SetAudioStreamCallback(synth->stream, synth_callback);
+  PlayAudioStream(synth->stream);
+
+  return synth;
+}
+
+void synth_free(Synth *synth) {
+  if (!synth)
+    return;
+
+  UnloadAudioStream(synth->stream);
+  active_synth = NULL;
+  pthread_mutex_destroy(&synth->lock);
+  free(synth);
+}
+
+SynthChannel *synth_channel_new(Synth *synth, SynthPatch patch) {
+  SynthChannel *channel = NULL;
+
+  pthread_mutex_lock(&synth->lock);
+  for (size_t i = 0; i < SYNTH_MAX_CHANNELS && !channel; i++) {
+    if (synth->channels[i].in_use)
+      continue;
+
+    channel = &synth->channels[i];
+    *channel = (SynthChannel){
+        .in_use = true,
+        .patch = patch,
+        .volume = 1.0f,
+        .pitch = 1.0f,
+        .pan = 0.5f,
+        .lfsr = 1,
+    };
+  }
+  pthread_mutex_unlock(&synth->lock);
+
+  return channel;
+}
+
+void synth_channel_free(Synth *synth, SynthChannel *channel) {
+  pthread_mutex_lock(&synth->lock);
+  channel->in_use = false;
+  pthread_mutex_unlock(&synth->lock);
+}
+
+void synth_note(Synth *synth, SynthChannel *channel, SynthNote note) {
+  pthread_mutex_lock(&synth->lock);
+  channel->sequencing = false;
+  trigger(channel, note, SYNTH_SAMPLE_RATE);
+  pthread_mutex_unlock(&synth->lock);
+}
+
+void synth_set_sequence(Synth *synth, SynthChannel *channel,
+                        const SynthNote *steps, size_t count, bool loop) {
+  if (count > SYNTH_MAX_STEPS)
+    count = SYNTH_MAX_STEPS;
+
+  pthread_mutex_lock(&synth->lock);
+  memcpy(channel->steps, steps, count * sizeof(SynthNote));
+  channel->step_count = count;
+  channel->loop = loop;
+  channel->sequencing = false;
+  pthread_mutex_unlock(&synth->lock);
+}
+
+void synth_play(Synth *synth, SynthChannel *channel) {
+  pthread_mutex_lock(&synth->lock);
+  channel->sequencing = channel->step_count > 0;
+  channel->step = 0;
+  channel->step_left = 0;
+  pthread_mutex_unlock(&synth->lock);
+}
+
+void synth_stop(Synth *synth, SynthChannel *channel) {
+  pthread_mutex_lock(&synth->lock);
+  channel->sequencing = false;
+  if (channel->stage != SYNTH_ENV_OFF)
+    channel->stage = SYNTH_ENV_RELEASE;
+  pthread_mutex_unlock(&synth->lock);
+}
+
+void synth_set_params(Synth *synth, SynthChannel *channel, float volume,
+                      float pitch, float pan) {
+  pthread_mutex_lock(&synth->lock);
+  channel->volume = volume;
+  channel->pitch = pitch;
+  channel->pan = pan;
+  pthread_mutex_unlock(&synth->lock);
+}
+
+bool synth_is_playing(Synth *synth, SynthChannel *channel) {
+  pthread_mutex_lock(&synth->lock);
+  bool playing = channel->sequencing || channel->stage != SYNTH_ENV_OFF;
+  pthread_mutex_unlock(&synth->lock);
+
+  return playing;
+}
+
+float synth_note_frequency(const char *name) {
+  // Semitones above C of the letters A to G
+  static const int semitones[] = {9, 11, 0, 2, 4, 5, 7};
+
+  char letter = toupper((unsigned char)name[0]);
+  if (letter < 'A' || letter > 'G')
+    return 0.0f;
+  int semitone = semitones[letter - 'A'];
+
+  const char *c = name + 1;
+  if (*c == '#') {
+    semitone++;
+    c++;
+  } else if (*c == 'b') {
+    semitone--;
+    c++;
+  }
+
+  char *end;
+  long octave = strtol(c, &end, 10);
+  if (end == c || *end != '\0')
+    return 0.0f;
+
+  int midi = (octave + 1) * 12 + semitone;
+  return 440.0f * powf(2.0f, (midi - 69) / 12.0f);
+}
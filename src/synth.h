@@ -0,0 +1,113 @@
+#ifndef SYNTH_H_
+#define SYNTH_H_
+
+#include <pthread.h>
+#include <raylib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SYNTH_SAMPLE_RATE 44100
+#define SYNTH_MAX_CHANNELS 16
+#define SYNTH_MAX_STEPS 256 // notes in one sequence
+
+// Mix level of one channel at full volume, headroom for a few at once
+#define SYNTH_CHANNEL_GAIN 0.25f
+
+#define SYNTH_WAVES(X)                                                         \
+  X(SQUARE, "square")     /* 50% duty cycle */                                 \
+  X(PULSE, "pulse")       /* square with an adjustable duty cycle */           \
+  X(TRIANGLE, "triangle") /* soft, like the NES bass channel */                \
+  X(NOISE, "noise")       /* 15-bit LFSR clocked at the note frequency */
+
+typedef enum {
+#define X(name, _) SYNTH_##name,
+  SYNTH_WAVES(X)
+#undef X
+      SYNTH_WAVE_COUNT
+} SynthWave;
+
+// NULL-terminated, for luaL_checkoption
+extern const char *const synth_wave_names[SYNTH_WAVE_COUNT + 1];
+
+// The sound of a channel. Times are in seconds, sustain is a level.
+typedef struct {
+  SynthWave wave;
+  float duty; // high part of a pulse period, 0 to 1
+  float attack, decay, sustain, release;
+} SynthPatch;
+
+typedef struct {
+  float freq;     // Hz, 0 is a rest
+  float duration; // seconds the note is held, the release follows
+  float volume;   // 0 to 1
+} SynthNote;
+
+typedef enum {
+  SYNTH_ENV_OFF,
+  SYNTH_ENV_ATTACK,
+  SYNTH_ENV_DECAY,
+  SYNTH_ENV_SUSTAIN,
+  SYNTH_ENV_RELEASE,
+} SynthEnvStage;
+
+// One monophonic voice. Written by the main thread and rendered by the
+// audio thread, both under Synth.lock.
+typedef struct {
+  bool in_use;
+  SynthPatch patch;
+  float volume, pitch, pan; // like VoiceParams
+
+  SynthNote steps[SYNTH_MAX_STEPS];
+  size_t step_count;
+  bool loop;
+
+  // Playback state, advanced by synth_render
+  bool sequencing;
+  size_t step;
+  uint32_t step_left; // samples until the next step
+  SynthNote note;     // the sounding note
+  uint32_t held_left; // samples until the release
+  SynthEnvStage stage;
+  float level;
+  float phase;
+  uint16_t lfsr;
+} SynthChannel;
+
+// Every synth source is a channel of one mixed stream, filled from the
+// audio thread through raylib's stream callback
+typedef struct {
+  AudioStream stream;
+  pthread_mutex_t lock;
+  SynthChannel channels[SYNTH_MAX_CHANNELS];
+} Synth;
+
+// Needs an initialized audio device
+Synth *synth_init(void);
+void synth_free(Synth *synth);
+
+// Returns NULL when every channel is taken
+SynthChannel *synth_channel_new(Synth *synth, SynthPatch patch);
+void synth_channel_free(Synth *synth, SynthChannel *channel);
+
+// Plays one note right away, cutting off the sequence
+void synth_note(Synth *synth, SynthChannel *channel, SynthNote note);
+
+// Replaces the sequence, which synth_play starts from the top
+void synth_set_sequence(Synth *synth, SynthChannel *channel,
+                        const SynthNote *steps, size_t count, bool loop);
+void synth_play(Synth *synth, SynthChannel *channel);
+void synth_stop(Synth *synth, SynthChannel *channel);
+void synth_set_params(Synth *synth, SynthChannel *channel, float volume,
+                      float pitch, float pan);
+bool synth_is_playing(Synth *synth, SynthChannel *channel);
+
+// Mixes `frames` stereo frames of every channel into `out`, the callback's
+// work. The caller holds the lock.
+void synth_render(SynthChannel *channels, size_t count, float *out,
+                  size_t frames, int sample_rate);
+
+// Frequency of a note name like "A4", "C#3" or "Bb5", 0 when invalid
+float synth_note_frequency(const char *name);
+
+#endif // SYNTH_H_
@@ -0,0 +1,142 @@
+#include "texture_stream.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+#endif
+
+TextureStream texture_stream_init(size_t w, size_t h) {
+  TextureStream stream = {.w = w, .h = h};
+
+  Image img = GenImageColor(w, h, BLANK);
+  stream.texture = LoadTextureFromImage(img);
+  UnloadImage(img);
+
+#ifdef __linux__
+  glGenBuffers(TEXTURE_STREAM_BUFFERS, stream.pbos);
+  for (int i = 0; i < TEXTURE_STREAM_BUFFERS; i++) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stream.pbos[i]);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, w * h * sizeof(Cell), NULL,
+                 GL_STREAM_DRAW);
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+#else
+  stream.staging = malloc(w * h * sizeof(Cell));
+  assert(stream.staging);
+#endif
+
+  return stream;
+}
+
+// Finds the next run of consecutive dirty rows starting at or after `*y` and
+// the column range covering all of them. Returns false when none is left.
+static bool next_dirty_region(const Grid *grid, size_t *y, size_t *y0,
+                              size_t *y1, size_t *x0, size_t *x1) {
+  while (*y < grid->dirty_y1 && grid->dirty[*y].x0 >= grid->dirty[*y].x1)
+    (*y)++;
+  if (*y >= grid->dirty_y1)
+    return false;
+
+  *y0 = *y;
+  *x0 = grid->dirty[*y].x0;
+  *x1 = grid->dirty[*y].x1;
+
+  for ((*y)++;
+       *y < grid->dirty_y1 && grid->dirty[*y].x0 < grid->dirty[*y].x1;
+       (*y)++) {
+    if (grid->dirty[*y].x0 < *x0)
+      *x0 = grid->dirty[*y].x0;
+    if (grid->dirty[*y].x1 > *x1)
+      *x1 = grid->dirty[*y].x1;
+  }
+
+  *y1 = *y;
+  return true;
+}
+
+// Uploads every region of the grid touched since the last upload.
+// Consecutive dirty rows are merged into one rectangle, so a full redraw is
+// one upload and an unchanged frame is none.
+void texture_stream_upload(TextureStream *stream, Grid *grid) {
+  assert(grid->w == stream->w && grid->h == stream->h);
+  if (!grid_is_dirty(grid))
+    return;
+
+  size_t y = grid->dirty_y0, y0, y1, x0, x1;
+
+#ifdef __linux__
+  // The buffer mirrors the grid rows [dirty_y0, dirty_y1). Whole rows of each
+  // region are copied with one memcpy and GL_UNPACK_ROW_LENGTH lets the
+  // driver pick out the dirty columns.
+  size_t base = grid->dirty_y0 * grid->w;
+  size_t size = (grid->dirty_y1 - grid->dirty_y0) * grid->w * sizeof(Cell);
+
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stream->pbos[stream->next]);
+  stream->next = (stream->next + 1) % TEXTURE_STREAM_BUFFERS;
+
+  // Invalidating lets the driver hand out fresh storage instead of waiting
+  // for a pending upload from the same buffer
+  Cell *mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+                                  GL_MAP_WRITE_BIT |
+                                      GL_MAP_INVALIDATE_BUFFER_BIT);
+  assert(mapped);
+
+  while (next_dirty_region(grid, &y, &y0, &y1, &x0, &x1)) {
+    memcpy(&mapped[y0 * grid->w - base], &grid->cells[y0 * grid->w],
+           (y1 - y0) * grid->w * sizeof(Cell));
+  }
+  glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+  glBindTexture(GL_TEXTURE_2D, stream->texture.id);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, grid->w);
+
+  y = grid->dirty_y0;
+  while (next_dirty_region(grid, &y, &y0, &y1, &x0, &x1)) {
+    size_t offset = (y0 * grid->w + x0 - base) * sizeof(Cell);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x0, y0, x1 - x0, y1 - y0, GL_RGBA,
+                    GL_UNSIGNED_BYTE, (const void *)offset);
+  }
+
+  // raylib assumes the default unpack state
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+#else
+  while (next_dirty_region(grid, &y, &y0, &y1, &x0, &x1)) {
+    Rectangle rec = {x0, y0, x1 - x0, y1 - y0};
+
+    // Full-width regions are contiguous in the grid and uploaded in place
+    if (x0 == 0 && x1 == grid->w) {
+      UpdateTextureRec(stream->texture, rec, &grid->cells[y0 * grid->w]);
+      continue;
+    }
+
+    size_t row_size = (x1 - x0) * sizeof(Cell);
+    for (size_t row = y0; row < y1; row++) {
+      memcpy(&stream->staging[(row - y0) * row_size],
+             &grid->cells[row * grid->w + x0], row_size);
+    }
+    UpdateTextureRec(stream->texture, rec, stream->staging);
+  }
+#endif
+
+  grid_clear_dirty(grid);
+}
+
+void texture_stream_finish(void) {
+#ifdef __linux__
+  glFinish();
+#endif
+}
+
+void texture_stream_free(TextureStream *stream) {
+#ifdef __linux__
+  glDeleteBuffers(TEXTURE_STREAM_BUFFERS, stream->pbos);
+#endif
+  free(stream->staging);
+  UnloadTexture(stream->texture);
+}
@@ -0,0 +1,32 @@
+#ifndef TEXTURE_STREAM_H_
+#define TEXTURE_STREAM_H_
+
+#include "grid.h"
+#include <raylib.h>
+#include <stddef.h>
+
+// Number of pixel buffer objects each stream rotates through, so the buffer
+// written this frame is never one the driver may still be reading from
+#define TEXTURE_STREAM_BUFFERS 3
+
+// A grid-sized RGBA8 texture kept in sync with a Grid by uploading only its
+// dirty regions. Cells are copied as they are, without conversion.
+typedef struct {
+  Texture texture;
+  size_t w, h;
+
+  // Pixel buffer ring (OpenGL on Linux), otherwise a staging buffer for
+  // regions narrower than the grid
+  unsigned int pbos[TEXTURE_STREAM_BUFFERS];
+  int next;
+  unsigned char *staging;
+} TextureStream;
+
+TextureStream texture_stream_init(size_t w, size_t h);
+void texture_stream_upload(TextureStream *stream, Grid *grid);
+void texture_stream_free(TextureStream *stream);
+
+// Blocks until all queued uploads have finished, for benchmarking
+void texture_stream_finish(void);
+
+#endif // TEXTURE_STREAM_H_
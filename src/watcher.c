@@ -0,0 +1,286 @@
+#include "watcher.h"
+#include "slog.h"
+#include <stdlib.h>
+
+#ifdef __linux__
+#include <assert.h>
+#include <dirent.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define WATCH_MASK                                                             \
+  (IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE |            \
+   IN_MOVED_FROM | IN_MOVED_TO)
+
+// A growable list of unique strings
+typedef struct {
+  char **items;
+  size_t count, capacity;
+} PathList;
+
+struct Watcher {
+  char *root;
+  int fd;
+  int stop_pipe[2];
+  pthread_t thread;
+
+  // Watched directories relative to the root ("" is the root), indexed by
+  // watch descriptor. Only touched by the watcher thread.
+  char **dirs;
+  size_t dir_capacity;
+
+  PathList pending; // watcher thread only, waiting for the burst to settle
+
+  pthread_mutex_t lock;
+  PathList ready; // settled, guarded by `lock`
+  atomic_bool has_ready;
+};
+
+static bool path_list_add(PathList *list, const char *path) {
+  for (size_t i = 0; i < list->count; i++) {
+    if (strcmp(list->items[i], path) == 0)
+      return false;
+  }
+
+  if (list->count == list->capacity) {
+    list->capacity = list->capacity ? list->capacity * 2 : 16;
+    list->items = realloc(list->items, list->capacity * sizeof(char *));
+    assert(list->items);
+  }
+
+  list->items[list->count++] = strdup(path);
+  return true;
+}
+
+static void path_list_clear(PathList *list) {
+  for (size_t i = 0; i < list->count; i++)
+    free(list->items[i]);
+  list->count = 0;
+}
+
+static const char *join_path(const char *dir, const char *name, char *buf,
+                             size_t size) {
+  snprintf(buf, size, "%s%s%s", dir, *dir ? "/" : "", name);
+  return buf;
+}
+
+// Watches `dir` (relative to the root) and every directory below it. Files
+// found along the way are reported as changed when `report_files` is set, for
+// directories that appear after startup.
+static void watch_tree(Watcher *watcher, const char *dir, bool report_files) {
+  char full[4096];
+  snprintf(full, sizeof full, "%s%s%s", watcher->root, *dir ? "/" : "", dir);
+
+  int wd = inotify_add_watch(watcher->fd, full, WATCH_MASK);
+  if (wd < 0) {
+    warning("Failed to watch %s", full);
+    return;
+  }
+
+  if ((size_t)wd >= watcher->dir_capacity) {
+    size_t capacity = watcher->dir_capacity * 2;
+    while (capacity <= (size_t)wd)
+      capacity *= 2;
+    watcher->dirs = realloc(watcher->dirs, capacity * sizeof(char *));
+    assert(watcher->dirs);
+    memset(&watcher->dirs[watcher->dir_capacity], 0,
+           (capacity - watcher->dir_capacity) * sizeof(char *));
+    watcher->dir_capacity = capacity;
+  }
+  free(watcher->dirs[wd]);
+  watcher->dirs[wd] = strdup(dir);
+
+  DIR *d = opendir(full);
+  if (!d)
+    return;
+
+  struct dirent *entry;
+  while ((entry = readdir(d)) != NULL) {
+    if (entry->d_name[0] == '.')
+      continue; // ., .. and hidden directories such as .git
+
+    char child[4096], child_full[4096];
+    join_path(dir, entry->d_name, child, sizeof child);
+    join_path(full, entry->d_name, child_full, sizeof child_full);
+
+    struct stat st;
+    if (stat(child_full, &st) != 0)
+      continue;
+
+    if (S_ISDIR(st.st_mode)) {
+      watch_tree(watcher, child, report_files);
+    } else if (report_files) {
+      path_list_add(&watcher->pending, child);
+    }
+  }
+
+  closedir(d);
+}
+
+static void read_events(Watcher *watcher) {
+  char buffer[4096]
+      __attribute__((aligned(__alignof__(struct inotify_event))));
+  ssize_t length = read(watcher->fd, buffer, sizeof buffer);
+
+  for (ssize_t i = 0; i < length;) {
+    const struct inotify_event *event =
+        (const struct inotify_event *)&buffer[i];
+    i += sizeof(struct inotify_event) + event->len;
+
+    // Hidden entries are editor swap files, the chunk cache and the like
+    if (event->len == 0 || event->name[0] == '.' || event->wd < 0 ||
+        (size_t)event->wd >= watcher->dir_capacity ||
+        !watcher->dirs[event->wd])
+      continue;
+
+    char path[4096];
+    join_path(watcher->dirs[event->wd], event->name, path, sizeof path);
+
+    if (event->mask & IN_ISDIR) {
+      if (event->mask & (IN_CREATE | IN_MOVED_TO))
+        watch_tree(watcher, path, true);
+      continue;
+    }
+
+    path_list_add(&watcher->pending, path);
+  }
+}
+
+// Moves the settled pending changes over to the main thread
+static void publish(Watcher *watcher) {
+  pthread_mutex_lock(&watcher->lock);
+  for (size_t i = 0; i < watcher->pending.count; i++)
+    path_list_add(&watcher->ready, watcher->pending.items[i]);
+  atomic_store(&watcher->has_ready, true);
+  pthread_mutex_unlock(&watcher->lock);
+
+  path_list_clear(&watcher->pending);
+}
+
+static void *watcher_thread(void *arg) {
+  Watcher *watcher = arg;
+
+  struct pollfd fds[2] = {
+      {.fd = watcher->fd, .events = POLLIN},
+      {.fd = watcher->stop_pipe[0], .events = POLLIN},
+  };
+
+  for (;;) {
+    // Sleep until something happens, or until a burst has been quiet for
+    // the debounce time
+    int timeout = watcher->pending.count ? WATCHER_DEBOUNCE_MS : -1;
+    int ready = poll(fds, 2, timeout);
+
+    if (fds[1].revents)
+      break;
+
+    if (ready == 0) {
+      publish(watcher);
+    } else if (ready > 0 && fds[0].revents & POLLIN) {
+      read_events(watcher);
+    }
+  }
+
+  return NULL;
+}
+
+Watcher *watcher_start(const char *root) {
+  Watcher *watcher = calloc(1, sizeof(Watcher));
+  assert(watcher);
+
+  watcher->root = strdup(root);
+  watcher->fd = inotify_init1(IN_CLOEXEC);
+  if (watcher->fd < 0 || pipe(watcher->stop_pipe) != 0) {
+    error("Failed to start the file watcher");
+    if (watcher->fd >= 0)
+      close(watcher->fd);
+    free(watcher->root);
+    free(watcher);
+    return NULL;
+  }
+
+  watcher->dir_capacity = 64;
+  watcher->dirs = calloc(watcher->dir_capacity, sizeof(char *));
+  assert(watcher->dirs);
+  watch_tree(watcher, "", false);
+
+  pthread_mutex_init(&watcher->lock, NULL);
+  atomic_init(&watcher->has_ready, false);
+  pthread_create(&watcher->thread, NULL, watcher_thread, watcher);
+
+  info("Watching %s for changes", root);
+  return watcher;
+}
+
+size_t watcher_poll(Watcher *watcher, char ***paths) {
+  if (!watcher || !atomic_load(&watcher->has_ready))
+    return 0;
+
+  pthread_mutex_lock(&watcher->lock);
+  *paths = watcher->ready.items;
+  size_t count = watcher->ready.count;
+  watcher->ready = (PathList){0};
+  atomic_store(&watcher->has_ready, false);
+  pthread_mutex_unlock(&watcher->lock);
+
+  return count;
+}
+
+void watcher_free_changes(char **paths, size_t count) {
+  for (size_t i = 0; i < count; i++)
+    free(paths[i]);
+  free(paths);
+}
+
+void watcher_stop(Watcher *watcher) {
+  if (!watcher)
+    return;
+
+  ssize_t written = write(watcher->stop_pipe[1], "", 1);
+  (void)written;
+  pthread_join(watcher->thread, NULL);
+
+  close(watcher->stop_pipe[0]);
+  close(watcher->stop_pipe[1]);
+  close(watcher->fd);
+  pthread_mutex_destroy(&watcher->lock);
+
+  for (size_t i = 0; i < watcher->dir_capacity; i++)
+    free(watcher->dirs[i]);
+  free(watcher->dirs);
+  path_list_clear(&watcher->pending);
+  free(watcher->pending.items);
+  path_list_clear(&watcher->ready);
+  free(watcher->ready.items);
+  free(watcher->root);
+  free(watcher);
+}
+
+#else
+
+Watcher *watcher_start(const char *root) {
+  warning("Hot reload is only supported on Linux, not watching %s", root);
+  return NULL;
+}
+
+void watcher_stop(Watcher *watcher) { (void)watcher; }
+
+size_t watcher_poll(Watcher *watcher, char ***paths) {
+  (void)watcher;
+  (void)paths;
+  return 0;
+}
+
+void watcher_free_changes(char **paths, size_t count) {
+  (void)count;
+  free(paths);
+}
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef WATCHER_H_
+#define WATCHER_H_
+
+#include <stddef.h>
+
+// Quiet time after the last file event before a burst of changes (like the
+// several events of one editor save) is handed over as a single batch
+#define WATCHER_DEBOUNCE_MS 100
+
+// Watches a directory tree from a background thread (inotify, Linux only)
+typedef struct Watcher Watcher;
+
+// Returns NULL when watching is unsupported or fails
+Watcher *watcher_start(const char *root);
+void watcher_stop(Watcher *watcher);
+
+// Takes the settled changes: paths relative to the root, each listed once.
+// Returns the count, 0 without touching the watcher's lock when nothing
+// changed. Free the list with watcher_free_changes.
+size_t watcher_poll(Watcher *watcher, char ***paths);
+void watcher_free_changes(char **paths, size_t count);
+
+#endif // WATCHER_H_